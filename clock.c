@@ -19,11 +19,14 @@
 #include <errno.h>
 #include <time.h>
 #include <linux/net_tstamp.h>
+#include <math.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
+#include <unistd.h>
 
 #include "address.h"
 #include "bmc.h"
@@ -37,15 +40,29 @@
 #include "phc.h"
 #include "port.h"
 #include "servo.h"
+#include "shm_status.h"
 #include "stats.h"
 #include "print.h"
 #include "rtnl.h"
 #include "tlv.h"
 #include "tsproc.h"
+#include "twheel.h"
 #include "uds.h"
 #include "util.h"
 
 #define N_CLOCK_PFD (N_POLLFD + 1) /* one extra per port, for the fault timer */
+#define CLOCK_TWHEEL_COOKIE NULL /* epoll data of the timer wheel */
+
+/*
+ * The descriptors are registered level triggered by default. Building
+ * with -DCLOCK_EPOLL_ET selects edge triggered mode, in which case
+ * every ready descriptor is drained before moving on to the next one.
+ */
+#ifdef CLOCK_EPOLL_ET
+#define CLOCK_EPOLL_EVENTS (EPOLLIN|EPOLLPRI|EPOLLET)
+#else
+#define CLOCK_EPOLL_EVENTS (EPOLLIN|EPOLLPRI)
+#endif
 #define POW2_41 ((double)(1ULL << 41))
 
 struct interface {
@@ -67,9 +84,33 @@ struct clock_stats {
 	struct stats *offset;
 	struct stats *freq;
 	struct stats *delay;
+	/* The offset and delay of the last completed interval. */
+	struct stats *last_offset;
+	struct stats *last_delay;
 	unsigned int max_count;
 };
 
+struct clock_fds;
+
+struct clock_fd {
+	struct clock_fds *owner;
+	int index; /* FD_xxx, or N_POLLFD for the fault timer */
+	int fd;    /* as registered with epoll, or -1 for timers */
+};
+
+struct clock_fds {
+	TAILQ_ENTRY(clock_fds) list;
+	struct port *port;
+	unsigned int skip; /* poll generation in which to ignore events */
+	int sde;           /* the port needs a state decision */
+	int new_best;      /* its Erbest changed in this state decision */
+	unsigned int checked; /* state decision that last refreshed Erbest */
+	int heap;          /* index into the Erbest heap, or -1 */
+	struct foreign_clock *best; /* Erbest, as of the last decision */
+	struct dataset erbest;      /* a copy of its dataset, the heap key */
+	struct clock_fd fd[N_CLOCK_PFD];
+};
+
 struct clock_subscriber {
 	LIST_ENTRY(clock_subscriber) list;
 	uint8_t events[EVENT_BITMASK_CNT];
@@ -96,11 +137,19 @@ struct clock {
 	struct ClockIdentity best_id;
 	LIST_HEAD(ports_head, port) ports;
 	struct port *uds_port;
-	struct pollfd *pollfd;
-	int pollfd_valid;
+	int epoll_fd;
+	struct twheel *twheel;
+	struct epoll_event *events;
+	unsigned int poll_gen;
+	TAILQ_HEAD(clock_fds_head, clock_fds) fds;
+	struct clock_fds **erbest; /* heap of the ports with an Erbest */
+	int n_erbest;
 	int nports; /* does not include the UDS port */
 	int last_port_number;
 	int sde;
+	int sde_all; /* every port needs a state decision */
+	unsigned int sde_gen; /* counts the state decisions */
+	struct defaultDS sde_dds; /* as of the last state decision */
 	int free_running;
 	int freq_est_interval;
 	int local_sync_uncertain;
@@ -116,6 +165,7 @@ struct clock {
 	UInteger8 max_steps_removed;
 	enum servo_state servo_state;
 	enum timestamp_type timestamping;
+	double servo_freq; /* the last frequency adjustment */
 	tmv_t master_offset;
 	tmv_t path_delay;
 	tmv_t ingress_ts;
@@ -132,14 +182,20 @@ struct clock {
 	struct interface *udsif;
 	LIST_HEAD(clock_subscribers_head, clock_subscriber) subscribers;
 	struct monitor *slave_event_monitor;
+	struct shm_status *status_shm;
 };
 
 struct clock the_clock;
 
 static void handle_state_decision_event(struct clock *c);
-static int clock_resize_pollfd(struct clock *c, int new_nports);
+static void clock_heap_remove(struct clock *c, struct clock_fds *fds);
+static int clock_resize_events(struct clock *c, int new_nports);
+static int clock_register_fds(struct clock *c, struct port *p);
+static void clock_unregister_fds(struct clock *c, struct port *p);
 static void clock_remove_port(struct clock *c, struct port *p);
 static void clock_stats_display(struct clock_stats *s);
+static void clock_stats_rotate(struct clock_stats *s);
+static void clock_stats_fill(struct clock_stats *s, struct clock_stats_np *csn);
 
 static void remove_subscriber(struct clock_subscriber *s)
 {
@@ -273,8 +329,16 @@ void clock_destroy(struct clock *c)
 		clock_remove_port(c, p);
 	}
 	monitor_destroy(c->slave_event_monitor);
+	clock_unregister_fds(c, c->uds_port);
 	port_close(c->uds_port);
-	free(c->pollfd);
+	if (c->epoll_fd >= 0) {
+		close(c->epoll_fd);
+	}
+	if (c->twheel) {
+		twheel_destroy(c->twheel);
+	}
+	free(c->events);
+	free(c->erbest);
 	if (c->clkid != CLOCK_REALTIME) {
 		phc_close(c->clkid);
 	}
@@ -283,12 +347,16 @@ void clock_destroy(struct clock *c)
 	stats_destroy(c->stats.offset);
 	stats_destroy(c->stats.freq);
 	stats_destroy(c->stats.delay);
+	stats_destroy(c->stats.last_offset);
+	stats_destroy(c->stats.last_delay);
+	if (c->status_shm) {
+		shm_status_close(c->status_shm);
+	}
 	if (c->sanity_check) {
 		clockcheck_destroy(c->sanity_check);
 	}
 	memset(c, 0, sizeof(*c));
 	msg_cleanup();
-	tc_cleanup();
 }
 
 static int clock_fault_timeout(struct port *port, int set)
@@ -342,7 +410,10 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 	struct management_tlv_datum *mtd;
 	struct subscribe_events_np *sen;
 	struct management_tlv *tlv;
+	struct msg_pool_stats_np *mps;
+	struct clock_stats_np *csn;
 	struct time_status_np *tsn;
+	struct msg_pool_stats stats;
 	struct tlv_extra *extra;
 	struct PTPText *text;
 	int datalen = 0;
@@ -455,6 +526,21 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 		mtd->val = c->local_sync_uncertain;
 		datalen = sizeof(*mtd);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		msg_pool_stats(&stats);
+		mps = (struct msg_pool_stats_np *) tlv->data;
+		mps->total = stats.total;
+		mps->in_use = stats.in_use;
+		mps->high_water = stats.high_water;
+		mps->limit = stats.limit;
+		mps->failures = stats.failures;
+		datalen = sizeof(*mps);
+		break;
+	case TLV_CLOCK_STATS_NP:
+		csn = (struct clock_stats_np *) tlv->data;
+		clock_stats_fill(&c->stats, csn);
+		datalen = sizeof(*csn);
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		tlv_extra_recycle(extra);
@@ -536,8 +622,10 @@ static int clock_management_set(struct clock *c, struct port *p,
 		case SYNC_UNCERTAIN_TRUE:
 			/* Display stats on change of local_sync_uncertain */
 			if (c->local_sync_uncertain != mtd->val
-			    && stats_get_num_values(c->stats.offset))
+			    && stats_get_num_values(c->stats.offset)) {
 				clock_stats_display(&c->stats);
+				clock_stats_rotate(&c->stats);
+			}
 			c->local_sync_uncertain = mtd->val;
 			respond = 1;
 			break;
@@ -558,7 +646,10 @@ static void clock_stats_update(struct clock_stats *s,
 	if (stats_get_num_values(s->offset) < s->max_count)
 		return;
 
-	clock_stats_display(s);
+	/* Single samples are printed as they come. */
+	if (s->max_count > 1)
+		clock_stats_display(s);
+	clock_stats_rotate(s);
 }
 
 static void clock_stats_display(struct clock_stats *s)
@@ -570,24 +661,59 @@ static void clock_stats_display(struct clock_stats *s)
 
 	/* Path delay stats are updated separately, they may be empty. */
 	if (!stats_get_result(s->delay, &delay_stats)) {
-		pr_info("rms %4.0f max %4.0f "
+		pr_info("rms %4.0f max %4.0f p99 %4.0f p99.9 %4.0f "
 			"freq %+6.0f +/- %3.0f "
-			"delay %5.0f +/- %3.0f",
+			"delay %5.0f +/- %3.0f p99 %5.0f",
 			offset_stats.rms, offset_stats.max_abs,
+			offset_stats.p99, offset_stats.p999,
 			freq_stats.mean, freq_stats.stddev,
-			delay_stats.mean, delay_stats.stddev);
+			delay_stats.mean, delay_stats.stddev,
+			delay_stats.p99);
 	} else {
-		pr_info("rms %4.0f max %4.0f "
+		pr_info("rms %4.0f max %4.0f p99 %4.0f p99.9 %4.0f "
 			"freq %+6.0f +/- %3.0f",
 			offset_stats.rms, offset_stats.max_abs,
+			offset_stats.p99, offset_stats.p999,
 			freq_stats.mean, freq_stats.stddev);
 	}
+}
+
+static void clock_stats_rotate(struct clock_stats *s)
+{
+	/* Keep the interval for the CLOCK_STATS_NP management TLV. */
+	stats_reset(s->last_offset);
+	stats_reset(s->last_delay);
+	stats_merge(s->last_offset, s->offset);
+	stats_merge(s->last_delay, s->delay);
 
 	stats_reset(s->offset);
 	stats_reset(s->freq);
 	stats_reset(s->delay);
 }
 
+static void clock_stats_fill(struct clock_stats *s, struct clock_stats_np *csn)
+{
+	struct stats_result offset_stats, delay_stats;
+
+	memset(csn, 0, sizeof(*csn));
+	if (stats_get_result(s->last_offset, &offset_stats))
+		return;
+
+	csn->samples = stats_get_num_values(s->last_offset);
+	csn->offset_rms = llround(offset_stats.rms);
+	csn->offset_max = llround(offset_stats.max_abs);
+	csn->offset_p50 = llround(offset_stats.p50);
+	csn->offset_p99 = llround(offset_stats.p99);
+	csn->offset_p999 = llround(offset_stats.p999);
+
+	if (stats_get_result(s->last_delay, &delay_stats))
+		return;
+
+	csn->delay_mean = llround(delay_stats.mean);
+	csn->delay_p99 = llround(delay_stats.p99);
+	csn->delay_p999 = llround(delay_stats.p999);
+}
+
 static enum servo_state clock_no_adjust(struct clock *c, tmv_t ingress,
 					tmv_t origin)
 {
@@ -630,9 +756,8 @@ static enum servo_state clock_no_adjust(struct clock *c, tmv_t ingress,
 		tmv_dbl(tmv_sub(ingress, f->ingress1));
 	freq = (1.0 - ratio) * 1e9;
 
-	if (c->stats.max_count > 1) {
-		clock_stats_update(&c->stats, tmv_dbl(c->master_offset), freq);
-	} else {
+	clock_stats_update(&c->stats, tmv_dbl(c->master_offset), freq);
+	if (c->stats.max_count <= 1) {
 		pr_info("master offset %10" PRId64 " s%d freq %+7.0f "
 			"path delay %9" PRId64,
 			tmv_to_nanoseconds(c->master_offset), state, freq,
@@ -677,21 +802,19 @@ static void clock_update_grandmaster(struct clock *c)
 static void clock_update_slave(struct clock *c)
 {
 	struct parentDS *pds = &c->dad.pds;
-	struct ptp_message *msg;
 
 	if (!c->best)
 		return;
 
-	msg                            = TAILQ_FIRST(&c->best->messages);
 	c->cur.stepsRemoved            = 1 + c->best->dataset.stepsRemoved;
 	pds->parentPortIdentity        = c->best->dataset.sender;
-	pds->grandmasterIdentity       = msg->announce.grandmasterIdentity;
-	pds->grandmasterClockQuality   = msg->announce.grandmasterClockQuality;
-	pds->grandmasterPriority1      = msg->announce.grandmasterPriority1;
-	pds->grandmasterPriority2      = msg->announce.grandmasterPriority2;
-	c->tds.currentUtcOffset        = msg->announce.currentUtcOffset;
-	c->tds.flags                   = msg->header.flagField[1];
-	c->tds.timeSource              = msg->announce.timeSource;
+	pds->grandmasterIdentity       = c->best->dataset.identity;
+	pds->grandmasterClockQuality   = c->best->dataset.quality;
+	pds->grandmasterPriority1      = c->best->dataset.priority1;
+	pds->grandmasterPriority2      = c->best->dataset.priority2;
+	c->tds.currentUtcOffset        = c->best->currentUtcOffset;
+	c->tds.flags                   = c->best->flags;
+	c->tds.timeSource              = c->best->timeSource;
 	if (!(c->tds.flags & PTP_TIMESCALE)) {
 		pr_warning("foreign master not using PTP timescale");
 	}
@@ -818,13 +941,17 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 {
 	struct port *p, *piter, *lastp = NULL;
 
-	if (clock_resize_pollfd(c, c->nports + 1)) {
+	if (clock_resize_events(c, c->nports + 1)) {
 		return -1;
 	}
 	p = port_open(phc_device, phc_index, timestamping,
 		      ++c->last_port_number, iface, c);
 	if (!p) {
-		/* No need to shrink pollfd */
+		/* No need to shrink the event array */
+		return -1;
+	}
+	if (clock_register_fds(c, p)) {
+		port_close(p);
 		return -1;
 	}
 	LIST_FOREACH(piter, &c->ports, list) {
@@ -836,21 +963,20 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 		LIST_INSERT_HEAD(&c->ports, p, list);
 	}
 	c->nports++;
-	clock_fda_changed(c);
 
 	return 0;
 }
 
 static void clock_remove_port(struct clock *c, struct port *p)
 {
-	/* Do not call clock_resize_pollfd, it's pointless to shrink
+	/* Do not call clock_resize_events, it's pointless to shrink
 	 * the allocated memory at this point, clock_destroy will free
 	 * it all anyway. This function is usable from other parts of
-	 * the code, but even then we don't mind if pollfd is larger
-	 * than necessary. */
+	 * the code, but even then we don't mind if the event array is
+	 * larger than necessary. */
 	LIST_REMOVE(p, list);
 	c->nports--;
-	clock_fda_changed(c);
+	clock_unregister_fds(c, p);
 	port_close(p);
 }
 
@@ -886,7 +1012,7 @@ int clock_required_modes(struct clock *c)
 struct clock *clock_create(enum clock_type type, struct config *config,
 			   const char *phc_device)
 {
-	enum servo_type servo = config_get_int(config, NULL, "clock_servo");
+	enum servo_type servo = config_int(config, 0, CFG_CLOCK_SERVO);
 	char ts_label[IF_NAMESIZE], phc[32], *tmp;
 	enum timestamp_type timestamping;
 	int fadj = 0, max_adj = 0, sw_ts;
@@ -896,6 +1022,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	struct port *p;
 	unsigned char oui[OUI_LEN];
 	struct interface *iface;
+	struct epoll_event ev;
 	struct timespec ts;
 	int sfl;
 
@@ -919,74 +1046,74 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 
 	/* Initialize the defaultDS. */
 	c->dds.clockQuality.clockClass =
-		config_get_int(config, NULL, "clockClass");
+		config_int(config, 0, CFG_CLOCK_CLASS);
 	c->dds.clockQuality.clockAccuracy =
-		config_get_int(config, NULL, "clockAccuracy");
+		config_int(config, 0, CFG_CLOCK_ACCURACY);
 	c->dds.clockQuality.offsetScaledLogVariance =
-		config_get_int(config, NULL, "offsetScaledLogVariance");
+		config_int(config, 0, CFG_OFFSET_SCALED_LOG_VARIANCE);
 
 	c->desc.productDescription.max_symbols = 64;
 	c->desc.revisionData.max_symbols = 32;
 	c->desc.userDescription.max_symbols = 128;
 
-	tmp = config_get_string(config, NULL, "productDescription");
+	tmp = config_string(config, 0, CFG_PRODUCT_DESCRIPTION);
 	if (count_char(tmp, ';') != 2 ||
 	    static_ptp_text_set(&c->desc.productDescription, tmp)) {
 		pr_err("invalid productDescription '%s'", tmp);
 		return NULL;
 	}
-	tmp = config_get_string(config, NULL, "revisionData");
+	tmp = config_string(config, 0, CFG_REVISION_DATA);
 	if (count_char(tmp, ';') != 2 ||
 	    static_ptp_text_set(&c->desc.revisionData, tmp)) {
 		pr_err("invalid revisionData '%s'", tmp);
 		return NULL;
 	}
-	tmp = config_get_string(config, NULL, "userDescription");
+	tmp = config_string(config, 0, CFG_USER_DESCRIPTION);
 	if (static_ptp_text_set(&c->desc.userDescription, tmp)) {
 		pr_err("invalid userDescription '%s'", tmp);
 		return NULL;
 	}
-	tmp = config_get_string(config, NULL, "manufacturerIdentity");
+	tmp = config_string(config, 0, CFG_MANUFACTURER_IDENTITY);
 	if (OUI_LEN != sscanf(tmp, "%hhx:%hhx:%hhx", &oui[0], &oui[1], &oui[2])) {
 		pr_err("invalid manufacturerIdentity '%s'", tmp);
 		return NULL;
 	}
 	memcpy(c->desc.manufacturerIdentity, oui, OUI_LEN);
 
-	c->dds.domainNumber = config_get_int(config, NULL, "domainNumber");
+	c->dds.domainNumber = config_int(config, 0, CFG_DOMAIN_NUMBER);
 
-	if (config_get_int(config, NULL, "clientOnly")) {
+	if (config_int(config, 0, CFG_CLIENT_ONLY)) {
 		c->dds.flags |= DDS_SLAVE_ONLY;
 	}
-	if (!config_get_int(config, NULL, "gmCapable") &&
+	if (!config_int(config, 0, CFG_GM_CAPABLE) &&
 	    c->dds.flags & DDS_SLAVE_ONLY) {
 		pr_err("Cannot mix 1588 clientOnly with 802.1AS !gmCapable");
 		return NULL;
 	}
-	if (!config_get_int(config, NULL, "gmCapable") ||
+	if (!config_int(config, 0, CFG_GM_CAPABLE) ||
 	    c->dds.flags & DDS_SLAVE_ONLY) {
 		c->dds.clockQuality.clockClass = 255;
 	}
 	c->default_dataset.localPriority =
-		config_get_int(config, NULL, "G.8275.defaultDS.localPriority");
-	c->max_steps_removed = config_get_int(config, NULL,"maxStepsRemoved");
+		config_int(config, 0, CFG_G8275_DEFAULT_DS_LOCAL_PRIORITY);
+	c->max_steps_removed = config_int(config, 0, CFG_MAX_STEPS_REMOVED);
 
 	/* Harmonize the twoStepFlag with the time_stamping option. */
 	if (config_harmonize_onestep(config)) {
 		return NULL;
 	}
-	if (config_get_int(config, NULL, "twoStepFlag")) {
+	if (config_int(config, 0, CFG_TWO_STEP_FLAG)) {
 		c->dds.flags |= DDS_TWO_STEP_FLAG;
 	}
-	timestamping = config_get_int(config, NULL, "time_stamping");
+	timestamping = config_int(config, 0, CFG_TIME_STAMPING);
 	if (timestamping == TS_SOFTWARE) {
 		sw_ts = 1;
 	} else {
 		sw_ts = 0;
 	}
 
-	c->dds.priority1 = config_get_int(config, NULL, "priority1");
-	c->dds.priority2 = config_get_int(config, NULL, "priority2");
+	c->dds.priority1 = config_int(config, 0, CFG_PRIORITY1);
+	c->dds.priority2 = config_int(config, 0, CFG_PRIORITY2);
 
 	/* Check the time stamping mode on each interface. */
 	c->timestamping = timestamping;
@@ -1008,7 +1135,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	iface = STAILQ_FIRST(&config->interfaces);
 
 	/* determine PHC Clock index */
-	if (config_get_int(config, NULL, "free_running")) {
+	if (config_int(config, 0, CFG_FREE_RUNNING)) {
 		phc_index = -1;
 	} else if (timestamping == TS_SOFTWARE || timestamping == TS_LEGACY_HW) {
 		phc_index = -1;
@@ -1027,7 +1154,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		pr_info("selected /dev/ptp%d as PTP clock", phc_index);
 	}
 
-	if (strcmp(config_get_string(config, NULL, "clockIdentity"),
+	if (strcmp(config_string(config, 0, CFG_CLOCK_IDENTITY),
 		   "000000.0000.000000") == 0) {
 		if (generate_clock_identity(&c->dds.clockIdentity,
 					    interface_name(iface))) {
@@ -1035,7 +1162,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 			return NULL;
 		}
 	} else {
-		if (str2cid(config_get_string(config, NULL, "clockIdentity"),
+		if (str2cid(config_string(config, 0, CFG_CLOCK_IDENTITY),
 					      &c->dds.clockIdentity)) {
 			pr_err("failed to set clock identity");
 			return NULL;
@@ -1043,7 +1170,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	}
 
 	/* Configure the UDS. */
-	uds_ifname = config_get_string(config, NULL, "uds_address");
+	uds_ifname = config_string(config, 0, CFG_UDS_ADDRESS);
 	c->udsif = interface_create(uds_ifname);
 	if (config_set_section_int(config, interface_name(c->udsif),
 				   "announceReceiptTimeout", 0)) {
@@ -1063,14 +1190,14 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	}
 
 	c->config = config;
-	c->free_running = config_get_int(config, NULL, "free_running");
-	c->freq_est_interval = config_get_int(config, NULL, "freq_est_interval");
+	c->free_running = config_int(config, 0, CFG_FREE_RUNNING);
+	c->freq_est_interval = config_int(config, 0, CFG_FREQ_EST_INTERVAL);
 	c->local_sync_uncertain = SYNC_UNCERTAIN_DONTCARE;
-	c->write_phase_mode = config_get_int(config, NULL, "write_phase_mode");
-	c->grand_master_capable = config_get_int(config, NULL, "gmCapable");
-	c->kernel_leap = config_get_int(config, NULL, "kernel_leap");
-	c->utc_offset = config_get_int(config, NULL, "utc_offset");
-	c->time_source = config_get_int(config, NULL, "timeSource");
+	c->write_phase_mode = config_int(config, 0, CFG_WRITE_PHASE_MODE);
+	c->grand_master_capable = config_int(config, 0, CFG_GM_CAPABLE);
+	c->kernel_leap = config_int(config, 0, CFG_KERNEL_LEAP);
+	c->utc_offset = config_int(config, 0, CFG_UTC_OFFSET);
+	c->time_source = config_int(config, 0, CFG_TIME_SOURCE);
 
 	if (c->free_running) {
 		c->clkid = CLOCK_INVALID;
@@ -1130,30 +1257,40 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	}
 	c->servo_state = SERVO_UNLOCKED;
 	c->servo_type = servo;
-	if (config_get_int(config, NULL, "dataset_comparison") == DS_CMP_G8275) {
+	if (config_int(config, 0, CFG_DATASET_COMPARISON) == DS_CMP_G8275) {
 		c->dscmp = telecom_dscmp;
 	} else {
 		c->dscmp = dscmp;
 	}
-	c->tsproc = tsproc_create(config_get_int(config, NULL, "tsproc_mode"),
-				  config_get_int(config, NULL, "delay_filter"),
-				  config_get_int(config, NULL, "delay_filter_length"));
+	c->tsproc = tsproc_create(config_int(config, 0, CFG_TSPROC_MODE),
+				  config_int(config, 0, CFG_DELAY_FILTER),
+				  config_int(config, 0,
+					     CFG_DELAY_FILTER_LENGTH));
 	if (!c->tsproc) {
 		pr_err("Failed to create time stamp processor");
 		return NULL;
 	}
-	c->initial_delay = dbl_tmv(config_get_int(config, NULL, "initial_delay"));
+	c->initial_delay = dbl_tmv(config_int(config, 0, CFG_INITIAL_DELAY));
 	c->master_local_rr = 1.0;
 	c->nrr = 1.0;
-	c->stats_interval = config_get_int(config, NULL, "summary_interval");
+	c->stats_interval = config_int(config, 0, CFG_SUMMARY_INTERVAL);
 	c->stats.offset = stats_create();
 	c->stats.freq = stats_create();
 	c->stats.delay = stats_create();
-	if (!c->stats.offset || !c->stats.freq || !c->stats.delay) {
+	c->stats.last_offset = stats_create();
+	c->stats.last_delay = stats_create();
+	if (!c->stats.offset || !c->stats.freq || !c->stats.delay ||
+	    !c->stats.last_offset || !c->stats.last_delay) {
 		pr_err("failed to create stats");
 		return NULL;
 	}
-	sfl = config_get_int(config, NULL, "sanity_freq_limit");
+	if (config_int(config, 0, CFG_STATUS_SHM)) {
+		c->status_shm = shm_status_create(uds_ifname);
+		if (!c->status_shm) {
+			return NULL;
+		}
+	}
+	sfl = config_int(config, 0, CFG_SANITY_FREQ_LIMIT);
 	if (sfl) {
 		c->sanity_check = clockcheck_create(sfl);
 		if (!c->sanity_check) {
@@ -1173,10 +1310,28 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 
 	LIST_INIT(&c->subscribers);
 	LIST_INIT(&c->ports);
+	TAILQ_INIT(&c->fds);
 	c->last_port_number = 0;
 
-	if (clock_resize_pollfd(c, 0)) {
-		pr_err("failed to allocate pollfd");
+	c->epoll_fd = epoll_create1(0);
+	if (c->epoll_fd < 0) {
+		pr_err("epoll_create1 failed: %m");
+		return NULL;
+	}
+	if (clock_resize_events(c, 0)) {
+		pr_err("failed to allocate epoll events");
+		return NULL;
+	}
+	c->twheel = twheel_create();
+	if (!c->twheel) {
+		pr_err("failed to create the timer wheel");
+		return NULL;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = CLOCK_TWHEEL_COOKIE;
+	if (epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, twheel_fd(c->twheel), &ev)) {
+		pr_err("failed to add the timer wheel to epoll: %m");
 		return NULL;
 	}
 
@@ -1186,7 +1341,10 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		pr_err("failed to open the UDS port");
 		return NULL;
 	}
-	clock_fda_changed(c);
+	if (clock_register_fds(c, c->uds_port)) {
+		pr_err("failed to register the UDS port");
+		return NULL;
+	}
 
 	c->slave_event_monitor = monitor_create(config, c->uds_port);
 	if (!c->slave_event_monitor) {
@@ -1274,54 +1432,146 @@ struct ClockIdentity clock_identity(struct clock *c)
 	return c->dds.clockIdentity;
 }
 
-static int clock_resize_pollfd(struct clock *c, int new_nports)
+static int clock_resize_events(struct clock *c, int new_nports)
 {
-	struct pollfd *new_pollfd;
+	struct epoll_event *new_events;
+	struct clock_fds **new_erbest;
 
-	/* Need to allocate one whole extra block of fds for UDS. */
-	new_pollfd = realloc(c->pollfd,
-			     (new_nports + 1) * N_CLOCK_PFD *
-			     sizeof(struct pollfd));
-	if (!new_pollfd) {
+	/*
+	 * Need to allocate one whole extra block of fds for UDS, and
+	 * one more entry for the timer wheel.
+	 */
+	new_events = realloc(c->events,
+			     ((new_nports + 1) * N_CLOCK_PFD + 1) *
+			     sizeof(struct epoll_event));
+	if (!new_events) {
 		return -1;
 	}
-	c->pollfd = new_pollfd;
+	c->events = new_events;
+
+	if (new_nports) {
+		new_erbest = realloc(c->erbest, new_nports * sizeof(*new_erbest));
+		if (!new_erbest) {
+			return -1;
+		}
+		c->erbest = new_erbest;
+	}
 	return 0;
 }
 
-static void clock_fill_pollfd(struct pollfd *dest, struct port *p)
+static struct clock_fds *clock_find_fds(struct clock *c, struct port *p)
 {
+	struct clock_fds *fds;
+
+	TAILQ_FOREACH(fds, &c->fds, list) {
+		if (fds->port == p) {
+			return fds;
+		}
+	}
+	return NULL;
+}
+
+static void clock_fds_add(struct clock *c, struct clock_fds *fds)
+{
+	struct epoll_event ev;
 	struct fdarray *fda;
 	int i;
 
-	fda = port_fda(p);
+	fda = port_fda(fds->port);
 	for (i = 0; i < N_POLLFD; i++) {
-		dest[i].fd = fda->fd[i];
-		dest[i].events = POLLIN|POLLPRI;
+		fds->fd[i].fd = fda->fd[i];
+		if (fds->fd[i].fd < 0) {
+			continue;
+		}
+		memset(&ev, 0, sizeof(ev));
+		ev.events = CLOCK_EPOLL_EVENTS;
+		ev.data.ptr = &fds->fd[i];
+		if (epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, fds->fd[i].fd, &ev)) {
+			pr_err("port %d: failed to add fd %d to epoll: %m",
+			       port_number(fds->port), fds->fd[i].fd);
+			fds->fd[i].fd = -1;
+		}
 	}
-	dest[i].fd = port_fault_fd(p);
-	dest[i].events = POLLIN|POLLPRI;
 }
 
-static void clock_check_pollfd(struct clock *c)
+static void clock_fds_del(struct clock *c, struct clock_fds *fds)
 {
-	struct port *p;
-	struct pollfd *dest = c->pollfd;
+	int i;
 
-	if (c->pollfd_valid) {
+	/*
+	 * Descriptors which the port already closed have been dropped
+	 * from the epoll set by the kernel, so errors are expected here.
+	 */
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		if (fds->fd[i].fd >= 0) {
+			epoll_ctl(c->epoll_fd, EPOLL_CTL_DEL, fds->fd[i].fd, NULL);
+			fds->fd[i].fd = -1;
+		}
+	}
+}
+
+static int clock_register_fds(struct clock *c, struct port *p)
+{
+	struct twheel_timer *t;
+	struct clock_fds *fds;
+	int i;
+
+	fds = calloc(1, sizeof(*fds));
+	if (!fds) {
+		return -1;
+	}
+	fds->port = p;
+	fds->skip = c->poll_gen - 1;
+	fds->heap = -1;
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		fds->fd[i].owner = fds;
+		fds->fd[i].index = i;
+		fds->fd[i].fd = -1;
+		/* Expired timers are dispatched like ready descriptors. */
+		t = port_timer(p, i);
+		if (t) {
+			t->cookie = &fds->fd[i];
+		}
+	}
+	clock_fds_add(c, fds);
+	TAILQ_INSERT_TAIL(&c->fds, fds, list);
+	return 0;
+}
+
+static void clock_unregister_fds(struct clock *c, struct port *p)
+{
+	struct twheel_timer *t;
+	struct clock_fds *fds;
+	int i;
+
+	fds = clock_find_fds(c, p);
+	if (!fds) {
 		return;
 	}
-	LIST_FOREACH(p, &c->ports, list) {
-		clock_fill_pollfd(dest, p);
-		dest += N_CLOCK_PFD;
+	clock_fds_del(c, fds);
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		t = port_timer(p, i);
+		if (t) {
+			t->cookie = NULL;
+		}
 	}
-	clock_fill_pollfd(dest, c->uds_port);
-	c->pollfd_valid = 1;
+	clock_heap_remove(c, fds);
+	TAILQ_REMOVE(&c->fds, fds, list);
+	free(fds);
 }
 
-void clock_fda_changed(struct clock *c)
+void clock_fda_changed(struct clock *c, struct port *p)
 {
-	c->pollfd_valid = 0;
+	struct clock_fds *fds;
+
+	fds = clock_find_fds(c, p);
+	if (!fds) {
+		return;
+	}
+	clock_fds_del(c, fds);
+	clock_fds_add(c, fds);
+	/* Events already collected for the old descriptors are stale. */
+	fds->skip = c->poll_gen;
 }
 
 static int clock_do_forward_mgmt(struct clock *c,
@@ -1473,6 +1723,8 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 	case TLV_GRANDMASTER_SETTINGS_NP:
 	case TLV_SUBSCRIBE_EVENTS_NP:
 	case TLV_SYNCHRONIZATION_UNCERTAIN_NP:
+	case TLV_MSG_POOL_STATS_NP:
+	case TLV_CLOCK_STATS_NP:
 		clock_management_send_error(p, msg, TLV_NOT_SUPPORTED);
 		break;
 	default:
@@ -1533,78 +1785,210 @@ struct PortIdentity clock_parent_identity(struct clock *c)
 void clock_set_sde(struct clock *c, int sde)
 {
 	c->sde = sde;
+	c->sde_all = sde;
 }
 
-int clock_poll(struct clock *c)
+static int clock_event_cmp(const void *a, const void *b)
 {
-	int cnt, i;
+	const struct epoll_event *x = a, *y = b;
+	uintptr_t px = (uintptr_t) x->data.ptr, py = (uintptr_t) y->data.ptr;
+
+	return px < py ? -1 : px > py ? 1 : 0;
+}
+
+#ifdef CLOCK_EPOLL_ET
+static int clock_fd_pending(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	/* POLLPRI only flags the error queue. */
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+#endif
+
+static void clock_port_event(struct clock *c, struct clock_fd *cfd,
+			     uint32_t revents)
+{
+	struct clock_fds *fds = cfd->owner;
+	struct port *p = fds->port;
 	enum fsm_event event;
-	struct pollfd *cur;
+
+	if (p == c->uds_port) {
+		if (cfd->index < N_POLLFD && revents & (EPOLLIN|EPOLLPRI)) {
+			event = port_event(p, cfd->index);
+			if (EV_STATE_DECISION_EVENT == event) {
+				c->sde = 1;
+				c->sde_all = 1;
+			}
+		}
+		return;
+	}
+
+	/*
+	 * When the fault timer expires we clear the fault,
+	 * but only if the link is up.
+	 */
+	if (cfd->index == N_POLLFD) {
+		if (revents & (EPOLLIN|EPOLLPRI)) {
+			clock_fault_timeout(p, 0);
+			if (port_link_status_get(p)) {
+				port_dispatch(p, EV_FAULT_CLEARED, 0);
+			}
+		}
+		return;
+	}
+
+	do {
+		if (revents & EPOLLERR) {
+			/* Transmit time stamps wait on the error queue. */
+			event = port_tx_event(p, cfd->index);
+			revents &= ~EPOLLERR;
+		} else {
+			event = port_event(p, cfd->index);
+			revents &= ~EPOLLIN;
+		}
+		if (EV_STATE_DECISION_EVENT == event) {
+			c->sde = 1;
+			fds->sde = 1;
+		}
+		if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
+			c->sde = 1;
+			fds->sde = 1;
+		}
+		port_dispatch(p, event, 0);
+		/* Clear any fault after a little while. */
+		if (PS_FAULTY == port_state(p)) {
+			clock_fault_timeout(p, 1);
+			fds->skip = c->poll_gen;
+			return;
+		}
+		if (fds->skip == c->poll_gen) {
+			return;
+		}
+#ifdef CLOCK_EPOLL_ET
+	} while (revents & EPOLLIN || (cfd->fd >= 0 &&
+				       clock_fd_pending(cfd->fd)));
+#else
+	} while (revents & EPOLLIN);
+#endif
+}
+
+/*
+ * Hands a timer expiry of a skipped port to the next round, unless the
+ * port has armed or disarmed the timer meanwhile.
+ */
+static void clock_requeue_timer(struct clock *c, struct clock_fd *cfd)
+{
+	struct twheel_timer *t;
+
+	t = port_timer(cfd->owner->port, cfd->index);
+	if (t && twheel_fired(t)) {
+		twheel_set(c->twheel, t, 1);
+	}
+}
+
+/*
+ * Replaces the event of the timer wheel with one event per expired
+ * timer, and returns the new number of events.
+ */
+static int clock_expire_timers(struct clock *c, int cnt)
+{
+	struct twheel_timer *t;
+
+	if (twheel_advance(c->twheel)) {
+		return cnt;
+	}
+	while ((t = twheel_expired(c->twheel)) != NULL) {
+		if (!t->cookie) {
+			continue;
+		}
+		c->events[cnt].events = EPOLLIN;
+		c->events[cnt].data.ptr = t->cookie;
+		cnt++;
+	}
+	return cnt;
+}
+
+/*
+ * The snapshot is small, so it is simply written after every round of
+ * events instead of tracking each change of the data sets and ports.
+ */
+static void clock_publish_status(struct clock *c)
+{
+	struct shm_status_data *d;
 	struct port *p;
+	int n = 0;
+
+	d = shm_status_write_begin(c->status_shm);
+	d->dds = c->dds;
+	d->cds = c->cur;
+	d->pds = c->dad.pds;
+	d->tds = clock_time_properties(c);
+	d->master_offset = tmv_to_nanoseconds(c->master_offset);
+	d->freq = c->servo_freq;
+	d->servo_state = c->servo_state;
+	LIST_FOREACH(p, &c->ports, list) {
+		if (n == SHM_STATUS_MAX_PORTS) {
+			break;
+		}
+		port_status(p, &d->port[n++]);
+	}
+	d->num_ports = n;
+	shm_status_write_end(c->status_shm);
+}
 
-	clock_check_pollfd(c);
-	cnt = poll(c->pollfd, (c->nports + 1) * N_CLOCK_PFD, -1);
+int clock_poll(struct clock *c)
+{
+	struct clock_fd *cfd;
+	int cnt, i;
+
+	/* Refresh the status region even when nothing happens. */
+	cnt = epoll_wait(c->epoll_fd, c->events,
+			 (c->nports + 1) * N_CLOCK_PFD + 1,
+			 c->status_shm ? SHM_STATUS_INTERVAL_MS : -1);
 	if (cnt < 0) {
 		if (EINTR == errno) {
 			return 0;
 		} else {
-			pr_emerg("poll failed");
+			pr_emerg("epoll_wait failed");
 			return -1;
 		}
 	} else if (!cnt) {
+		if (c->status_shm) {
+			clock_publish_status(c);
+		}
 		return 0;
 	}
 
-	cur = c->pollfd;
-
-	LIST_FOREACH(p, &c->ports, list) {
-		/* Let the ports handle their events. */
-		for (i = 0; i < N_POLLFD; i++) {
-			if (cur[i].revents & (POLLIN|POLLPRI|POLLERR)) {
-				if (cur[i].revents & POLLERR) {
-					pr_err("port %d: unexpected socket error",
-					       port_number(p));
-					event = EV_FAULT_DETECTED;
-				} else {
-					event = port_event(p, i);
-				}
-				if (EV_STATE_DECISION_EVENT == event) {
-					c->sde = 1;
-				}
-				if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
-					c->sde = 1;
-				}
-				port_dispatch(p, event, 0);
-				/* Clear any fault after a little while. */
-				if (PS_FAULTY == port_state(p)) {
-					clock_fault_timeout(p, 1);
-					break;
-				}
-			}
-		}
-
-		/*
-		 * When the fault timer expires we clear the fault,
-		 * but only if the link is up.
-		 */
-		if (cur[N_POLLFD].revents & (POLLIN|POLLPRI)) {
-			clock_fault_timeout(p, 0);
-			if (port_link_status_get(p)) {
-				port_dispatch(p, EV_FAULT_CLEARED, 0);
-			}
+	for (i = 0; i < cnt; i++) {
+		if (c->events[i].data.ptr == CLOCK_TWHEEL_COOKIE) {
+			c->events[i] = c->events[--cnt];
+			cnt = clock_expire_timers(c, cnt);
+			break;
 		}
+	}
 
-		cur += N_CLOCK_PFD;
+	/*
+	 * Group the ready descriptors by port and sort them by index,
+	 * in order to preserve the ordering guarantee given in fd.h.
+	 */
+	if (cnt > 1) {
+		qsort(c->events, cnt, sizeof(c->events[0]), clock_event_cmp);
 	}
+	c->poll_gen++;
 
-	/* Check the UDS port. */
-	for (i = 0; i < N_POLLFD; i++) {
-		if (cur[i].revents & (POLLIN|POLLPRI)) {
-			event = port_event(c->uds_port, i);
-			if (EV_STATE_DECISION_EVENT == event) {
-				c->sde = 1;
-			}
+	for (i = 0; i < cnt; i++) {
+		cfd = c->events[i].data.ptr;
+		/*
+		 * Skip the remaining descriptors of a port which went
+		 * faulty or changed its descriptors in this round, but
+		 * never the fault timer.
+		 */
+		if (cfd->index < N_POLLFD && cfd->owner->skip == c->poll_gen) {
+			clock_requeue_timer(c, cfd);
+			continue;
 		}
+		clock_port_event(c, cfd, c->events[i].events);
 	}
 
 	if (c->sde) {
@@ -1612,6 +1996,9 @@ int clock_poll(struct clock *c)
 		c->sde = 0;
 	}
 	clock_prune_subscriptions(c);
+	if (c->status_shm) {
+		clock_publish_status(c);
+	}
 	return 0;
 }
 
@@ -1739,6 +2126,7 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 	adj = servo_sample(c->servo, offset, tmv_to_nanoseconds(ingress),
 			   weight, &state);
 	c->servo_state = state;
+	c->servo_freq = adj;
 
 	tsproc_set_clock_rate_ratio(c->tsproc, clock_rate_ratio(c));
 
@@ -1769,9 +2157,8 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		break;
 	}
 
-	if (c->stats.max_count > 1) {
-		clock_stats_update(&c->stats, tmv_dbl(c->master_offset), adj);
-	} else {
+	clock_stats_update(&c->stats, tmv_dbl(c->master_offset), adj);
+	if (c->stats.max_count <= 1) {
 		pr_info("master offset %10" PRId64 " s%d freq %+7.0f "
 			"path delay %9" PRId64,
 			tmv_to_nanoseconds(c->master_offset), state, adj,
@@ -1829,19 +2216,169 @@ void clock_update_time_properties(struct clock *c, struct timePropertiesDS tds)
 	c->tds = tds;
 }
 
+struct twheel *clock_twheel(struct clock *c)
+{
+	return c->twheel;
+}
+
+/*
+ * The ports with an Erbest sit in a binary heap ordered by dscmp(),
+ * so that Ebest is always at the top. The keys are copies, since the
+ * foreign masters of a port may be freed before the next decision.
+ */
+static int clock_heap_better(struct clock *c, int i, int j)
+{
+	return c->dscmp(&c->erbest[i]->erbest, &c->erbest[j]->erbest) > 0;
+}
+
+static void clock_heap_swap(struct clock *c, int i, int j)
+{
+	struct clock_fds *tmp = c->erbest[i];
+
+	c->erbest[i] = c->erbest[j];
+	c->erbest[j] = tmp;
+	c->erbest[i]->heap = i;
+	c->erbest[j]->heap = j;
+}
+
+static void clock_heap_fix(struct clock *c, int i)
+{
+	int child, parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!clock_heap_better(c, i, parent)) {
+			break;
+		}
+		clock_heap_swap(c, i, parent);
+		i = parent;
+	}
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= c->n_erbest) {
+			break;
+		}
+		if (child + 1 < c->n_erbest &&
+		    clock_heap_better(c, child + 1, child)) {
+			child++;
+		}
+		if (!clock_heap_better(c, child, i)) {
+			break;
+		}
+		clock_heap_swap(c, i, child);
+		i = child;
+	}
+}
+
+static void clock_heap_remove(struct clock *c, struct clock_fds *fds)
+{
+	int i = fds->heap;
+
+	if (i < 0) {
+		return;
+	}
+	fds->heap = -1;
+	c->n_erbest--;
+	if (i == c->n_erbest) {
+		return;
+	}
+	c->erbest[i] = c->erbest[c->n_erbest];
+	c->erbest[i]->heap = i;
+	clock_heap_fix(c, i);
+}
+
+/*
+ * Returns non-zero if the Erbest of the port changed.
+ */
+static int clock_update_erbest(struct clock *c, struct clock_fds *fds)
+{
+	struct foreign_clock *best;
+	int dirty;
+
+	dirty = port_best_dirty(fds->port);
+	best = port_compute_best(fds->port);
+	if (!dirty && best == fds->best) {
+		return 0;
+	}
+	fds->best = best;
+	if (!best) {
+		clock_heap_remove(c, fds);
+		return 1;
+	}
+	fds->erbest = best->dataset;
+	if (fds->heap < 0) {
+		fds->heap = c->n_erbest++;
+		c->erbest[fds->heap] = fds;
+	}
+	clock_heap_fix(c, fds->heap);
+	return 1;
+}
+
+static void clock_check_erbest(struct clock *c, struct clock_fds *fds)
+{
+	fds->checked = c->sde_gen;
+	if (clock_update_erbest(c, fds)) {
+		fds->sde = 1;
+		fds->new_best = 1;
+	}
+}
+
+static struct clock_fds *clock_check_ebest(struct clock *c)
+{
+	/* A port that was skipped may be the new Ebest, and stale. */
+	while (c->n_erbest && c->erbest[0]->checked != c->sde_gen) {
+		clock_check_erbest(c, c->erbest[0]);
+	}
+	return c->n_erbest ? c->erbest[0] : NULL;
+}
+
 static void handle_state_decision_event(struct clock *c)
 {
-	struct foreign_clock *best = NULL, *fc;
+	struct foreign_clock *best = NULL;
+	struct clock_fds *fds, *top;
 	struct ClockIdentity best_id;
 	struct port *piter;
-	int fresh_best = 0;
+	int all, fresh_best = 0;
 
-	LIST_FOREACH(piter, &c->ports, list) {
-		fc = port_compute_best(piter);
-		if (!fc)
+	all = c->sde_all || memcmp(&c->dds, &c->sde_dds, sizeof(c->dds));
+	c->sde_gen++;
+
+	/*
+	 * Only the ports whose foreign masters changed need a new Erbest.
+	 * The Ebest port is always checked, as its master may have aged
+	 * out, and so is any port that takes its place.
+	 */
+	TAILQ_FOREACH(fds, &c->fds, list) {
+		if (fds->port == c->uds_port) {
 			continue;
-		if (!best || c->dscmp(&fc->dataset, &best->dataset) > 0)
-			best = fc;
+		}
+		if (!all && !fds->sde && fds->heap != 0 &&
+		    !port_best_dirty(fds->port)) {
+			continue;
+		}
+		clock_check_erbest(c, fds);
+	}
+
+	top = clock_check_ebest(c);
+	best = top ? top->best : NULL;
+
+	/*
+	 * A different Ebest affects the decision of every port, so bring
+	 * all of them up to date.
+	 */
+	if (!all && best != c->best) {
+		all = 1;
+		TAILQ_FOREACH(fds, &c->fds, list) {
+			if (fds->port != c->uds_port &&
+			    fds->checked != c->sde_gen) {
+				clock_check_erbest(c, fds);
+			}
+		}
+		top = clock_check_ebest(c);
+		best = top ? top->best : NULL;
+	}
+	if (top && top->new_best) {
+		all = 1;
 	}
 
 	if (best) {
@@ -1873,9 +2410,18 @@ static void handle_state_decision_event(struct clock *c)
 	c->best = best;
 	c->best_id = best_id;
 
-	LIST_FOREACH(piter, &c->ports, list) {
+	c->sde_all = 0;
+	c->sde_dds = c->dds;
+
+	TAILQ_FOREACH(fds, &c->fds, list) {
 		enum port_state ps;
 		enum fsm_event event;
+		piter = fds->port;
+		if (piter == c->uds_port || (!all && !fds->sde)) {
+			continue;
+		}
+		fds->sde = 0;
+		fds->new_best = 0;
 		ps = bmc_state_decision(c, piter, c->dscmp);
 		switch (ps) {
 		case PS_LISTENING:
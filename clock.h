@@ -31,6 +31,7 @@
 #include "transport.h"
 
 struct ptp_message; /*forward declaration*/
+struct twheel;
 
 /** Opaque type. */
 struct clock;
@@ -166,10 +167,11 @@ struct ClockIdentity clock_identity(struct clock *c);
 
 /**
  * Informs clock that a file descriptor of one of its ports changed. The
- * clock will rebuild its array of file descriptors to poll.
+ * clock will update the registration of that port's descriptors only.
  * @param c    The clock instance.
+ * @param p    The port whose descriptors changed.
  */
-void clock_fda_changed(struct clock *c);
+void clock_fda_changed(struct clock *c, struct port *p);
 
 /**
  * Obtains the time of the latest synchronization.
@@ -339,6 +341,13 @@ struct timePropertiesDS clock_time_properties(struct clock *c);
  */
 void clock_update_time_properties(struct clock *c, struct timePropertiesDS tds);
 
+/**
+ * Obtain the timer wheel which drives the timers of all ports.
+ * @param c  The clock instance.
+ * @return   A pointer to the timer wheel, never NULL.
+ */
+struct twheel *clock_twheel(struct clock *c);
+
 /**
  * Obtain a clock's description.
  * @param c  The clock instance.
@@ -31,6 +31,7 @@
 #include "ether.h"
 #include "hash.h"
 #include "print.h"
+#include "sk.h"
 #include "util.h"
 
 struct interface {
@@ -81,6 +82,11 @@ struct config_item {
 
 #define N_CONFIG_ITEMS (sizeof(config_tab) / sizeof(config_tab[0]))
 
+struct section_items {
+	struct config_item *item[N_CONFIG_OPTIONS];
+	char name[];
+};
+
 #define CONFIG_ITEM_DBL(_label, _port, _default, _min, _max) {	\
 	.label	= _label,				\
 	.type	= CFG_TYPE_DOUBLE,			\
@@ -160,6 +166,8 @@ static struct config_enum dataset_comp_enu[] = {
 static struct config_enum delay_filter_enu[] = {
 	{ "moving_average", FILTER_MOVING_AVERAGE },
 	{ "moving_median",  FILTER_MOVING_MEDIAN  },
+	{ "tree_median",    FILTER_TREE_MEDIAN    },
+	{ "trimmed_mean",   FILTER_TRIMMED_MEAN   },
 	{ NULL, 0 },
 };
 
@@ -220,118 +228,10 @@ static struct config_enum bmca_enu[] = {
 	{ NULL, 0 },
 };
 
+#define CONFIG_TAB_ENTRY(id, item) [id] = item,
+
 struct config_item config_tab[] = {
-	PORT_ITEM_INT("announceReceiptTimeout", 3, 2, UINT8_MAX),
-	PORT_ITEM_ENU("asCapable", AS_CAPABLE_AUTO, as_capable_enu),
-	GLOB_ITEM_INT("assume_two_step", 0, 0, 1),
-	PORT_ITEM_INT("boundary_clock_jbod", 0, 0, 1),
-	PORT_ITEM_ENU("BMCA", BMCA_PTP, bmca_enu),
-	GLOB_ITEM_INT("check_fup_sync", 0, 0, 1),
-	GLOB_ITEM_INT("clientOnly", 0, 0, 1),
-	GLOB_ITEM_INT("clockAccuracy", 0xfe, 0, UINT8_MAX),
-	GLOB_ITEM_INT("clockClass", 248, 0, UINT8_MAX),
-	GLOB_ITEM_STR("clockIdentity", "000000.0000.000000"),
-	GLOB_ITEM_ENU("clock_servo", CLOCK_SERVO_PI, clock_servo_enu),
-	GLOB_ITEM_ENU("clock_type", CLOCK_TYPE_ORDINARY, clock_type_enu),
-	GLOB_ITEM_ENU("dataset_comparison", DS_CMP_IEEE1588, dataset_comp_enu),
-	PORT_ITEM_INT("delayAsymmetry", 0, INT_MIN, INT_MAX),
-	PORT_ITEM_ENU("delay_filter", FILTER_MOVING_MEDIAN, delay_filter_enu),
-	PORT_ITEM_INT("delay_filter_length", 10, 1, INT_MAX),
-	PORT_ITEM_ENU("delay_mechanism", DM_E2E, delay_mech_enu),
-	GLOB_ITEM_INT("dscp_event", 0, 0, 63),
-	GLOB_ITEM_INT("dscp_general", 0, 0, 63),
-	GLOB_ITEM_INT("domainNumber", 0, 0, 127),
-	PORT_ITEM_INT("egressLatency", 0, INT_MIN, INT_MAX),
-	PORT_ITEM_INT("fault_badpeernet_interval", 16, INT32_MIN, INT32_MAX),
-	PORT_ITEM_INT("fault_reset_interval", 4, INT8_MIN, INT8_MAX),
-	GLOB_ITEM_DBL("first_step_threshold", 0.00002, 0.0, DBL_MAX),
-	PORT_ITEM_INT("follow_up_info", 0, 0, 1),
-	GLOB_ITEM_INT("free_running", 0, 0, 1),
-	PORT_ITEM_INT("freq_est_interval", 1, 0, INT_MAX),
-	GLOB_ITEM_INT("G.8275.defaultDS.localPriority", 128, 1, UINT8_MAX),
-	PORT_ITEM_INT("G.8275.portDS.localPriority", 128, 1, UINT8_MAX),
-	GLOB_ITEM_INT("gmCapable", 1, 0, 1),
-	GLOB_ITEM_ENU("hwts_filter", HWTS_FILTER_NORMAL, hwts_filter_enu),
-	PORT_ITEM_INT("hybrid_e2e", 0, 0, 1),
-	PORT_ITEM_INT("ignore_source_id", 0, 0, 1),
-	PORT_ITEM_INT("ignore_transport_specific", 0, 0, 1),
-	PORT_ITEM_INT("ingressLatency", 0, INT_MIN, INT_MAX),
-	PORT_ITEM_INT("inhibit_announce", 0, 0, 1),
-	PORT_ITEM_INT("inhibit_delay_req", 0, 0, 1),
-	PORT_ITEM_INT("inhibit_multicast_service", 0, 0, 1),
-	GLOB_ITEM_INT("initial_delay", 0, 0, INT_MAX),
-	GLOB_ITEM_INT("kernel_leap", 1, 0, 1),
-	GLOB_ITEM_STR("leapfile", NULL),
-	PORT_ITEM_INT("logAnnounceInterval", 1, INT8_MIN, INT8_MAX),
-	PORT_ITEM_INT("logMinDelayReqInterval", 0, INT8_MIN, INT8_MAX),
-	PORT_ITEM_INT("logMinPdelayReqInterval", 0, INT8_MIN, INT8_MAX),
-	PORT_ITEM_INT("logSyncInterval", 0, INT8_MIN, INT8_MAX),
-	GLOB_ITEM_INT("logging_level", LOG_INFO, PRINT_LEVEL_MIN, PRINT_LEVEL_MAX),
-	PORT_ITEM_INT("masterOnly", 0, 0, 1),
-	GLOB_ITEM_INT("maxStepsRemoved", 255, 2, UINT8_MAX),
-	GLOB_ITEM_STR("message_tag", NULL),
-	GLOB_ITEM_STR("manufacturerIdentity", "00:00:00"),
-	GLOB_ITEM_INT("max_frequency", 900000000, 0, INT_MAX),
-	PORT_ITEM_INT("min_neighbor_prop_delay", -20000000, INT_MIN, -1),
-	PORT_ITEM_INT("msg_interval_request", 0, 0, 1),
-	PORT_ITEM_INT("neighborPropDelayThresh", 20000000, 0, INT_MAX),
-	PORT_ITEM_INT("net_sync_monitor", 0, 0, 1),
-	PORT_ITEM_ENU("network_transport", TRANS_UDP_IPV4, nw_trans_enu),
-	GLOB_ITEM_INT("ntpshm_segment", 0, INT_MIN, INT_MAX),
-	GLOB_ITEM_INT("offsetScaledLogVariance", 0xffff, 0, UINT16_MAX),
-	PORT_ITEM_INT("operLogPdelayReqInterval", 0, INT8_MIN, INT8_MAX),
-	PORT_ITEM_INT("operLogSyncInterval", 0, INT8_MIN, INT8_MAX),
-	PORT_ITEM_INT("path_trace_enabled", 0, 0, 1),
-	GLOB_ITEM_DBL("pi_integral_const", 0.0, 0.0, DBL_MAX),
-	GLOB_ITEM_DBL("pi_integral_exponent", 0.4, -DBL_MAX, DBL_MAX),
-	GLOB_ITEM_DBL("pi_integral_norm_max", 0.3, DBL_MIN, 2.0),
-	GLOB_ITEM_DBL("pi_integral_scale", 0.0, 0.0, DBL_MAX),
-	GLOB_ITEM_DBL("pi_proportional_const", 0.0, 0.0, DBL_MAX),
-	GLOB_ITEM_DBL("pi_proportional_exponent", -0.3, -DBL_MAX, DBL_MAX),
-	GLOB_ITEM_DBL("pi_proportional_norm_max", 0.7, DBL_MIN, 1.0),
-	GLOB_ITEM_DBL("pi_proportional_scale", 0.0, 0.0, DBL_MAX),
-	GLOB_ITEM_INT("priority1", 128, 0, UINT8_MAX),
-	GLOB_ITEM_INT("priority2", 128, 0, UINT8_MAX),
-	GLOB_ITEM_STR("productDescription", ";;"),
-	PORT_ITEM_STR("ptp_dst_mac", "01:1B:19:00:00:00"),
-	PORT_ITEM_STR("p2p_dst_mac", "01:80:C2:00:00:0E"),
-	GLOB_ITEM_STR("revisionData", ";;"),
-	GLOB_ITEM_INT("sanity_freq_limit", 200000000, 0, INT_MAX),
-	GLOB_ITEM_INT("servo_num_offset_values", 10, 0, INT_MAX),
-	GLOB_ITEM_INT("servo_offset_threshold", 0, 0, INT_MAX),
-	GLOB_ITEM_STR("slave_event_monitor", ""),
-	GLOB_ITEM_INT("slaveOnly", 0, 0, 1), /*deprecated*/
-	GLOB_ITEM_INT("socket_priority", 0, 0, 15),
-	GLOB_ITEM_DBL("step_threshold", 0.0, 0.0, DBL_MAX),
-	GLOB_ITEM_INT("summary_interval", 0, INT_MIN, INT_MAX),
-	PORT_ITEM_INT("syncReceiptTimeout", 0, 0, UINT8_MAX),
-	GLOB_ITEM_INT("tc_spanning_tree", 0, 0, 1),
-	GLOB_ITEM_INT("timeSource", INTERNAL_OSCILLATOR, 0x10, 0xfe),
-	GLOB_ITEM_ENU("time_stamping", TS_HARDWARE, timestamping_enu),
-	PORT_ITEM_INT("transportSpecific", 0, 0, 0x0F),
-	PORT_ITEM_INT("ts2phc.channel", 0, 0, INT_MAX),
-	PORT_ITEM_INT("ts2phc.extts_correction", 0, INT_MIN, INT_MAX),
-	PORT_ITEM_ENU("ts2phc.extts_polarity", PTP_RISING_EDGE, extts_polarity_enu),
-	PORT_ITEM_INT("ts2phc.master", 0, 0, 1),
-	GLOB_ITEM_STR("ts2phc.nmea_remote_host", ""),
-	GLOB_ITEM_STR("ts2phc.nmea_remote_port", ""),
-	GLOB_ITEM_STR("ts2phc.nmea_serialport", "/dev/ttyS0"),
-	PORT_ITEM_INT("ts2phc.pin_index", 0, 0, INT_MAX),
-	GLOB_ITEM_INT("ts2phc.pulsewidth", 500000000, 1000000, 999000000),
-	PORT_ITEM_ENU("tsproc_mode", TSPROC_FILTER, tsproc_enu),
-	GLOB_ITEM_INT("twoStepFlag", 1, 0, 1),
-	GLOB_ITEM_INT("tx_timestamp_timeout", 1, 1, INT_MAX),
-	PORT_ITEM_INT("udp_ttl", 1, 1, 255),
-	PORT_ITEM_INT("udp6_scope", 0x0E, 0x00, 0x0F),
-	GLOB_ITEM_STR("uds_address", "/var/run/ptp4l"),
-	PORT_ITEM_INT("unicast_listen", 0, 0, 1),
-	PORT_ITEM_INT("unicast_master_table", 0, 0, INT_MAX),
-	PORT_ITEM_INT("unicast_req_duration", 3600, 10, INT_MAX),
-	GLOB_ITEM_INT("use_syslog", 1, 0, 1),
-	GLOB_ITEM_STR("userDescription", ""),
-	GLOB_ITEM_INT("utc_offset", CURRENT_UTC_OFFSET, 0, INT_MAX),
-	GLOB_ITEM_INT("verbose", 0, 0, 1),
-	GLOB_ITEM_INT("write_phase_mode", 0, 0, 1),
+	CONFIG_ITEMS(CONFIG_TAB_ENTRY)
 };
 
 static struct unicast_master_table *current_uc_mtab;
@@ -370,13 +270,71 @@ static struct config_item *config_find_item(struct config *cfg,
 	return config_global_item(cfg, name);
 }
 
+static int config_section_find(struct config *cfg, const char *section)
+{
+	int i;
+
+	if (!section || !strcmp(section, "global")) {
+		return 0;
+	}
+	for (i = 1; i < cfg->n_sections; i++) {
+		if (!strcmp(cfg->sections[i]->name, section)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int config_section_add(struct config *cfg, const char *section)
+{
+	struct section_items **sections, *s;
+	int n = cfg->n_sections ? cfg->n_sections : 1;
+
+	s = calloc(1, sizeof(*s) + strlen(section) + 1);
+	if (!s) {
+		return -1;
+	}
+	strcpy(s->name, section);
+
+	sections = realloc(cfg->sections, (n + 1) * sizeof(*sections));
+	if (!sections) {
+		free(s);
+		return -1;
+	}
+	/* Index zero stands for the global section. */
+	sections[0] = NULL;
+	sections[n] = s;
+	cfg->sections = sections;
+	cfg->n_sections = n + 1;
+	return n;
+}
+
+static struct config_item *config_option_item(struct config *cfg, int section,
+					      enum config_option option)
+{
+	struct config_item *ci = NULL;
+
+	if (section > 0) {
+		ci = cfg->sections[section]->item[option];
+	}
+	return ci ? ci : &config_tab[option];
+}
+
 static struct config_item *config_item_alloc(struct config *cfg,
 					     const char *section,
 					     const char *name,
 					     enum config_type type)
 {
-	struct config_item *ci;
+	struct config_item *ci, *cgi;
 	char buf[CONFIG_LABEL_SIZE + MAX_IFNAME_SIZE];
+	int index;
+
+	cgi = config_global_item(cfg, name);
+	index = config_section(cfg, section);
+	if (!cgi || index < 0) {
+		fprintf(stderr, "low memory or bad item %s\n", name);
+		return NULL;
+	}
 
 	ci = calloc(1, sizeof(*ci));
 	if (!ci) {
@@ -392,6 +350,9 @@ static struct config_item *config_item_alloc(struct config *cfg,
 		free(ci);
 		return NULL;
 	}
+	if (index) {
+		cfg->sections[index]->item[cgi - config_tab] = ci;
+	}
 
 	return ci;
 }
@@ -929,6 +890,7 @@ void config_destroy(struct config *cfg)
 	struct unicast_master_address *address;
 	struct unicast_master_table *table;
 	struct interface *iface;
+	int i;
 
 	while ((iface = STAILQ_FIRST(&cfg->interfaces))) {
 		STAILQ_REMOVE_HEAD(&cfg->interfaces, list);
@@ -946,6 +908,10 @@ void config_destroy(struct config *cfg)
 		free(table);
 	}
 	hash_destroy(cfg->htab, config_item_free);
+	for (i = 1; i < cfg->n_sections; i++) {
+		free(cfg->sections[i]);
+	}
+	free(cfg->sections);
 	free(cfg->opts);
 	free(cfg);
 }
@@ -997,6 +963,48 @@ char *config_get_string(struct config *cfg, const char *section,
 	return ci->val.s;
 }
 
+int config_section(struct config *cfg, const char *section)
+{
+	int index = config_section_find(cfg, section);
+
+	return index < 0 ? config_section_add(cfg, section) : index;
+}
+
+double config_double(struct config *cfg, int section,
+		     enum config_option option)
+{
+	struct config_item *ci = config_option_item(cfg, section, option);
+
+	if (ci->type != CFG_TYPE_DOUBLE) {
+		pr_err("bug: config option %s type mismatch!", ci->label);
+		exit(-1);
+	}
+	return ci->val.d;
+}
+
+int config_int(struct config *cfg, int section, enum config_option option)
+{
+	struct config_item *ci = config_option_item(cfg, section, option);
+
+	if (ci->type != CFG_TYPE_INT && ci->type != CFG_TYPE_ENUM) {
+		pr_err("bug: config option %s type mismatch!", ci->label);
+		exit(-1);
+	}
+	return ci->val.i;
+}
+
+char *config_string(struct config *cfg, int section,
+		    enum config_option option)
+{
+	struct config_item *ci = config_option_item(cfg, section, option);
+
+	if (ci->type != CFG_TYPE_STRING) {
+		pr_err("bug: config option %s type mismatch!", ci->label);
+		exit(-1);
+	}
+	return ci->val.s;
+}
+
 int config_harmonize_onestep(struct config *cfg)
 {
 	enum timestamp_type tstype = config_get_int(cfg, NULL, "time_stamping");
@@ -23,6 +23,7 @@
 #include <getopt.h>
 #include <sys/queue.h>
 
+#include "config_items.h"
 #include "ds.h"
 #include "dm.h"
 #include "filter.h"
@@ -32,6 +33,16 @@
 #include "servo.h"
 #include "sk.h"
 
+#define CONFIG_OPTION_ID(id, item) id,
+
+/** Identifies a configuration option, see config_items.h. */
+enum config_option {
+	CONFIG_ITEMS(CONFIG_OPTION_ID)
+	N_CONFIG_OPTIONS
+};
+
+struct section_items;
+
 struct config {
 	/* configured interfaces */
 	STAILQ_HEAD(interfaces_head, interface) interfaces;
@@ -43,6 +54,10 @@ struct config {
 	/* hash of all non-legacy items */
 	struct hash *htab;
 
+	/* section specific items indexed by option, see config_section() */
+	struct section_items **sections;
+	int n_sections;
+
 	/* unicast master tables */
 	STAILQ_HEAD(ucmtab_head, unicast_master_table) unicast_master_tables;
 };
@@ -64,6 +79,50 @@ int config_get_int(struct config *cfg, const char *section,
 char *config_get_string(struct config *cfg, const char *section,
 			const char *option);
 
+/*
+ * Methods using option identifiers. These avoid the string lookups
+ * and are meant for the code paths which run repeatedly.
+ */
+
+/**
+ * Obtain the index of a configuration section. The index remains
+ * valid for the lifetime of the configuration, even if options are
+ * added to the section later on.
+ * @param cfg      The configuration of interest.
+ * @param section  The name of the section, or NULL for the global one.
+ * @return         A non-negative index on success, negative on failure.
+ */
+int config_section(struct config *cfg, const char *section);
+
+/**
+ * Obtain the value of a floating point option.
+ * @param cfg      The configuration of interest.
+ * @param section  An index obtained via @ref config_section().
+ * @param option   The option of interest.
+ * @return         The section specific value if set, the global otherwise.
+ */
+double config_double(struct config *cfg, int section,
+		     enum config_option option);
+
+/**
+ * Obtain the value of an integer or enumerated option.
+ * @param cfg      The configuration of interest.
+ * @param section  An index obtained via @ref config_section().
+ * @param option   The option of interest.
+ * @return         The section specific value if set, the global otherwise.
+ */
+int config_int(struct config *cfg, int section, enum config_option option);
+
+/**
+ * Obtain the value of a string option.
+ * @param cfg      The configuration of interest.
+ * @param section  An index obtained via @ref config_section().
+ * @param option   The option of interest.
+ * @return         The section specific value if set, the global otherwise.
+ */
+char *config_string(struct config *cfg, int section,
+		    enum config_option option);
+
 int config_harmonize_onestep(struct config *cfg);
 
 static inline struct option *config_long_options(struct config *cfg)
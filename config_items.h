@@ -0,0 +1,234 @@
+/**
+ * @file config_items.h
+ * @brief Lists the configuration options and their default values.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_CONFIG_ITEMS_H
+#define HAVE_CONFIG_ITEMS_H
+
+/*
+ * Each entry pairs the identifier of an option with its table entry.
+ * The list is expanded once in config.h to generate the option
+ * identifiers, and once in config.c to generate the table itself, so
+ * that the two always match. Only config.c evaluates the second
+ * argument, and so the enumeration tables and constants referenced
+ * there need not be visible elsewhere.
+ */
+#define CONFIG_ITEMS(X) \
+	X(CFG_ANNOUNCE_RECEIPT_TIMEOUT, \
+	  PORT_ITEM_INT("announceReceiptTimeout", 3, 2, UINT8_MAX)) \
+	X(CFG_AS_CAPABLE, \
+	  PORT_ITEM_ENU("asCapable", AS_CAPABLE_AUTO, as_capable_enu)) \
+	X(CFG_ASSUME_TWO_STEP, GLOB_ITEM_INT("assume_two_step", 0, 0, 1)) \
+	X(CFG_BOUNDARY_CLOCK_JBOD, \
+	  PORT_ITEM_INT("boundary_clock_jbod", 0, 0, 1)) \
+	X(CFG_BMCA, PORT_ITEM_ENU("BMCA", BMCA_PTP, bmca_enu)) \
+	X(CFG_CHECK_FUP_SYNC, GLOB_ITEM_INT("check_fup_sync", 0, 0, 1)) \
+	X(CFG_CLIENT_ONLY, GLOB_ITEM_INT("clientOnly", 0, 0, 1)) \
+	X(CFG_CLOCK_ACCURACY, \
+	  GLOB_ITEM_INT("clockAccuracy", 0xfe, 0, UINT8_MAX)) \
+	X(CFG_CLOCK_CLASS, GLOB_ITEM_INT("clockClass", 248, 0, UINT8_MAX)) \
+	X(CFG_CLOCK_IDENTITY, \
+	  GLOB_ITEM_STR("clockIdentity", "000000.0000.000000")) \
+	X(CFG_CLOCK_SERVO, \
+	  GLOB_ITEM_ENU("clock_servo", CLOCK_SERVO_PI, clock_servo_enu)) \
+	X(CFG_CLOCK_TYPE, \
+	  GLOB_ITEM_ENU("clock_type", CLOCK_TYPE_ORDINARY, clock_type_enu)) \
+	X(CFG_DATASET_COMPARISON, \
+	  GLOB_ITEM_ENU("dataset_comparison", DS_CMP_IEEE1588, \
+			dataset_comp_enu)) \
+	X(CFG_DELAY_ASYMMETRY, \
+	  PORT_ITEM_INT("delayAsymmetry", 0, INT_MIN, INT_MAX)) \
+	X(CFG_DELAY_FILTER, \
+	  PORT_ITEM_ENU("delay_filter", FILTER_MOVING_MEDIAN, \
+			delay_filter_enu)) \
+	X(CFG_DELAY_FILTER_LENGTH, \
+	  PORT_ITEM_INT("delay_filter_length", 10, 1, INT_MAX)) \
+	X(CFG_DELAY_MECHANISM, \
+	  PORT_ITEM_ENU("delay_mechanism", DM_E2E, delay_mech_enu)) \
+	X(CFG_DSCP_EVENT, GLOB_ITEM_INT("dscp_event", 0, 0, 63)) \
+	X(CFG_DSCP_GENERAL, GLOB_ITEM_INT("dscp_general", 0, 0, 63)) \
+	X(CFG_DOMAIN_NUMBER, GLOB_ITEM_INT("domainNumber", 0, 0, 127)) \
+	X(CFG_EGRESS_LATENCY, \
+	  PORT_ITEM_INT("egressLatency", 0, INT_MIN, INT_MAX)) \
+	X(CFG_FAULT_BADPEERNET_INTERVAL, \
+	  PORT_ITEM_INT("fault_badpeernet_interval", 16, INT32_MIN, \
+			INT32_MAX)) \
+	X(CFG_FAULT_RESET_INTERVAL, \
+	  PORT_ITEM_INT("fault_reset_interval", 4, INT8_MIN, INT8_MAX)) \
+	X(CFG_FIRST_STEP_THRESHOLD, \
+	  GLOB_ITEM_DBL("first_step_threshold", 0.00002, 0.0, DBL_MAX)) \
+	X(CFG_FOLLOW_UP_INFO, PORT_ITEM_INT("follow_up_info", 0, 0, 1)) \
+	X(CFG_FREE_RUNNING, GLOB_ITEM_INT("free_running", 0, 0, 1)) \
+	X(CFG_FREQ_EST_INTERVAL, \
+	  PORT_ITEM_INT("freq_est_interval", 1, 0, INT_MAX)) \
+	X(CFG_G8275_DEFAULT_DS_LOCAL_PRIORITY, \
+	  GLOB_ITEM_INT("G.8275.defaultDS.localPriority", 128, 1, UINT8_MAX)) \
+	X(CFG_G8275_PORT_DS_LOCAL_PRIORITY, \
+	  PORT_ITEM_INT("G.8275.portDS.localPriority", 128, 1, UINT8_MAX)) \
+	X(CFG_GM_CAPABLE, GLOB_ITEM_INT("gmCapable", 1, 0, 1)) \
+	X(CFG_HWTS_FILTER, \
+	  GLOB_ITEM_ENU("hwts_filter", HWTS_FILTER_NORMAL, hwts_filter_enu)) \
+	X(CFG_HYBRID_E2E, PORT_ITEM_INT("hybrid_e2e", 0, 0, 1)) \
+	X(CFG_IGNORE_SOURCE_ID, PORT_ITEM_INT("ignore_source_id", 0, 0, 1)) \
+	X(CFG_IGNORE_TRANSPORT_SPECIFIC, \
+	  PORT_ITEM_INT("ignore_transport_specific", 0, 0, 1)) \
+	X(CFG_INGRESS_LATENCY, \
+	  PORT_ITEM_INT("ingressLatency", 0, INT_MIN, INT_MAX)) \
+	X(CFG_INHIBIT_ANNOUNCE, PORT_ITEM_INT("inhibit_announce", 0, 0, 1)) \
+	X(CFG_INHIBIT_DELAY_REQ, PORT_ITEM_INT("inhibit_delay_req", 0, 0, 1)) \
+	X(CFG_INHIBIT_MULTICAST_SERVICE, \
+	  PORT_ITEM_INT("inhibit_multicast_service", 0, 0, 1)) \
+	X(CFG_INITIAL_DELAY, GLOB_ITEM_INT("initial_delay", 0, 0, INT_MAX)) \
+	X(CFG_KERNEL_LEAP, GLOB_ITEM_INT("kernel_leap", 1, 0, 1)) \
+	X(CFG_LEAPFILE, GLOB_ITEM_STR("leapfile", NULL)) \
+	X(CFG_LINREG_MAX_POINTS, \
+	  GLOB_ITEM_INT("linreg_max_points", 64, 4, 1 << 16)) \
+	X(CFG_LOG_ANNOUNCE_INTERVAL, \
+	  PORT_ITEM_INT("logAnnounceInterval", 1, INT8_MIN, INT8_MAX)) \
+	X(CFG_LOG_MIN_DELAY_REQ_INTERVAL, \
+	  PORT_ITEM_INT("logMinDelayReqInterval", 0, INT8_MIN, INT8_MAX)) \
+	X(CFG_LOG_MIN_PDELAY_REQ_INTERVAL, \
+	  PORT_ITEM_INT("logMinPdelayReqInterval", 0, INT8_MIN, INT8_MAX)) \
+	X(CFG_LOG_SYNC_INTERVAL, \
+	  PORT_ITEM_INT("logSyncInterval", 0, INT8_MIN, INT8_MAX)) \
+	X(CFG_LOGGING_ASYNC, GLOB_ITEM_INT("logging_async", 0, 0, 1)) \
+	X(CFG_LOGGING_LEVEL, \
+	  GLOB_ITEM_INT("logging_level", LOG_INFO, PRINT_LEVEL_MIN, \
+			PRINT_LEVEL_MAX)) \
+	X(CFG_MASTER_ONLY, PORT_ITEM_INT("masterOnly", 0, 0, 1)) \
+	X(CFG_MAX_STEPS_REMOVED, \
+	  GLOB_ITEM_INT("maxStepsRemoved", 255, 2, UINT8_MAX)) \
+	X(CFG_MEASUREMENT_CPUS, GLOB_ITEM_STR("measurement_cpus", NULL)) \
+	X(CFG_MESSAGE_TAG, GLOB_ITEM_STR("message_tag", NULL)) \
+	X(CFG_MANUFACTURER_IDENTITY, \
+	  GLOB_ITEM_STR("manufacturerIdentity", "00:00:00")) \
+	X(CFG_MAX_FOREIGN_MASTERS, \
+	  PORT_ITEM_INT("max_foreign_masters", 16, 1, INT_MAX)) \
+	X(CFG_MAX_FREQUENCY, \
+	  GLOB_ITEM_INT("max_frequency", 900000000, 0, INT_MAX)) \
+	X(CFG_MSG_POOL_MAX, GLOB_ITEM_INT("msg_pool_max", 0, 0, INT_MAX)) \
+	X(CFG_MSG_POOL_SIZE, GLOB_ITEM_INT("msg_pool_size", 64, 0, INT_MAX)) \
+	X(CFG_MIN_NEIGHBOR_PROP_DELAY, \
+	  PORT_ITEM_INT("min_neighbor_prop_delay", -20000000, INT_MIN, -1)) \
+	X(CFG_MSG_INTERVAL_REQUEST, \
+	  PORT_ITEM_INT("msg_interval_request", 0, 0, 1)) \
+	X(CFG_NEIGHBOR_PROP_DELAY_THRESH, \
+	  PORT_ITEM_INT("neighborPropDelayThresh", 20000000, 0, INT_MAX)) \
+	X(CFG_NET_SYNC_MONITOR, PORT_ITEM_INT("net_sync_monitor", 0, 0, 1)) \
+	X(CFG_NETWORK_TRANSPORT, \
+	  PORT_ITEM_ENU("network_transport", TRANS_UDP_IPV4, nw_trans_enu)) \
+	X(CFG_NTPSHM_SEGMENT, \
+	  GLOB_ITEM_INT("ntpshm_segment", 0, INT_MIN, INT_MAX)) \
+	X(CFG_OFFSET_SCALED_LOG_VARIANCE, \
+	  GLOB_ITEM_INT("offsetScaledLogVariance", 0xffff, 0, UINT16_MAX)) \
+	X(CFG_OPER_LOG_PDELAY_REQ_INTERVAL, \
+	  PORT_ITEM_INT("operLogPdelayReqInterval", 0, INT8_MIN, INT8_MAX)) \
+	X(CFG_OPER_LOG_SYNC_INTERVAL, \
+	  PORT_ITEM_INT("operLogSyncInterval", 0, INT8_MIN, INT8_MAX)) \
+	X(CFG_PATH_TRACE_ENABLED, \
+	  PORT_ITEM_INT("path_trace_enabled", 0, 0, 1)) \
+	X(CFG_PI_INTEGRAL_CONST, \
+	  GLOB_ITEM_DBL("pi_integral_const", 0.0, 0.0, DBL_MAX)) \
+	X(CFG_PI_INTEGRAL_EXPONENT, \
+	  GLOB_ITEM_DBL("pi_integral_exponent", 0.4, -DBL_MAX, DBL_MAX)) \
+	X(CFG_PI_INTEGRAL_NORM_MAX, \
+	  GLOB_ITEM_DBL("pi_integral_norm_max", 0.3, DBL_MIN, 2.0)) \
+	X(CFG_PI_INTEGRAL_SCALE, \
+	  GLOB_ITEM_DBL("pi_integral_scale", 0.0, 0.0, DBL_MAX)) \
+	X(CFG_PI_PROPORTIONAL_CONST, \
+	  GLOB_ITEM_DBL("pi_proportional_const", 0.0, 0.0, DBL_MAX)) \
+	X(CFG_PI_PROPORTIONAL_EXPONENT, \
+	  GLOB_ITEM_DBL("pi_proportional_exponent", -0.3, -DBL_MAX, DBL_MAX)) \
+	X(CFG_PI_PROPORTIONAL_NORM_MAX, \
+	  GLOB_ITEM_DBL("pi_proportional_norm_max", 0.7, DBL_MIN, 1.0)) \
+	X(CFG_PI_PROPORTIONAL_SCALE, \
+	  GLOB_ITEM_DBL("pi_proportional_scale", 0.0, 0.0, DBL_MAX)) \
+	X(CFG_PRECISE_READINGS, GLOB_ITEM_INT("precise_readings", 0, 0, 1)) \
+	X(CFG_PRIORITY1, GLOB_ITEM_INT("priority1", 128, 0, UINT8_MAX)) \
+	X(CFG_PRIORITY2, GLOB_ITEM_INT("priority2", 128, 0, UINT8_MAX)) \
+	X(CFG_PRODUCT_DESCRIPTION, GLOB_ITEM_STR("productDescription", ";;")) \
+	X(CFG_PTP_DST_MAC, PORT_ITEM_STR("ptp_dst_mac", "01:1B:19:00:00:00")) \
+	X(CFG_P2P_DST_MAC, PORT_ITEM_STR("p2p_dst_mac", "01:80:C2:00:00:0E")) \
+	X(CFG_REVISION_DATA, GLOB_ITEM_STR("revisionData", ";;")) \
+	X(CFG_RX_BATCH_SIZE, \
+	  PORT_ITEM_INT("rx_batch_size", 1, 1, SK_RX_BATCH_MAX)) \
+	X(CFG_RX_FILTER, PORT_ITEM_INT("rx_filter", 0, 0, 1)) \
+	X(CFG_RX_RING_BLOCKS, PORT_ITEM_INT("rx_ring_blocks", 0, 0, 1024)) \
+	X(CFG_SANITY_FREQ_LIMIT, \
+	  GLOB_ITEM_INT("sanity_freq_limit", 200000000, 0, INT_MAX)) \
+	X(CFG_SERVO_NUM_OFFSET_VALUES, \
+	  GLOB_ITEM_INT("servo_num_offset_values", 10, 0, INT_MAX)) \
+	X(CFG_SERVO_OFFSET_THRESHOLD, \
+	  GLOB_ITEM_INT("servo_offset_threshold", 0, 0, INT_MAX)) \
+	X(CFG_SLAVE_EVENT_MONITOR, GLOB_ITEM_STR("slave_event_monitor", "")) \
+	X(CFG_SLAVE_ONLY, GLOB_ITEM_INT("slaveOnly", 0, 0, 1)) /*deprecated*/ \
+	X(CFG_SOCKET_PRIORITY, GLOB_ITEM_INT("socket_priority", 0, 0, 15)) \
+	X(CFG_STATUS_SHM, GLOB_ITEM_INT("status_shm", 0, 0, 1)) \
+	X(CFG_STEP_THRESHOLD, \
+	  GLOB_ITEM_DBL("step_threshold", 0.0, 0.0, DBL_MAX)) \
+	X(CFG_SUMMARY_INTERVAL, \
+	  GLOB_ITEM_INT("summary_interval", 0, INT_MIN, INT_MAX)) \
+	X(CFG_SYNC_RECEIPT_TIMEOUT, \
+	  PORT_ITEM_INT("syncReceiptTimeout", 0, 0, UINT8_MAX)) \
+	X(CFG_TC_EVICT_OLDEST, PORT_ITEM_INT("tc_evict_oldest", 1, 0, 1)) \
+	X(CFG_TC_RECORDS, PORT_ITEM_INT("tc_records", 256, 1, INT_MAX)) \
+	X(CFG_TC_SPANNING_TREE, GLOB_ITEM_INT("tc_spanning_tree", 0, 0, 1)) \
+	X(CFG_TIME_SOURCE, \
+	  GLOB_ITEM_INT("timeSource", INTERNAL_OSCILLATOR, 0x10, 0xfe)) \
+	X(CFG_TIME_STAMPING, \
+	  GLOB_ITEM_ENU("time_stamping", TS_HARDWARE, timestamping_enu)) \
+	X(CFG_TRANSPORT_SPECIFIC, \
+	  PORT_ITEM_INT("transportSpecific", 0, 0, 0x0F)) \
+	X(CFG_TS2PHC_CHANNEL, PORT_ITEM_INT("ts2phc.channel", 0, 0, INT_MAX)) \
+	X(CFG_TS2PHC_EXTTS_CORRECTION, \
+	  PORT_ITEM_INT("ts2phc.extts_correction", 0, INT_MIN, INT_MAX)) \
+	X(CFG_TS2PHC_EXTTS_POLARITY, \
+	  PORT_ITEM_ENU("ts2phc.extts_polarity", PTP_RISING_EDGE, \
+			extts_polarity_enu)) \
+	X(CFG_TS2PHC_MASTER, PORT_ITEM_INT("ts2phc.master", 0, 0, 1)) \
+	X(CFG_TS2PHC_NMEA_REMOTE_HOST, \
+	  GLOB_ITEM_STR("ts2phc.nmea_remote_host", "")) \
+	X(CFG_TS2PHC_NMEA_REMOTE_PORT, \
+	  GLOB_ITEM_STR("ts2phc.nmea_remote_port", "")) \
+	X(CFG_TS2PHC_NMEA_SERIALPORT, \
+	  GLOB_ITEM_STR("ts2phc.nmea_serialport", "/dev/ttyS0")) \
+	X(CFG_TS2PHC_PIN_INDEX, \
+	  PORT_ITEM_INT("ts2phc.pin_index", 0, 0, INT_MAX)) \
+	X(CFG_TS2PHC_PULSEWIDTH, \
+	  GLOB_ITEM_INT("ts2phc.pulsewidth", 500000000, 1000000, 999000000)) \
+	X(CFG_TSPROC_MODE, \
+	  PORT_ITEM_ENU("tsproc_mode", TSPROC_FILTER, tsproc_enu)) \
+	X(CFG_TWO_STEP_FLAG, GLOB_ITEM_INT("twoStepFlag", 1, 0, 1)) \
+	X(CFG_TX_TIMESTAMP_TIMEOUT, \
+	  GLOB_ITEM_INT("tx_timestamp_timeout", 1, 1, INT_MAX)) \
+	X(CFG_UDP_TTL, PORT_ITEM_INT("udp_ttl", 1, 1, 255)) \
+	X(CFG_UDP6_SCOPE, PORT_ITEM_INT("udp6_scope", 0x0E, 0x00, 0x0F)) \
+	X(CFG_UDS_ADDRESS, GLOB_ITEM_STR("uds_address", "/var/run/ptp4l")) \
+	X(CFG_UNICAST_LISTEN, PORT_ITEM_INT("unicast_listen", 0, 0, 1)) \
+	X(CFG_UNICAST_MASTER_TABLE, \
+	  PORT_ITEM_INT("unicast_master_table", 0, 0, INT_MAX)) \
+	X(CFG_UNICAST_REQ_DURATION, \
+	  PORT_ITEM_INT("unicast_req_duration", 3600, 10, INT_MAX)) \
+	X(CFG_USE_SYSLOG, GLOB_ITEM_INT("use_syslog", 1, 0, 1)) \
+	X(CFG_USER_DESCRIPTION, GLOB_ITEM_STR("userDescription", "")) \
+	X(CFG_UTC_OFFSET, \
+	  GLOB_ITEM_INT("utc_offset", CURRENT_UTC_OFFSET, 0, INT_MAX)) \
+	X(CFG_VERBOSE, GLOB_ITEM_INT("verbose", 0, 0, 1)) \
+	X(CFG_WRITE_PHASE_MODE, GLOB_ITEM_INT("write_phase_mode", 0, 0, 1))
+
+#endif
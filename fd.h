@@ -20,13 +20,17 @@
 #ifndef HAVE_FD_H
 #define HAVE_FD_H
 
-#define N_TIMER_FDS 8
+#define N_TIMER_FDS 9
 
 /*
+ * The timers do not use descriptors of their own. They live in the
+ * timer wheel of the clock, and their slots in the fdarray remain -1,
+ * but expired timers are dispatched by index just like descriptors.
+ *
  * The order matters here.  The DELAY timer must appear before the
  * ANNOUNCE and SYNC_RX timers in order to correctly handle the case
  * when the DELAY timer and one of the other two expire during the
- * same call to poll().
+ * same pass of the main loop.
  */
 enum {
 	FD_EVENT,
@@ -39,6 +43,7 @@ enum {
 	FD_SYNC_TX_TIMER,
 	FD_UNICAST_REQ_TIMER,
 	FD_UNICAST_SRV_TIMER,
+	FD_TXTS_TIMER,
 	FD_RTNL,
 	N_POLLFD,
 };
@@ -31,6 +31,8 @@ struct filter;
 enum filter_type {
 	FILTER_MOVING_AVERAGE,
 	FILTER_MOVING_MEDIAN,
+	FILTER_TREE_MEDIAN,
+	FILTER_TRIMMED_MEAN,
 };
 
 /**
@@ -21,28 +21,42 @@
 #define HAVE_FOREIGN_H
 
 #include <sys/queue.h>
+#include <time.h>
 
+#include "address.h"
 #include "ds.h"
 #include "port.h"
 
 #define FOREIGN_MASTER_THRESHOLD 2
 
+/**
+ * The receipt of an announce message, which counts towards the
+ * qualification of a foreign master until it ages out.
+ */
+struct foreign_announce {
+	struct timespec ts;
+	Integer8 logMessageInterval;
+};
+
 struct foreign_clock {
 	/**
-	 * Pointer to next foreign_clock in list.
+	 * Pointer to next foreign_clock in the hash bucket.
 	 */
 	LIST_ENTRY(foreign_clock) list;
 
 	/**
-	 * A list of received announce messages.
-	 *
-	 * The data set field, foreignMasterPortIdentity, is the
-	 * sourcePortIdentity of the first message.
+	 * Position in the list of the records in use, least recently
+	 * heard first, or in the list of free records.
+	 */
+	TAILQ_ENTRY(foreign_clock) lru;
+
+	/**
+	 * The latest announce messages received, newest first.
 	 */
-	TAILQ_HEAD(messages, ptp_message) messages;
+	struct foreign_announce rx[FOREIGN_MASTER_THRESHOLD];
 
 	/**
-	 * Number of elements in the message list,
+	 * Number of valid elements in the rx array,
 	 * aka foreignMasterAnnounceMessages.
 	 */
 	unsigned int n_messages;
@@ -55,8 +69,20 @@ struct foreign_clock {
 	/**
 	 * Contains the information from the latest announce message
 	 * in a form suitable for comparision in the BMCA.
+	 *
+	 * The data set field, foreignMasterPortIdentity, is the
+	 * sourcePortIdentity of the first message.
 	 */
 	struct dataset dataset;
+
+	/**
+	 * The time properties and the source address of the latest
+	 * announce message, for when the foreign master is selected.
+	 */
+	Integer16 currentUtcOffset;
+	UInteger8 flags;
+	Enumeration8 timeSource;
+	struct address address;
 };
 
 #endif
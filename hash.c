@@ -22,92 +22,183 @@
 
 #include "hash.h"
 
-#define HASH_TABLE_SIZE 200
+/*
+ * The table uses open addressing with linear probing. Each slot caches
+ * the full hash of its key, so that probing only compares the strings
+ * when the hashes match, and growing the table never rehashes a key.
+ * Since elements are never removed, no tombstones are needed.
+ */
+#define HASH_INITIAL_SIZE	256	/* must be a power of two */
+#define HASH_ARENA_SIZE		4096
 
-struct node {
-	char *key;
+struct slot {
+	const char *key;
 	void *data;
-	struct node *next;
+	unsigned int hash;
+};
+
+/* The keys are copied into a chain of arena blocks. */
+struct arena {
+	struct arena *next;
+	size_t used;
+	size_t size;
+	char buf[];
 };
 
 struct hash {
-	struct node *table[HASH_TABLE_SIZE];
+	struct slot *table;
+	unsigned int size;
+	unsigned int count;
+	struct arena *arena;
 };
 
-static unsigned int hash_function(const char* s)
+unsigned int hash_key(const char *key)
 {
-	unsigned int i;
+	unsigned int h = 2166136261u;
+
+	/* FNV-1a */
+	for (; *key; key++) {
+		h ^= (unsigned char) *key;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static struct slot *hash_find(struct hash *ht, const char *key,
+			      unsigned int h)
+{
+	unsigned int i, mask = ht->size - 1;
+	struct slot *s;
+
+	for (i = h & mask; ; i = (i + 1) & mask) {
+		s = &ht->table[i];
+		if (!s->key) {
+			return s;
+		}
+		if (s->hash == h && !strcmp(s->key, key)) {
+			return s;
+		}
+	}
+}
+
+static int hash_grow(struct hash *ht)
+{
+	unsigned int i, j, mask, size = ht->size * 2;
+	struct slot *table;
 
-	for (i = 0; *s; s++) {
-		i = 131 * i + *s;
+	table = calloc(size, sizeof(*table));
+	if (!table) {
+		return -1;
 	}
-	return i % HASH_TABLE_SIZE;
+	mask = size - 1;
+	for (i = 0; i < ht->size; i++) {
+		if (!ht->table[i].key) {
+			continue;
+		}
+		for (j = ht->table[i].hash & mask; table[j].key; j = (j + 1) & mask)
+			;
+		table[j] = ht->table[i];
+	}
+	free(ht->table);
+	ht->table = table;
+	ht->size = size;
+	return 0;
+}
+
+static char *arena_strdup(struct hash *ht, const char *key)
+{
+	size_t len = strlen(key) + 1, size;
+	struct arena *a = ht->arena;
+	char *p;
+
+	if (!a || a->size - a->used < len) {
+		size = len > HASH_ARENA_SIZE ? len : HASH_ARENA_SIZE;
+		a = malloc(sizeof(*a) + size);
+		if (!a) {
+			return NULL;
+		}
+		a->next = ht->arena;
+		a->used = 0;
+		a->size = size;
+		ht->arena = a;
+	}
+	p = a->buf + a->used;
+	memcpy(p, key, len);
+	a->used += len;
+	return p;
 }
 
 struct hash *hash_create(void)
 {
 	struct hash *ht = calloc(1, sizeof(*ht));
+
+	if (!ht) {
+		return NULL;
+	}
+	ht->table = calloc(HASH_INITIAL_SIZE, sizeof(*ht->table));
+	if (!ht->table) {
+		free(ht);
+		return NULL;
+	}
+	ht->size = HASH_INITIAL_SIZE;
 	return ht;
 }
 
 void hash_destroy(struct hash *ht, void (*func)(void *))
 {
+	struct arena *a, *next;
 	unsigned int i;
-	struct node *n, *next, **table = ht->table;
-
-	for (i = 0; i < HASH_TABLE_SIZE; i++) {
-		for (n = table[i] ; n; n = next) {
-			next = n->next;
-			if (func) {
-				func(n->data);
-			}
-			free(n->key);
-			free(n);
+
+	for (i = 0; i < ht->size; i++) {
+		if (ht->table[i].key && func) {
+			func(ht->table[i].data);
 		}
 	}
-
+	for (a = ht->arena; a; a = next) {
+		next = a->next;
+		free(a);
+	}
+	free(ht->table);
 	free(ht);
 }
 
 int hash_insert(struct hash *ht, const char* key, void *data)
 {
-	unsigned int h;
-	struct node *n, **table = ht->table;
+	return hash_insert_key(ht, key, hash_key(key), data);
+}
 
-	h = hash_function(key);
+int hash_insert_key(struct hash *ht, const char *key, unsigned int h,
+		    void *data)
+{
+	struct slot *s;
 
-	for (n = table[h] ; n; n = n->next) {
-		if (!strcmp(n->key, key)) {
-			/* reject duplicate keys */
-			return -1;
-		}
+	/* Keep the load factor at or below 3/4. */
+	if (4 * (ht->count + 1) > 3 * ht->size && hash_grow(ht)) {
+		return -1;
 	}
-	n = calloc(1, sizeof(*n));
-	if (!n) {
+	s = hash_find(ht, key, h);
+	if (s->key) {
+		/* reject duplicate keys */
 		return -1;
 	}
-	n->key = strdup(key);
-	if (!n->key) {
-		free(n);
+	s->key = arena_strdup(ht, key);
+	if (!s->key) {
 		return -1;
 	}
-	n->data = data;
-	n->next = table[h];
-	table[h] = n;
+	s->data = data;
+	s->hash = h;
+	ht->count++;
 	return 0;
 }
 
 void *hash_lookup(struct hash *ht, const char* key)
 {
-	unsigned int h;
-	struct node *n, **table = ht->table;
+	return hash_lookup_key(ht, key, hash_key(key));
+}
 
-	h = hash_function(key);
+void *hash_lookup_key(struct hash *ht, const char *key, unsigned int h)
+{
+	struct slot *s = hash_find(ht, key, h);
 
-	for (n = table[h] ; n; n = n->next) {
-		if (!strcmp(n->key, key)) {
-			return n->data;
-		}
-	}
-	return NULL;
+	return s->key ? s->data : NULL;
 }
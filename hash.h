@@ -54,6 +54,35 @@ int hash_insert(struct hash *ht, const char* key, void *data);
  */
 void *hash_lookup(struct hash *ht, const char* key);
 
+/**
+ * Computes the hash of a key. Callers which look up the same key
+ * repeatedly may cache the result and use @ref hash_insert_key() and
+ * @ref hash_lookup_key() to avoid hashing the key each time.
+ * @param key  Key that identifies an element.
+ * @return     The hash value of the key.
+ */
+unsigned int hash_key(const char *key);
+
+/**
+ * Inserts an element into a hash table using a precomputed hash.
+ * @param ht   Hash table into which the element is to be stored.
+ * @param key  Key that identifies the element.
+ * @param h    The value of @ref hash_key() for 'key'.
+ * @param data Pointer to the user data to be stored.
+ * @return Zero on success and non-zero on error, as @ref hash_insert().
+ */
+int hash_insert_key(struct hash *ht, const char *key, unsigned int h,
+		    void *data);
+
+/**
+ * Looks up an element from the hash table using a precomputed hash.
+ * @param ht   Hash table to consult.
+ * @param key  Key identifying the element of interest.
+ * @param h    The value of @ref hash_key() for 'key'.
+ * @return  Pointer to the element's data, or NULL if the key is not found.
+ */
+void *hash_lookup_key(struct hash *ht, const char *key, unsigned int h);
+
 #endif
 
 
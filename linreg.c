@@ -18,19 +18,19 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#include "config.h"
 #include "linreg.h"
 #include "print.h"
 #include "servo_private.h"
 
-/* Maximum and minimum number of points used in regression,
+/* Limits of the number of points used in regression,
    defined as a power of 2 */
-#define MAX_SIZE 6
+#define MAX_SIZE_LIMIT 16
 #define MIN_SIZE 2
 
-#define MAX_POINTS (1 << MAX_SIZE)
-
 /* Smoothing factor used for long-term prediction error */
 #define ERR_SMOOTH 0.02
 /* Number of updates used for initialization */
@@ -38,6 +38,9 @@
 /* Maximum ratio of two err values to be considered equal */
 #define ERR_EQUALS 1.05
 
+/* Number of servos taken at a time by the batch kernel */
+#define BATCH_SIZE 16
+
 /* Uncorrected local time vs remote time */
 struct point {
 	uint64_t x;
@@ -45,7 +48,27 @@ struct point {
 	double w;
 };
 
+/*
+ * Weighted sums of the points in a window, with the coordinates taken
+ * relative to the anchor. Points are added to and evicted from the sums
+ * as the window slides, so that a regression costs O(1) regardless of
+ * the window size.
+ */
+struct sums {
+	/* Origin of the coordinates */
+	struct point anchor;
+	/* Number of points added since the sums were recomputed */
+	unsigned int age;
+	double w;
+	double wx;
+	double wy;
+	double wxx;
+	double wxy;
+};
+
 struct result {
+	/* Running sums of the points in the window */
+	struct sums sums;
 	/* Slope and intercept from latest regression */
 	double slope;
 	double intercept;
@@ -58,7 +81,10 @@ struct result {
 struct linreg_servo {
 	struct servo servo;
 	/* Circular buffer of points */
-	struct point points[MAX_POINTS];
+	struct point *points;
+	/* Largest size and number of points in the buffer */
+	unsigned int max_size;
+	unsigned int max_points;
 	/* Current time in x, y */
 	struct point reference;
 	/* Number of stored points */
@@ -70,7 +96,7 @@ struct linreg_servo {
 	/* Local time stamp of last update */
 	uint64_t last_update;
 	/* Regression results for all sizes */
-	struct result results[MAX_SIZE - MIN_SIZE + 1];
+	struct result results[MAX_SIZE_LIMIT - MIN_SIZE + 1];
 	/* Selected size */
 	unsigned int size;
 	/* Current frequency offset of the clock */
@@ -86,6 +112,7 @@ struct linreg_servo {
 static void linreg_destroy(struct servo *servo)
 {
 	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
+	free(s->points);
 	free(s);
 }
 
@@ -98,7 +125,7 @@ static void move_reference(struct linreg_servo *s, int64_t x, int64_t y)
 	s->reference.y += y;
 
 	/* Update intercepts for new reference */
-	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
+	for (i = MIN_SIZE; i <= s->max_size; i++) {
 		res = &s->results[i - MIN_SIZE];
 		res->intercept += x * res->slope - y;
 	}
@@ -123,70 +150,189 @@ static void update_reference(struct linreg_servo *s, uint64_t local_ts)
 	s->last_update = local_ts;
 }
 
+static void sums_update(struct sums *sums, struct point *p, double sign)
+{
+	double x, y, w;
+
+	x = (int64_t)(p->x - sums->anchor.x);
+	y = (int64_t)(p->y - sums->anchor.y);
+	w = sign * p->w;
+
+	sums->w += w;
+	sums->wx += x * w;
+	sums->wy += y * w;
+	sums->wxx += x * x * w;
+	sums->wxy += x * y * w;
+}
+
+/*
+ * Recomputes the sums of a window of n points relative to the newest
+ * point. Doing it each time the window has been replaced keeps the
+ * coordinates within two window lengths of the anchor, and it discards
+ * the rounding errors accumulated by the updates, at an average cost
+ * of O(1) per sample.
+ */
+static void rebuild_sums(struct linreg_servo *s, struct sums *sums,
+			 unsigned int n)
+{
+	unsigned int i, l;
+
+	memset(sums, 0, sizeof(*sums));
+	sums->anchor = s->points[s->last_point];
+
+	for (i = 0; i < n && i < s->num_points; i++) {
+		/* Iterate points from newest to oldest */
+		l = (s->max_points + s->last_point - i) % s->max_points;
+		sums_update(sums, &s->points[l], 1.0);
+	}
+}
+
 static void add_sample(struct linreg_servo *s, int64_t offset, double weight)
 {
-	s->last_point = (s->last_point + 1) % MAX_POINTS;
+	unsigned int l, n, size;
+	struct sums *sums;
+	struct point *p;
+
+	s->last_point = (s->last_point + 1) % s->max_points;
+	p = &s->points[s->last_point];
+
+	/* Evict the points leaving the windows, before overwriting one. */
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			break;
+		sums = &s->results[size - MIN_SIZE].sums;
+		if (sums->age + 1 >= n)
+			continue;
+		l = (s->max_points + s->last_point - n) % s->max_points;
+		sums_update(sums, &s->points[l], -1.0);
+	}
 
-	s->points[s->last_point].x = s->reference.x;
-	s->points[s->last_point].y = s->reference.y - offset;
-	s->points[s->last_point].w = weight;
+	p->x = s->reference.x;
+	p->y = s->reference.y - offset;
+	p->w = weight;
 
-	if (s->num_points < MAX_POINTS)
+	if (s->num_points < s->max_points)
 		s->num_points++;
+
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
+		n = 1 << size;
+		sums = &s->results[size - MIN_SIZE].sums;
+		if (++sums->age >= n)
+			rebuild_sums(s, sums, n);
+		else
+			sums_update(sums, p, 1.0);
+	}
 }
 
-static void regress(struct linreg_servo *s)
+/*
+ * The regressions of all window sizes, and of all servos in a batch,
+ * are independent of each other. They are gathered into the lanes of
+ * vectors and computed together.
+ */
+struct lanes {
+	int n;
+	struct result *res[SERVO_VEC_LEN];
+	servo_vec w, wx, wy, wxx, wxy;
+	servo_vec y0, dx, dy, slope, intercept, err, err_updates;
+};
+
+static void lanes_run(struct lanes *l)
 {
-	double x, y, y0, e, x_sum, y_sum, xy_sum, x2_sum, w, w_sum;
-	unsigned int i, l, n, size;
-	struct result *res;
+	servo_vec e, err_init, err_smooth, slope, zero = { 0 };
+	servo_mask seen, init;
+	int i;
+
+	/* Fill the unused lanes with harmless values. */
+	for (i = l->n; i < SERVO_VEC_LEN; i++) {
+		l->w[i] = 1.0;
+		l->wx[i] = 0.0;
+		l->wy[i] = 0.0;
+		l->wxx[i] = 1.0;
+		l->wxy[i] = 0.0;
+		l->y0[i] = 0.0;
+		l->dx[i] = 0.0;
+		l->dy[i] = 0.0;
+		l->slope[i] = 0.0;
+		l->intercept[i] = 0.0;
+		l->err[i] = 0.0;
+		l->err_updates[i] = 0.0;
+	}
 
-	x_sum = 0.0, y_sum = 0.0, xy_sum = 0.0, x2_sum = 0.0; w_sum = 0.0;
-	i = 0;
+	/* Update moving average of the prediction error */
+	e = l->intercept - l->y0;
+	e = servo_vec_select(e < 0.0, -e, e);
+	seen = l->slope != 0.0;
+	init = seen & (l->err_updates < ERR_INITIAL_UPDATES);
+	err_init = (l->err * l->err_updates + e) / (l->err_updates + 1.0);
+	err_smooth = l->err + ERR_SMOOTH * (e - l->err);
+	l->err = servo_vec_select(init, err_init,
+				  servo_vec_select(seen, err_smooth, l->err));
+	l->err_updates += servo_vec_select(init, zero + 1.0, zero);
+
+	/* Get new intercept and slope */
+	slope = (l->wxy - l->wx * l->wy / l->w) /
+		(l->wxx - l->wx * l->wx / l->w);
+
+	/* Move the intercept from the anchor to the reference */
+	l->intercept = (l->wy - slope * l->wx) / l->w +
+		slope * l->dx - l->dy;
+
+	for (i = 0; i < l->n; i++) {
+		l->res[i]->slope = slope[i];
+		l->res[i]->intercept = l->intercept[i];
+		l->res[i]->err = l->err[i];
+		l->res[i]->err_updates = l->err_updates[i];
+	}
+	l->n = 0;
+}
+
+static void lanes_add(struct lanes *l, struct linreg_servo *s)
+{
+	unsigned int n, size;
+	struct result *res;
+	double y0;
+	int k;
 
 	y0 = (int64_t)(s->points[s->last_point].y - s->reference.y);
 
-	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
 		n = 1 << size;
 		if (n > s->num_points)
 			/* Not enough points for this size */
 			break;
 
 		res = &s->results[size - MIN_SIZE];
+		k = l->n++;
+		l->res[k] = res;
+		l->w[k] = res->sums.w;
+		l->wx[k] = res->sums.wx;
+		l->wy[k] = res->sums.wy;
+		l->wxx[k] = res->sums.wxx;
+		l->wxy[k] = res->sums.wxy;
+		l->y0[k] = y0;
+		l->dx[k] = (int64_t)(s->reference.x - res->sums.anchor.x);
+		l->dy[k] = (int64_t)(s->reference.y - res->sums.anchor.y);
+		l->slope[k] = res->slope;
+		l->intercept[k] = res->intercept;
+		l->err[k] = res->err;
+		l->err_updates[k] = res->err_updates;
+		if (l->n == SERVO_VEC_LEN)
+			lanes_run(l);
+	}
+}
 
-		/* Update moving average of the prediction error */
-		if (res->slope) {
-			e = fabs(res->intercept - y0);
-			if (res->err_updates < ERR_INITIAL_UPDATES) {
-				res->err *= res->err_updates;
-				res->err += e;
-				res->err_updates++;
-				res->err /= res->err_updates;
-			} else {
-				res->err += ERR_SMOOTH * (e - res->err);
-			}
-		}
-
-		for (; i < n; i++) {
-			/* Iterate points from newest to oldest */
-			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
-
-			x = (int64_t)(s->points[l].x - s->reference.x);
-			y = (int64_t)(s->points[l].y - s->reference.y);
-			w = s->points[l].w;
-
-			x_sum += x * w;
-			y_sum += y * w;
-			xy_sum += x * y * w;
-			x2_sum += x * x * w;
-			w_sum += w;
-		}
+static void regress(struct linreg_servo **s, int n)
+{
+	struct lanes l;
+	int i;
 
-		/* Get new intercept and slope */
-		res->slope = (xy_sum - x_sum * y_sum / w_sum) /
-				(x2_sum - x_sum * x_sum / w_sum);
-		res->intercept = (y_sum - res->slope * x_sum) / w_sum;
+	l.n = 0;
+	for (i = 0; i < n; i++) {
+		lanes_add(&l, s[i]);
 	}
+	if (l.n)
+		lanes_run(&l);
 }
 
 static void update_size(struct linreg_servo *s)
@@ -200,7 +346,7 @@ static void update_size(struct linreg_servo *s)
 	best_size = 0;
 	best_err = 0.0;
 
-	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
 		res = &s->results[size - MIN_SIZE];
 		if ((!best_size && res->slope) ||
 		    (best_err * ERR_EQUALS > res->err &&
@@ -213,28 +359,16 @@ static void update_size(struct linreg_servo *s)
 	s->size = best_size;
 }
 
-static double linreg_sample(struct servo *servo,
-			    int64_t offset,
-			    uint64_t local_ts,
-			    double weight,
+/*
+ * Takes the frequency from the regression results of a new sample.
+ */
+static double linreg_update(struct linreg_servo *s, int64_t offset,
 			    enum servo_state *state)
 {
-	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
+	struct servo *servo = &s->servo;
 	struct result *res;
 	int corr_interval;
 
-	/*
-	 * The current time and the time when will be the frequency of the
-	 * clock actually updated is assumed here to be equal to local_ts
-	 * (which is the time stamp of the received sync message). As long as
-	 * the differences are smaller than the update interval, the loop
-	 * should be robust enough to handle this simplification.
-	 */
-
-	update_reference(s, local_ts);
-	add_sample(s, offset, weight);
-	regress(s);
-
 	update_size(s);
 
 	if (s->size < MIN_SIZE) {
@@ -286,6 +420,54 @@ static double linreg_sample(struct servo *servo,
 	return -s->clock_freq;
 }
 
+static double linreg_sample(struct servo *servo,
+			    int64_t offset,
+			    uint64_t local_ts,
+			    double weight,
+			    enum servo_state *state)
+{
+	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
+
+	/*
+	 * The current time and the time when will be the frequency of the
+	 * clock actually updated is assumed here to be equal to local_ts
+	 * (which is the time stamp of the received sync message). As long as
+	 * the differences are smaller than the update interval, the loop
+	 * should be robust enough to handle this simplification.
+	 */
+
+	update_reference(s, local_ts);
+	add_sample(s, offset, weight);
+	regress(&s, 1);
+
+	return linreg_update(s, offset, state);
+}
+
+static void linreg_sample_batch(struct servo **servo, int n,
+				const int64_t *offset,
+				const uint64_t *local_ts,
+				const double *weight, double *freq,
+				enum servo_state *state)
+{
+	struct linreg_servo *s[BATCH_SIZE];
+	int i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i < BATCH_SIZE ? n - i : BATCH_SIZE;
+		for (j = 0; j < m; j++) {
+			s[j] = container_of(servo[i + j], struct linreg_servo,
+					    servo);
+			update_reference(s[j], local_ts[i + j]);
+			add_sample(s[j], offset[i + j], weight[i + j]);
+		}
+		regress(s, m);
+		for (j = 0; j < m; j++) {
+			freq[i + j] = linreg_update(s[j], offset[i + j],
+						    &state[i + j]);
+		}
+	}
+}
+
 static void linreg_sync_interval(struct servo *servo, double interval)
 {
 	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
@@ -303,7 +485,8 @@ static void linreg_reset(struct servo *servo)
 	s->size = 0;
 	s->frequency_ratio = 1.0;
 
-	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
+	for (i = MIN_SIZE; i <= s->max_size; i++) {
+		memset(&s->results[i - MIN_SIZE].sums, 0, sizeof(struct sums));
 		s->results[i - MIN_SIZE].slope = 0.0;
 		s->results[i - MIN_SIZE].err_updates = 0;
 	}
@@ -330,16 +513,31 @@ static void linreg_leap(struct servo *servo, int leap)
 	s->leap = leap;
 }
 
-struct servo *linreg_servo_create(int fadj)
+struct servo *linreg_servo_create(struct config *cfg, int fadj)
 {
 	struct linreg_servo *s;
+	int max_points;
 
 	s = calloc(1, sizeof(*s));
 	if (!s)
 		return NULL;
 
+	/* Round the number of points down to a power of 2. */
+	max_points = config_int(cfg, 0, CFG_LINREG_MAX_POINTS);
+	for (s->max_size = MIN_SIZE;
+	     s->max_size < MAX_SIZE_LIMIT && 2 << s->max_size <= max_points;
+	     s->max_size++)
+		;
+	s->max_points = 1 << s->max_size;
+	s->points = calloc(s->max_points, sizeof(*s->points));
+	if (!s->points) {
+		free(s);
+		return NULL;
+	}
+
 	s->servo.destroy = linreg_destroy;
 	s->servo.sample = linreg_sample;
+	s->servo.sample_batch = linreg_sample_batch;
 	s->servo.sync_interval = linreg_sync_interval;
 	s->servo.reset = linreg_reset;
 	s->servo.rate_ratio = linreg_rate_ratio;
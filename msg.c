@@ -19,10 +19,10 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-#include "contain.h"
 #include "msg.h"
 #include "print.h"
 #include "tlv.h"
@@ -37,24 +37,45 @@ int assume_two_step = 0;
  */
 #define MSG_HEADROOM 24
 
+/*
+ * Each storage object starts on a cache line of its own, so that two
+ * messages never share a line.
+ */
+#define MSG_CACHE_LINE 64
+
 struct message_storage {
 	unsigned char reserved[MSG_HEADROOM];
 	struct ptp_message msg;
-} PACKED;
+} PACKED __attribute__((aligned(MSG_CACHE_LINE)));
 
-static TAILQ_HEAD(msg_pool, ptp_message) msg_pool = TAILQ_HEAD_INITIALIZER(msg_pool);
+/*
+ * Messages are carved out of slabs, which are allocated in bulk and
+ * never returned to the system before msg_cleanup(). Every thread
+ * keeps its own free list, and so the fast path needs neither locks
+ * nor atomic operations on the lists. Only the statistics are shared.
+ */
+#define MSG_SLAB_SIZE 32
 
-static struct {
-	int total;
+struct msg_slab {
+	LIST_ENTRY(msg_slab) list;
 	int count;
-} pool_stats;
+	struct message_storage storage[];
+};
+
+struct msg_cache {
+	TAILQ_HEAD(msg_pool, ptp_message) pool;
+	LIST_HEAD(msg_slabs, msg_slab) slabs;
+};
+
+static __thread struct msg_cache msg_cache;
+
+static struct msg_pool_stats pool_stats;
 
 #ifdef DEBUG_POOL
 static void pool_debug(const char *str, void *addr)
 {
-	fprintf(stderr, "*** %p %10s total %d count %d used %d\n",
-		addr, str, pool_stats.total, pool_stats.count,
-		pool_stats.total - pool_stats.count);
+	fprintf(stderr, "*** %p %10s total %u used %u\n",
+		addr, str, pool_stats.total, pool_stats.in_use);
 }
 #else
 static void pool_debug(const char *str, void *addr)
@@ -254,44 +275,128 @@ static void timestamp_pre_send(struct Timestamp *ts)
 
 /* public methods */
 
+static struct msg_cache *msg_cache_get(void)
+{
+	struct msg_cache *mc = &msg_cache;
+
+	if (!mc->pool.tqh_last) {
+		TAILQ_INIT(&mc->pool);
+		LIST_INIT(&mc->slabs);
+	}
+	return mc;
+}
+
+/*
+ * Adds a slab of up to 'n' messages to the free list of the calling
+ * thread, within the limit of the pool. Returns the number of new
+ * messages.
+ */
+static int msg_pool_refill(struct msg_cache *mc, int n)
+{
+	unsigned int limit = __atomic_load_n(&pool_stats.limit, __ATOMIC_RELAXED);
+	unsigned int total;
+	struct msg_slab *slab;
+	void *ptr;
+	int i;
+
+	total = __atomic_add_fetch(&pool_stats.total, n, __ATOMIC_RELAXED);
+	if (limit && total > limit) {
+		/* Give back whatever exceeds the limit. */
+		i = total - limit < n ? total - limit : n;
+		__atomic_sub_fetch(&pool_stats.total, i, __ATOMIC_RELAXED);
+		n -= i;
+	}
+	if (n <= 0) {
+		return 0;
+	}
+	if (posix_memalign(&ptr, MSG_CACHE_LINE, sizeof(*slab) +
+			   n * sizeof(struct message_storage))) {
+		__atomic_sub_fetch(&pool_stats.total, n, __ATOMIC_RELAXED);
+		return 0;
+	}
+	slab = ptr;
+	slab->count = n;
+	LIST_INSERT_HEAD(&mc->slabs, slab, list);
+	for (i = 0; i < n; i++) {
+		TAILQ_INSERT_TAIL(&mc->pool, &slab->storage[i].msg, list);
+	}
+	pool_debug("refill", slab);
+	return n;
+}
+
+int msg_pool_init(int prealloc, int limit)
+{
+	struct msg_cache *mc = msg_cache_get();
+
+	pool_stats.limit = limit;
+	if (prealloc > 0 && msg_pool_refill(mc, prealloc) < prealloc) {
+		return -1;
+	}
+	return 0;
+}
+
+void msg_pool_stats(struct msg_pool_stats *stats)
+{
+	stats->total = __atomic_load_n(&pool_stats.total, __ATOMIC_RELAXED);
+	stats->in_use = __atomic_load_n(&pool_stats.in_use, __ATOMIC_RELAXED);
+	stats->high_water = __atomic_load_n(&pool_stats.high_water,
+					    __ATOMIC_RELAXED);
+	stats->limit = __atomic_load_n(&pool_stats.limit, __ATOMIC_RELAXED);
+	stats->failures = __atomic_load_n(&pool_stats.failures,
+					  __ATOMIC_RELAXED);
+}
+
 struct ptp_message *msg_allocate(void)
 {
-	struct message_storage *s;
-	struct ptp_message *m = TAILQ_FIRST(&msg_pool);
-
-	if (m) {
-		TAILQ_REMOVE(&msg_pool, m, list);
-		pool_stats.count--;
-		pool_debug("dequeue", m);
-	} else {
-		s = malloc(sizeof(*s));
-		if (s) {
-			m = &s->msg;
-			pool_stats.total++;
-			pool_debug("allocate", m);
-		}
+	struct msg_cache *mc = msg_cache_get();
+	unsigned int in_use, high_water;
+	struct ptp_message *m;
+
+	m = TAILQ_FIRST(&mc->pool);
+	if (!m && msg_pool_refill(mc, MSG_SLAB_SIZE)) {
+		m = TAILQ_FIRST(&mc->pool);
+	}
+	if (!m) {
+		__atomic_add_fetch(&pool_stats.failures, 1, __ATOMIC_RELAXED);
+		return NULL;
 	}
-	if (m) {
-		memset(m, 0, sizeof(*m));
-		m->refcnt = 1;
-		TAILQ_INIT(&m->tlv_list);
+	TAILQ_REMOVE(&mc->pool, m, list);
+	pool_debug("dequeue", m);
+
+	in_use = __atomic_add_fetch(&pool_stats.in_use, 1, __ATOMIC_RELAXED);
+	high_water = __atomic_load_n(&pool_stats.high_water, __ATOMIC_RELAXED);
+	while (in_use > high_water &&
+	       !__atomic_compare_exchange_n(&pool_stats.high_water, &high_water,
+					    in_use, 1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED)) {
+		;
 	}
 
+	memset(m, 0, sizeof(*m));
+	m->refcnt = 1;
+	TAILQ_INIT(&m->tlv_list);
+
 	return m;
 }
 
 void msg_cleanup(void)
 {
-	struct message_storage *s;
-	struct ptp_message *m;
+	struct msg_cache *mc = msg_cache_get();
+	struct msg_slab *slab;
 
 	tlv_extra_cleanup();
 
-	while ((m = TAILQ_FIRST(&msg_pool)) != NULL) {
-		TAILQ_REMOVE(&msg_pool, m, list);
-		s = container_of(m, struct message_storage, msg);
-		free(s);
+	/* Messages still in use must stay valid, so keep the slabs. */
+	if (__atomic_load_n(&pool_stats.in_use, __ATOMIC_RELAXED)) {
+		return;
+	}
+	while ((slab = LIST_FIRST(&mc->slabs)) != NULL) {
+		LIST_REMOVE(slab, list);
+		__atomic_sub_fetch(&pool_stats.total, slab->count,
+				   __ATOMIC_RELAXED);
+		free(slab);
 	}
+	TAILQ_INIT(&mc->pool);
 }
 
 struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
@@ -575,10 +680,10 @@ void msg_put(struct ptp_message *m)
 	if (m->refcnt) {
 		return;
 	}
-	pool_stats.count++;
+	__atomic_sub_fetch(&pool_stats.in_use, 1, __ATOMIC_RELAXED);
 	pool_debug("recycle", m);
 	msg_tlv_recycle(m);
-	TAILQ_INSERT_HEAD(&msg_pool, m, list);
+	TAILQ_INSERT_HEAD(&msg_cache_get()->pool, m, list);
 }
 
 int msg_sots_missing(struct ptp_message *m)
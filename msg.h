@@ -335,6 +335,34 @@ static inline int msg_type(const struct ptp_message *m)
 	return m->header.tsmt & 0x0f;
 }
 
+/**
+ * Statistics of the message pool. All figures count messages.
+ */
+struct msg_pool_stats {
+	unsigned int total;      /* allocated from the system */
+	unsigned int in_use;     /* currently allocated to users */
+	unsigned int high_water; /* largest in_use value so far */
+	unsigned int limit;      /* upper bound of total, or zero */
+	unsigned int failures;   /* allocations refused */
+};
+
+/**
+ * Set up the message pool. This is optional, and without it the pool
+ * grows on demand with no upper bound.
+ *
+ * @param prealloc  Number of messages to allocate right away.
+ * @param limit     Maximum number of messages, or zero for no limit.
+ * @return          Zero on success, non-zero if the preallocation failed.
+ */
+int msg_pool_init(int prealloc, int limit);
+
+/**
+ * Obtain the statistics of the message pool.
+ *
+ * @param stats  Returns the current statistics.
+ */
+void msg_pool_stats(struct msg_pool_stats *stats);
+
 /**
  * Allocate a new message instance.
  *
@@ -347,7 +375,8 @@ static inline int msg_type(const struct ptp_message *m)
 struct ptp_message *msg_allocate(void);
 
 /**
- * Release all of the memory in the message cache.
+ * Release all of the memory in the message cache of the calling thread.
+ * The memory is kept while any message is still in use.
  */
 void msg_cleanup(void);
 
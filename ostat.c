@@ -0,0 +1,281 @@
+/**
+ * @file ostat.c
+ * @brief Moving median and trimmed mean based on an order statistic tree.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ostat.h"
+#include "filter_private.h"
+
+/*
+ * The samples of the window are kept in a treap, a binary search tree
+ * balanced by random node priorities, so that inserting and removing a
+ * sample takes O(log n) steps on average. Each node counts the nodes
+ * of its subtree and sums their values, which allows finding the k-th
+ * smallest sample and the sum of the k smallest samples in O(log n).
+ *
+ * Node i holds the sample in slot i of the circular buffer. Equal
+ * values are ordered by their slot, which makes every key unique.
+ */
+#define NIL -1
+
+struct node {
+	int64_t value;
+	int64_t sum;
+	uint32_t prio;
+	int cnt;
+	int left;
+	int right;
+};
+
+struct ostat {
+	struct filter filter;
+	int trimmed;
+	int cnt;
+	int len;
+	int index;
+	int root;
+	uint32_t seed;
+	struct node *node;
+};
+
+static uint32_t ostat_random(struct ostat *o)
+{
+	/* xorshift32 */
+	o->seed ^= o->seed << 13;
+	o->seed ^= o->seed >> 17;
+	o->seed ^= o->seed << 5;
+	return o->seed;
+}
+
+static int node_less(struct ostat *o, int a, int b)
+{
+	if (o->node[a].value != o->node[b].value) {
+		return o->node[a].value < o->node[b].value;
+	}
+	return a < b;
+}
+
+static void node_update(struct ostat *o, int t)
+{
+	struct node *n = &o->node[t];
+
+	n->cnt = 1;
+	n->sum = n->value;
+	if (n->left != NIL) {
+		n->cnt += o->node[n->left].cnt;
+		n->sum += o->node[n->left].sum;
+	}
+	if (n->right != NIL) {
+		n->cnt += o->node[n->right].cnt;
+		n->sum += o->node[n->right].sum;
+	}
+}
+
+static int node_insert(struct ostat *o, int t, int x)
+{
+	struct node *n;
+	int tmp;
+
+	if (t == NIL) {
+		return x;
+	}
+	n = &o->node[t];
+	if (node_less(o, x, t)) {
+		n->left = node_insert(o, n->left, x);
+		if (o->node[n->left].prio > n->prio) {
+			/* Rotate right. */
+			tmp = n->left;
+			n->left = o->node[tmp].right;
+			node_update(o, t);
+			o->node[tmp].right = t;
+			t = tmp;
+		}
+	} else {
+		n->right = node_insert(o, n->right, x);
+		if (o->node[n->right].prio > n->prio) {
+			/* Rotate left. */
+			tmp = n->right;
+			n->right = o->node[tmp].left;
+			node_update(o, t);
+			o->node[tmp].left = t;
+			t = tmp;
+		}
+	}
+	node_update(o, t);
+	return t;
+}
+
+static int node_merge(struct ostat *o, int a, int b)
+{
+	if (a == NIL) {
+		return b;
+	}
+	if (b == NIL) {
+		return a;
+	}
+	if (o->node[a].prio > o->node[b].prio) {
+		o->node[a].right = node_merge(o, o->node[a].right, b);
+		node_update(o, a);
+		return a;
+	}
+	o->node[b].left = node_merge(o, a, o->node[b].left);
+	node_update(o, b);
+	return b;
+}
+
+static int node_remove(struct ostat *o, int t, int x)
+{
+	struct node *n = &o->node[t];
+
+	if (t == x) {
+		return node_merge(o, n->left, n->right);
+	}
+	if (node_less(o, x, t)) {
+		n->left = node_remove(o, n->left, x);
+	} else {
+		n->right = node_remove(o, n->right, x);
+	}
+	node_update(o, t);
+	return t;
+}
+
+/* Returns the k-th smallest value, counting from zero. */
+static int64_t ostat_kth(struct ostat *o, int k)
+{
+	int t = o->root, lcnt;
+
+	for (;;) {
+		lcnt = o->node[t].left == NIL ? 0 : o->node[o->node[t].left].cnt;
+		if (k < lcnt) {
+			t = o->node[t].left;
+		} else if (k == lcnt) {
+			return o->node[t].value;
+		} else {
+			k -= lcnt + 1;
+			t = o->node[t].right;
+		}
+	}
+}
+
+/* Returns the sum of the k smallest values. */
+static int64_t ostat_sum(struct ostat *o, int k)
+{
+	int t = o->root, left;
+	int64_t sum = 0;
+
+	while (k > 0 && t != NIL) {
+		left = o->node[t].left;
+		if (left != NIL && k <= o->node[left].cnt) {
+			t = left;
+			continue;
+		}
+		if (left != NIL) {
+			sum += o->node[left].sum;
+			k -= o->node[left].cnt;
+		}
+		sum += o->node[t].value;
+		k--;
+		t = o->node[t].right;
+	}
+	return sum;
+}
+
+static void ostat_destroy(struct filter *filter)
+{
+	struct ostat *o = container_of(filter, struct ostat, filter);
+	free(o->node);
+	free(o);
+}
+
+static tmv_t ostat_sample(struct filter *filter, tmv_t sample)
+{
+	struct ostat *o = container_of(filter, struct ostat, filter);
+	struct node *n = &o->node[o->index];
+	int64_t sum;
+	int trim;
+
+	if (o->cnt < o->len) {
+		o->cnt++;
+	} else {
+		o->root = node_remove(o, o->root, o->index);
+	}
+	n->value = tmv_to_nanoseconds(sample);
+	n->prio = ostat_random(o);
+	n->left = NIL;
+	n->right = NIL;
+	node_update(o, o->index);
+	o->root = node_insert(o, o->root, o->index);
+
+	o->index = (1 + o->index) % o->len;
+
+	if (o->trimmed) {
+		/* Discard the lowest and the highest quarter. */
+		trim = o->cnt / 4;
+		sum = ostat_sum(o, o->cnt - trim) - ostat_sum(o, trim);
+		return nanoseconds_to_tmv(sum / (o->cnt - 2 * trim));
+	}
+	if (o->cnt % 2)
+		return nanoseconds_to_tmv(ostat_kth(o, o->cnt / 2));
+	else
+		return nanoseconds_to_tmv((ostat_kth(o, o->cnt / 2 - 1) +
+					   ostat_kth(o, o->cnt / 2)) / 2);
+}
+
+static void ostat_reset(struct filter *filter)
+{
+	struct ostat *o = container_of(filter, struct ostat, filter);
+	o->cnt = 0;
+	o->index = 0;
+	o->root = NIL;
+}
+
+static struct filter *ostat_create(int length, int trimmed)
+{
+	struct ostat *o;
+
+	if (length < 1)
+		return NULL;
+	o = calloc(1, sizeof(*o));
+	if (!o)
+		return NULL;
+	o->filter.destroy = ostat_destroy;
+	o->filter.sample = ostat_sample;
+	o->filter.reset = ostat_reset;
+	o->node = calloc(1, length * sizeof(*o->node));
+	if (!o->node) {
+		free(o);
+		return NULL;
+	}
+	o->len = length;
+	o->trimmed = trimmed;
+	o->root = NIL;
+	o->seed = 2463534242u;
+	return &o->filter;
+}
+
+struct filter *ostat_median_create(int length)
+{
+	return ostat_create(length, 0);
+}
+
+struct filter *ostat_trimmed_create(int length)
+{
+	return ostat_create(length, 1);
+}
@@ -0,0 +1,29 @@
+/**
+ * @file ostat.h
+ * @brief Implements order statistic filters.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_OSTAT_H
+#define HAVE_OSTAT_H
+
+#include "filter.h"
+
+struct filter *ostat_median_create(int length);
+
+struct filter *ostat_trimmed_create(int length);
+
+#endif
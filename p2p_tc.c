@@ -53,12 +53,12 @@ void p2p_dispatch(struct port *p, enum fsm_event event, int mdiff)
 		return;
 	}
 
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(p, FD_ANNOUNCE_TIMER);
+	port_clr_tmo(p, FD_SYNC_RX_TIMER);
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(p, FD_QUALIFICATION_TIMER);
+	port_clr_tmo(p, FD_MANNO_TIMER);
+	port_clr_tmo(p, FD_SYNC_TX_TIMER);
 
 	/*
 	 * Handle the side effects of the state transition.
@@ -90,61 +90,12 @@ void p2p_dispatch(struct port *p, enum fsm_event event, int mdiff)
 	};
 }
 
-enum fsm_event p2p_event(struct port *p, int fd_index)
+static enum fsm_event p2p_rx(struct port *p, struct ptp_message *msg, int cnt)
 {
-	int cnt, fd = p->fda.fd[fd_index];
 	enum fsm_event event = EV_NONE;
-	struct ptp_message *msg, *dup;
-
-	switch (fd_index) {
-	case FD_ANNOUNCE_TIMER:
-	case FD_SYNC_RX_TIMER:
-		pr_debug("port %hu: %s timeout", portnum(p),
-			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
-		if (p->best) {
-			fc_clear(p->best);
-		}
-		port_set_announce_tmo(p);
-		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
-
-	case FD_DELAY_TIMER:
-		pr_debug("port %hu: delay timeout", portnum(p));
-		port_set_delay_tmo(p);
-		tc_prune(p);
-		return p2p_delay_request(p) ? EV_FAULT_DETECTED : EV_NONE;
-
-	case FD_QUALIFICATION_TIMER:
-		pr_debug("port %hu: qualification timeout", portnum(p));
-		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
-
-	case FD_MANNO_TIMER:
-	case FD_SYNC_TX_TIMER:
-	case FD_UNICAST_REQ_TIMER:
-	case FD_UNICAST_SRV_TIMER:
-		pr_err("unexpected timer expiration");
-		return EV_NONE;
-
-	case FD_RTNL:
-		pr_debug("port %hu: received link status notification", portnum(p));
-		rtnl_link_status(fd, p->name, port_link_status, p);
-		if (p->link_status == (LINK_UP|LINK_STATE_CHANGED)) {
-			return EV_FAULT_CLEARED;
-		} else if ((p->link_status == (LINK_DOWN|LINK_STATE_CHANGED)) ||
-			   (p->link_status & TS_LABEL_CHANGED)) {
-			return EV_FAULT_DETECTED;
-		} else {
-			return EV_NONE;
-		}
-	}
+	struct ptp_message *dup;
 
-	msg = msg_allocate();
-	if (!msg) {
-		return EV_FAULT_DETECTED;
-	}
-	msg->hwts.type = p->timestamping;
-
-	cnt = transport_recv(p->trp, fd, msg);
-	if (cnt <= 0) {
+	if (!cnt) {
 		pr_err("port %hu: recv message failed", portnum(p));
 		msg_put(msg);
 		return EV_FAULT_DETECTED;
@@ -215,8 +166,16 @@ enum fsm_event p2p_event(struct port *p, int fd_index)
 			event = EV_STATE_DECISION_EVENT;
 		}
 		break;
-	case SIGNALING:
 	case MANAGEMENT:
+		/* Answer local queries, e.g. for the TC statistics. */
+		if (portnum(p) == 0) {
+			if (dup && clock_manage(p->clock, p, dup)) {
+				event = EV_STATE_DECISION_EVENT;
+			}
+			break;
+		}
+		/* fall through */
+	case SIGNALING:
 		if (tc_forward(p, msg)) {
 			event = EV_FAULT_DETECTED;
 		}
@@ -229,3 +188,54 @@ enum fsm_event p2p_event(struct port *p, int fd_index)
 	}
 	return event;
 }
+
+enum fsm_event p2p_event(struct port *p, int fd_index)
+{
+	int fd = p->fda.fd[fd_index];
+
+	switch (fd_index) {
+	case FD_ANNOUNCE_TIMER:
+	case FD_SYNC_RX_TIMER:
+		pr_debug("port %hu: %s timeout", portnum(p),
+			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
+		if (p->best) {
+			fc_clear(p->best);
+		}
+		port_set_announce_tmo(p);
+		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
+
+	case FD_DELAY_TIMER:
+		pr_debug("port %hu: delay timeout", portnum(p));
+		port_set_delay_tmo(p);
+		tc_prune(p);
+		return p2p_delay_request(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_QUALIFICATION_TIMER:
+		pr_debug("port %hu: qualification timeout", portnum(p));
+		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
+
+	case FD_MANNO_TIMER:
+	case FD_SYNC_TX_TIMER:
+	case FD_UNICAST_REQ_TIMER:
+	case FD_UNICAST_SRV_TIMER:
+		pr_err("unexpected timer expiration");
+		return EV_NONE;
+
+	case FD_TXTS_TIMER:
+		return port_tx_timeout(p);
+
+	case FD_RTNL:
+		pr_debug("port %hu: received link status notification", portnum(p));
+		rtnl_link_status(fd, p->name, port_link_status, p);
+		if (p->link_status == (LINK_UP|LINK_STATE_CHANGED)) {
+			return EV_FAULT_CLEARED;
+		} else if ((p->link_status == (LINK_DOWN|LINK_STATE_CHANGED)) ||
+			   (p->link_status & TS_LABEL_CHANGED)) {
+			return EV_FAULT_DETECTED;
+		} else {
+			return EV_NONE;
+		}
+	}
+
+	return port_recv(p, fd_index, p2p_rx);
+}
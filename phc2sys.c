@@ -22,15 +22,22 @@
 #include <float.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <math.h>
 #include <net/if.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -64,6 +71,23 @@
 
 #define PHC_PPS_OFFSET_LIMIT 10000000
 
+#define BATCH_MAX 64
+
+#define WORKER_QUEUE_SIZE 4
+#define WORKER_LEAD_NS 200000
+#define WORKER_TIMEOUT_MS 1000
+
+#define PRECISE_WARMUP_READINGS 2
+#define CALIBRATION_WEIGHT 16
+
+struct worker;
+
+/* The asymmetry of reading a clock pair on one CPU. */
+struct phc_calibration {
+	double asymmetry;
+	unsigned int count;
+};
+
 struct clock {
 	LIST_ENTRY(clock) list;
 	LIST_ENTRY(clock) dst_list;
@@ -85,6 +109,11 @@ struct clock {
 	struct stats *freq_stats;
 	struct stats *delay_stats;
 	struct clockcheck *sanity_check;
+	struct worker *worker;
+	struct phc_calibration *calibration;
+	int n_calibration;
+	clockid_t calibration_src;
+	double ref_uncertainty;
 };
 
 struct port {
@@ -99,15 +128,22 @@ struct phc2sys_private {
 	int sanity_freq_limit;
 	enum servo_type servo_type;
 	int phc_readings;
+	int precise_readings;
 	double phc_interval;
 	int forced_sync_offset;
 	int kernel_leap;
 	int state_changed;
+	int utc_pending;
 	struct pmc_agent *agent;
 	LIST_HEAD(port_head, port) ports;
 	LIST_HEAD(clock_head, clock) clocks;
 	LIST_HEAD(dst_clock_head, clock) dst_clocks;
 	struct clock *master;
+	int *cpus;
+	int n_cpus;
+	int n_workers;
+	int worker_efd;
+	unsigned int cycle;
 };
 
 static struct config *phc2sys_config;
@@ -118,6 +154,8 @@ static int clock_handle_leap(struct phc2sys_private *priv,
 
 static int normalize_state(int state);
 
+static void worker_destroy(struct worker *w);
+
 static struct servo *servo_add(struct phc2sys_private *priv,
 			       struct clock *clock)
 {
@@ -229,6 +267,10 @@ static void clock_cleanup(struct phc2sys_private *priv)
 		if (c->offset_stats) {
 			stats_destroy(c->offset_stats);
 		}
+		if (c->worker) {
+			worker_destroy(c->worker);
+		}
+		free(c->calibration);
 		if (c->device) {
 			free(c->device);
 		}
@@ -501,6 +543,418 @@ static int read_phc(clockid_t clkid, clockid_t sysclk, int readings,
 	return 1;
 }
 
+enum measure_method {
+	MEASURE_PHC,
+	MEASURE_SYSOFF,
+	MEASURE_SYSOFF_REVERSED,
+};
+
+struct measurement {
+	struct clock *clock;
+	unsigned int cycle;
+	enum measure_method method;
+	clockid_t src;
+	clockid_t dst;
+	int sysoff_method;
+	int readings;
+	int precise;
+	struct timespec trigger;
+	/* Filled in by the measurement. */
+	int status;
+	int64_t offset;
+	uint64_t ts;
+	int64_t delay;
+	double uncertainty;
+};
+
+/*
+ * Selects how to measure the offset of a destination clock. Returns
+ * non-zero if the clock is not to be synchronized.
+ */
+static int measure_setup(struct phc2sys_private *priv, struct clock *clock,
+			 struct measurement *m)
+{
+	/* don't try to synchronize the clock to itself */
+	if (clock->clkid == priv->master->clkid ||
+	    (clock->phc_index >= 0 &&
+	     clock->phc_index == priv->master->phc_index) ||
+	    !strcmp(clock->device, priv->master->device))
+		return -1;
+
+	m->clock = clock;
+	m->cycle = priv->cycle;
+	m->readings = priv->phc_readings;
+	m->precise = priv->precise_readings;
+	m->uncertainty = 0.0;
+
+	if (clock->clkid == CLOCK_REALTIME &&
+	    priv->master->sysoff_method >= 0) {
+		/* use sysoff */
+		m->method = MEASURE_SYSOFF;
+		m->src = priv->master->clkid;
+		m->sysoff_method = priv->master->sysoff_method;
+	} else if (priv->master->clkid == CLOCK_REALTIME &&
+		   clock->sysoff_method >= 0) {
+		/* use reversed sysoff */
+		m->method = MEASURE_SYSOFF_REVERSED;
+		m->src = clock->clkid;
+		m->sysoff_method = clock->sysoff_method;
+	} else {
+		/* use phc */
+		m->method = MEASURE_PHC;
+		m->src = priv->master->clkid;
+		m->dst = clock->clkid;
+	}
+	return 0;
+}
+
+static int64_t timespec_ns(struct timespec *ts)
+{
+	return ts->tv_sec * NS_PER_SEC + ts->tv_nsec;
+}
+
+/*
+ * Reads the destination clock before and after the source clock, and a
+ * few times the other way around. The difference between the two
+ * estimates is twice the asymmetry of the readings, which depends on
+ * the CPU. It is averaged per CPU and used to correct the result.
+ */
+static int read_phc_precise(struct measurement *m, int cpu)
+{
+	struct sysoff_reading fwd[SYSOFF_MAX_READINGS], rev[SYSOFF_MAX_READINGS];
+	struct timespec t1, t2, tp;
+	struct phc_calibration *cal;
+	int64_t rev_offset, rev_delay;
+	int i, n, n_rev;
+	double rev_unc;
+	uint64_t rev_ts;
+
+	n = m->readings < SYSOFF_MAX_READINGS ?
+		m->readings : SYSOFF_MAX_READINGS;
+	n_rev = n / 4 ? n / 4 : 1;
+
+	for (i = -PRECISE_WARMUP_READINGS; i < n; i++) {
+		if (clock_gettime(m->dst, &t1) ||
+		    clock_gettime(m->src, &tp) ||
+		    clock_gettime(m->dst, &t2)) {
+			pr_err("failed to read clock: %m");
+			return 0;
+		}
+		if (i < 0)
+			continue;
+		fwd[i].before = timespec_ns(&t1);
+		fwd[i].clock = timespec_ns(&tp);
+		fwd[i].after = timespec_ns(&t2);
+	}
+	for (i = 0; i < n_rev; i++) {
+		if (clock_gettime(m->src, &t1) ||
+		    clock_gettime(m->dst, &tp) ||
+		    clock_gettime(m->src, &t2)) {
+			pr_err("failed to read clock: %m");
+			return 0;
+		}
+		rev[i].before = timespec_ns(&t1);
+		rev[i].clock = timespec_ns(&tp);
+		rev[i].after = timespec_ns(&t2);
+	}
+	sysoff_filter(fwd, n, &m->offset, &m->ts, &m->delay, &m->uncertainty);
+	sysoff_filter(rev, n_rev, &rev_offset, &rev_ts, &rev_delay, &rev_unc);
+	rev_offset = -rev_offset;
+
+	if (m->clock->calibration_src != m->src) {
+		memset(m->clock->calibration, 0,
+		       m->clock->n_calibration * sizeof(*cal));
+		m->clock->calibration_src = m->src;
+	}
+	if (cpu < 0 || cpu >= m->clock->n_calibration)
+		return 1;
+
+	cal = &m->clock->calibration[cpu];
+	if (cal->count < CALIBRATION_WEIGHT)
+		cal->count++;
+	cal->asymmetry += ((m->offset - rev_offset) / 2.0 - cal->asymmetry) /
+		cal->count;
+
+	/* Stay within the bounds given by the readings. */
+	if (cal->asymmetry > m->uncertainty)
+		m->offset -= llround(m->uncertainty);
+	else if (cal->asymmetry < -m->uncertainty)
+		m->offset += llround(m->uncertainty);
+	else
+		m->offset -= llround(cal->asymmetry);
+	return 1;
+}
+
+/*
+ * Measures with the thread pinned to its current CPU after a few
+ * discarded readings, which bring the code, the data and the clock
+ * drivers into the caches.
+ */
+static int measure_precise(struct measurement *m)
+{
+	int cpu, err, fd, pinned = 0, r = 1;
+	cpu_set_t old, set;
+	int64_t junk_offset, junk_delay;
+	uint64_t junk_ts;
+
+	cpu = sched_getcpu();
+	if (cpu >= 0 && !sched_getaffinity(0, sizeof(old), &old) &&
+	    CPU_COUNT(&old) > 1) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pinned = !sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	if (!m->clock->calibration) {
+		m->clock->n_calibration = sysconf(_SC_NPROCESSORS_CONF);
+		if (m->clock->n_calibration > 0)
+			m->clock->calibration =
+				calloc(m->clock->n_calibration,
+				       sizeof(*m->clock->calibration));
+		if (!m->clock->calibration)
+			m->clock->n_calibration = 0;
+	}
+
+	switch (m->method) {
+	case MEASURE_SYSOFF:
+	case MEASURE_SYSOFF_REVERSED:
+		fd = CLOCKID_TO_FD(m->src);
+		sysoff_measure(fd, m->sysoff_method, 1,
+			       &junk_offset, &junk_ts, &junk_delay);
+		err = sysoff_measure_filtered(fd, m->sysoff_method,
+					      m->readings, &m->offset, &m->ts,
+					      &m->delay, &m->uncertainty);
+		if (err < 0) {
+			r = -1;
+			break;
+		}
+		if (m->method == MEASURE_SYSOFF_REVERSED) {
+			m->offset = -m->offset;
+			m->ts += m->offset;
+		}
+		break;
+	case MEASURE_PHC:
+		r = read_phc_precise(m, cpu);
+		break;
+	}
+
+	if (pinned)
+		sched_setaffinity(0, sizeof(old), &old);
+	return r;
+}
+
+/*
+ * Measures the offset. Returns 1 on success, zero if the sample is to
+ * be skipped, and -1 on a fatal error.
+ */
+static int measure(struct measurement *m)
+{
+	if (m->precise)
+		return measure_precise(m);
+
+	switch (m->method) {
+	case MEASURE_SYSOFF:
+		if (sysoff_measure(CLOCKID_TO_FD(m->src), m->sysoff_method,
+				   m->readings, &m->offset, &m->ts,
+				   &m->delay) < 0)
+			return -1;
+		return 1;
+	case MEASURE_SYSOFF_REVERSED:
+		if (sysoff_measure(CLOCKID_TO_FD(m->src), m->sysoff_method,
+				   m->readings, &m->offset, &m->ts,
+				   &m->delay) < 0)
+			return -1;
+		m->offset = -m->offset;
+		m->ts += m->offset;
+		return 1;
+	case MEASURE_PHC:
+		return read_phc(m->src, m->dst, m->readings,
+				&m->offset, &m->ts, &m->delay);
+	}
+	return -1;
+}
+
+/*
+ * A measurement worker owns one destination clock and runs pinned to
+ * its own CPU. The main thread passes the requests and the worker
+ * passes the results back through a pair of single producer, single
+ * consumer queues. All workers of a cycle wait for the same trigger
+ * instant, so the clocks are sampled at the same time.
+ */
+struct worker_queue {
+	unsigned int head;	/* written only by the producer */
+	unsigned int tail __attribute__((aligned(64)));	/* by the consumer */
+	struct measurement slot[WORKER_QUEUE_SIZE];
+};
+
+struct worker {
+	struct worker_queue request;
+	struct worker_queue result;
+	pthread_t thread;
+	int efd;
+	int done_efd;
+	int stop;
+	/* Used only by the main thread */
+	int busy;
+	int done;
+	struct measurement last;
+};
+
+static int worker_queue_push(struct worker_queue *q, struct measurement *m)
+{
+	unsigned int head = q->head;
+
+	if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) ==
+	    WORKER_QUEUE_SIZE)
+		return -1;
+	q->slot[head % WORKER_QUEUE_SIZE] = *m;
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int worker_queue_pop(struct worker_queue *q, struct measurement *m)
+{
+	unsigned int tail = q->tail;
+
+	if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail)
+		return -1;
+	*m = q->slot[tail % WORKER_QUEUE_SIZE];
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct measurement m;
+	uint64_t count;
+
+	while (!__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+		while (!worker_queue_pop(&w->request, &m)) {
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&m.trigger, NULL);
+			m.status = measure(&m);
+			/* At most one request is outstanding. */
+			worker_queue_push(&w->result, &m);
+			eventfd_write(w->done_efd, 1);
+		}
+		if (read(w->efd, &count, sizeof(count)) < 0 && errno != EINTR) {
+			pr_err("measurement worker failed: %m");
+			break;
+		}
+	}
+	return NULL;
+}
+
+static struct worker *worker_create(int done_efd, int cpu)
+{
+	sigset_t all, old;
+	pthread_attr_t attr;
+	struct worker *w;
+	cpu_set_t set;
+	int err;
+
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		pr_err("failed to allocate memory for a worker");
+		return NULL;
+	}
+	w->done_efd = done_efd;
+	w->efd = eventfd(0, EFD_CLOEXEC);
+	if (w->efd < 0) {
+		pr_err("failed to create eventfd: %m");
+		goto no_efd;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_attr_init(&attr);
+	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+
+	/* Leave the signals to the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&w->thread, &attr, worker_run, w);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+	if (err) {
+		pr_err("failed to start a worker on CPU %d: %s",
+		       cpu, strerror(err));
+		goto no_thread;
+	}
+	return w;
+no_thread:
+	close(w->efd);
+no_efd:
+	free(w);
+	return NULL;
+}
+
+static void worker_destroy(struct worker *w)
+{
+	__atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+	eventfd_write(w->efd, 1);
+	pthread_join(w->thread, NULL);
+	close(w->efd);
+	free(w);
+}
+
+static int worker_post(struct phc2sys_private *priv, struct clock *clock,
+		       struct measurement *m)
+{
+	if (!clock->worker) {
+		clock->worker = worker_create(priv->worker_efd,
+			priv->cpus[priv->n_workers % priv->n_cpus]);
+		if (!clock->worker)
+			return -1;
+		priv->n_workers++;
+	}
+	/* Still busy with a measurement which timed out earlier. */
+	if (clock->worker->busy)
+		return 0;
+
+	if (worker_queue_push(&clock->worker->request, m))
+		return 0;
+	clock->worker->busy = 1;
+	eventfd_write(clock->worker->efd, 1);
+	return 1;
+}
+
+static int parse_cpu_list(const char *str, int **cpus)
+{
+	int first, last, n = 0, *list = NULL, *tmp;
+	char *end;
+
+	while (*str) {
+		first = last = strtol(str, &end, 10);
+		if (end == str)
+			goto bad;
+		if (*end == '-') {
+			str = end + 1;
+			last = strtol(str, &end, 10);
+			if (end == str)
+				goto bad;
+		}
+		if (first < 0 || last < first || last >= CPU_SETSIZE)
+			goto bad;
+		tmp = realloc(list, (n + last - first + 1) * sizeof(*list));
+		if (!tmp)
+			goto bad;
+		list = tmp;
+		while (first <= last)
+			list[n++] = first++;
+		str = end;
+		if (*str == ',')
+			str++;
+		else if (*str)
+			goto bad;
+	}
+	*cpus = list;
+	return n;
+bad:
+	free(list);
+	return -1;
+}
+
 static int64_t get_sync_offset(struct phc2sys_private *priv, struct clock *dst)
 {
 	int direction = priv->forced_sync_offset;
@@ -528,19 +982,22 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 
 	if (!stats_get_result(clock->delay_stats, &delay_stats)) {
 		pr_info("%s "
-			"rms %4.0f max %4.0f "
+			"rms %4.0f max %4.0f p99 %4.0f p99.9 %4.0f "
 			"freq %+6.0f +/- %3.0f "
-			"delay %5.0f +/- %3.0f",
+			"delay %5.0f +/- %3.0f p99 %5.0f",
 			clock->device,
 			offset_stats.rms, offset_stats.max_abs,
+			offset_stats.p99, offset_stats.p999,
 			freq_stats.mean, freq_stats.stddev,
-			delay_stats.mean, delay_stats.stddev);
+			delay_stats.mean, delay_stats.stddev,
+			delay_stats.p99);
 	} else {
 		pr_info("%s "
-			"rms %4.0f max %4.0f "
+			"rms %4.0f max %4.0f p99 %4.0f p99.9 %4.0f "
 			"freq %+6.0f +/- %3.0f",
 			clock->device,
 			offset_stats.rms, offset_stats.max_abs,
+			offset_stats.p99, offset_stats.p999,
 			freq_stats.mean, freq_stats.stddev);
 	}
 
@@ -549,27 +1006,34 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 	stats_reset(clock->delay_stats);
 }
 
-static void update_clock(struct phc2sys_private *priv, struct clock *clock,
-			 int64_t offset, uint64_t ts, int64_t delay)
+/*
+ * Prepares a measured offset for the servo. Returns zero if the
+ * sample is to be passed to the servo, non-zero otherwise.
+ */
+static int prepare_clock(struct phc2sys_private *priv, struct clock *clock,
+			 int64_t *offset, uint64_t ts)
 {
-	enum servo_state state;
-	double ppb;
-
 	if (!clock->servo) {
 		clock->servo = servo_add(priv, clock);
 		if (!clock->servo)
-			return;
+			return -1;
 	}
 
-	if (clock_handle_leap(priv, clock, offset, ts))
-		return;
+	if (clock_handle_leap(priv, clock, *offset, ts))
+		return -1;
 
-	offset += get_sync_offset(priv, clock);
+	*offset += get_sync_offset(priv, clock);
 
 	if (clock->sanity_check && clockcheck_sample(clock->sanity_check, ts))
 		servo_reset(clock->servo);
 
-	ppb = servo_sample(clock->servo, offset, ts, 1.0, &state);
+	return 0;
+}
+
+static void adjust_clock(struct phc2sys_private *priv, struct clock *clock,
+			 int64_t offset, int64_t delay, double ppb,
+			 enum servo_state state)
+{
 	clock->servo_state = state;
 
 	switch (state) {
@@ -606,6 +1070,90 @@ static void update_clock(struct phc2sys_private *priv, struct clock *clock,
 	}
 }
 
+static void update_clock(struct phc2sys_private *priv, struct clock *clock,
+			 int64_t offset, uint64_t ts, int64_t delay)
+{
+	enum servo_state state;
+	double ppb;
+
+	if (prepare_clock(priv, clock, &offset, ts))
+		return;
+
+	ppb = servo_sample(clock->servo, offset, ts, 1.0, &state);
+
+	adjust_clock(priv, clock, offset, delay, ppb, state);
+}
+
+/*
+ * The samples of all destination clocks are collected first and then
+ * passed through the servos in one pass, after which the clocks are
+ * adjusted. This keeps the measurements of the clocks close together
+ * in time, as the adjustments and the logging happen after all of them.
+ */
+struct batch {
+	int n;
+	struct clock *clock[BATCH_MAX];
+	struct servo *servo[BATCH_MAX];
+	int64_t offset[BATCH_MAX];
+	uint64_t ts[BATCH_MAX];
+	int64_t delay[BATCH_MAX];
+	double weight[BATCH_MAX];
+	double ppb[BATCH_MAX];
+	enum servo_state state[BATCH_MAX];
+};
+
+static void batch_flush(struct phc2sys_private *priv, struct batch *b)
+{
+	int i;
+
+	servo_sample_batch(b->servo, b->n, b->offset, b->ts, b->weight,
+			   b->ppb, b->state);
+	for (i = 0; i < b->n; i++) {
+		adjust_clock(priv, b->clock[i], b->offset[i], b->delay[i],
+			     b->ppb[i], b->state[i]);
+	}
+	b->n = 0;
+}
+
+/*
+ * Weighs a sample by its uncertainty relative to a reference, which
+ * follows the typical uncertainty of the clock but drops immediately
+ * to a new minimum.
+ */
+static double measurement_weight(struct clock *clock, struct measurement *m)
+{
+	if (!m->precise || m->uncertainty <= 0.0)
+		return 1.0;
+
+	if (clock->ref_uncertainty <= 0.0 ||
+	    m->uncertainty < clock->ref_uncertainty) {
+		clock->ref_uncertainty = m->uncertainty;
+		return 1.0;
+	}
+	clock->ref_uncertainty += (m->uncertainty - clock->ref_uncertainty) /
+		CALIBRATION_WEIGHT;
+	return clock->ref_uncertainty / m->uncertainty;
+}
+
+static void batch_add(struct phc2sys_private *priv, struct batch *b,
+		      struct measurement *m)
+{
+	struct clock *clock = m->clock;
+	int64_t offset = m->offset;
+
+	if (prepare_clock(priv, clock, &offset, m->ts))
+		return;
+
+	b->clock[b->n] = clock;
+	b->servo[b->n] = clock->servo;
+	b->offset[b->n] = offset;
+	b->ts[b->n] = m->ts;
+	b->delay[b->n] = m->delay;
+	b->weight[b->n] = measurement_weight(clock, m);
+	if (++b->n == BATCH_MAX)
+		batch_flush(priv, b);
+}
+
 static void enable_pps_output(clockid_t src)
 {
 	int enable = 1;
@@ -696,74 +1244,243 @@ static int update_needed(struct clock *c)
 	return 0;
 }
 
-static int do_loop(struct phc2sys_private *priv)
+/*
+ * Picks up the results which are ready, and returns how many of them
+ * belong to the current cycle. The late results of an earlier cycle
+ * only free their workers.
+ */
+static int poll_workers(struct phc2sys_private *priv)
 {
-	struct timespec interval;
 	struct clock *clock;
-	uint64_t ts;
-	int64_t offset, delay;
+	struct worker *w;
+	int n = 0;
 
-	interval.tv_sec = priv->phc_interval;
-	interval.tv_nsec = (priv->phc_interval - interval.tv_sec) * 1e9;
+	LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
+		w = clock->worker;
+		if (!w || !w->busy || worker_queue_pop(&w->result, &w->last))
+			continue;
+		w->busy = 0;
+		if (w->last.cycle == priv->cycle) {
+			w->done = 1;
+			n++;
+		}
+	}
+	return n;
+}
 
-	while (is_running()) {
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+/*
+ * Waits for the workers posted in this cycle and passes their results
+ * to the servos in the order of the destination clocks. The eventfd
+ * only wakes us up, as its count may include the results which arrived
+ * after the timeout of an earlier cycle.
+ */
+static int collect_workers(struct phc2sys_private *priv, struct batch *b,
+			   int posted)
+{
+	struct pollfd pfd = { .fd = priv->worker_efd, .events = POLLIN };
+	struct clock *clock;
+	struct worker *w;
+	uint64_t count;
+	int cnt, err = 0;
+
+	while (posted > 0) {
+		cnt = poll(&pfd, 1, WORKER_TIMEOUT_MS);
+		if (cnt < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("poll failed: %m");
+			return -1;
+		}
+		if (!cnt) {
+			pr_warning("timed out waiting for measurements");
+			break;
+		}
+		if (eventfd_read(priv->worker_efd, &count))
+			continue;
+		posted -= poll_workers(priv);
+	}
+	LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
+		w = clock->worker;
+		if (!w || !w->done)
+			continue;
+		w->done = 0;
+		if (w->last.status < 0)
+			err = -1;
+		else if (w->last.status && !err)
+			batch_add(priv, b, &w->last);
+	}
+	return err;
+}
+
+static int sample_clocks(struct phc2sys_private *priv)
+{
+	struct timespec now;
+	struct measurement m;
+	struct batch batch;
+	struct clock *clock;
+	int posted = 0, r;
 
-		if (pmc_agent_update(priv->agent) < 0) {
+	batch.n = 0;
+	priv->cycle++;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	m.trigger.tv_sec = now.tv_sec;
+	m.trigger.tv_nsec = now.tv_nsec + WORKER_LEAD_NS;
+	if (m.trigger.tv_nsec >= NS_PER_SEC) {
+		m.trigger.tv_sec++;
+		m.trigger.tv_nsec -= NS_PER_SEC;
+	}
+
+	LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
+		if (!update_needed(clock))
+			continue;
+		if (measure_setup(priv, clock, &m))
+			continue;
+
+		if (priv->n_cpus) {
+			r = worker_post(priv, clock, &m);
+			if (r < 0)
+				return -1;
+			posted += r;
 			continue;
 		}
-		if (priv->state_changed) {
-			/* force getting offset, as it may have
-			 * changed after the port state change */
-			if (pmc_agent_query_utc_offset(priv->agent, 1000)) {
-				pr_err("failed to get UTC offset");
-				continue;
-			}
+		r = measure(&m);
+		if (r < 0)
+			return -1;
+		if (r)
+			batch_add(priv, &batch, &m);
+	}
+	if (priv->n_cpus && collect_workers(priv, &batch, posted))
+		return -1;
+	batch_flush(priv, &batch);
+	return 0;
+}
+
+/*
+ * Handles the result of processing the messages from ptp4l. After a
+ * port state change the clocks are reconfigured once the UTC offset,
+ * which may have changed too, has arrived.
+ */
+static void handle_agent_update(struct phc2sys_private *priv, int updated)
+{
+	if (updated > 0 && priv->utc_pending) {
+		priv->utc_pending = 0;
+		if (priv->state_changed)
 			reconfigure(priv);
+	}
+	if (priv->state_changed && !priv->utc_pending) {
+		updated = pmc_agent_request_utc_offset(priv->agent);
+		if (updated < 0)
+			pr_err("failed to request UTC offset");
+		else if (updated > 0)
+			reconfigure(priv);
+		else
+			priv->utc_pending = 1;
+	}
+}
+
+static int do_loop(struct phc2sys_private *priv)
+{
+	struct epoll_event ev, events[2];
+	struct itimerspec tmo;
+	int agent_fd, cnt, ep, i, pending, r = -1, tfd, updated;
+	uint64_t expirations;
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd < 0) {
+		pr_err("timerfd_create failed: %m");
+		return -1;
+	}
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) {
+		pr_err("epoll_create1 failed: %m");
+		goto no_epoll;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = tfd;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev)) {
+		pr_err("epoll_ctl failed: %m");
+		goto out;
+	}
+	agent_fd = pmc_agent_fd(priv->agent);
+	if (agent_fd >= 0) {
+		ev.data.fd = agent_fd;
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, agent_fd, &ev)) {
+			pr_err("epoll_ctl failed: %m");
+			goto out;
 		}
-		if (!priv->master)
-			continue;
+	}
 
-		LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
-			if (!update_needed(clock))
-				continue;
+	/*
+	 * The samples are taken at absolute deadlines, so that the time
+	 * spent in the loop does not make the interval drift.
+	 */
+	memset(&tmo, 0, sizeof(tmo));
+	tmo.it_interval.tv_sec = priv->phc_interval;
+	tmo.it_interval.tv_nsec =
+		(priv->phc_interval - tmo.it_interval.tv_sec) * 1e9;
+	clock_gettime(CLOCK_MONOTONIC, &tmo.it_value);
+	tmo.it_value.tv_sec += tmo.it_interval.tv_sec;
+	tmo.it_value.tv_nsec += tmo.it_interval.tv_nsec;
+	if (tmo.it_value.tv_nsec >= NS_PER_SEC) {
+		tmo.it_value.tv_sec++;
+		tmo.it_value.tv_nsec -= NS_PER_SEC;
+	}
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &tmo, NULL)) {
+		pr_err("timerfd_settime failed: %m");
+		goto out;
+	}
 
-			/* don't try to synchronize the clock to itself */
-			if (clock->clkid == priv->master->clkid ||
-			    (clock->phc_index >= 0 &&
-			     clock->phc_index == priv->master->phc_index) ||
-			    !strcmp(clock->device, priv->master->device))
+	handle_agent_update(priv, 0);
+	r = 0;
+
+	while (is_running()) {
+		cnt = epoll_wait(ep, events, 2, -1);
+		if (cnt < 0) {
+			if (errno == EINTR)
 				continue;
+			pr_err("epoll_wait failed: %m");
+			r = -1;
+			break;
+		}
+		for (i = 0; i < cnt; i++) {
+			if (events[i].data.fd == agent_fd) {
+				handle_agent_update(priv,
+					pmc_agent_process(priv->agent));
+				continue;
+			}
+			if (read(tfd, &expirations, sizeof(expirations)) < 0)
+				continue;
+			if (expirations > 1)
+				pr_debug("missed %" PRIu64 " sampling deadlines",
+					 expirations - 1);
 
-			if (clock->clkid == CLOCK_REALTIME &&
-			    priv->master->sysoff_method >= 0) {
-				/* use sysoff */
-				if (sysoff_measure(CLOCKID_TO_FD(priv->master->clkid),
-						   priv->master->sysoff_method,
-						   priv->phc_readings,
-						   &offset, &ts, &delay) < 0)
-					return -1;
-			} else if (priv->master->clkid == CLOCK_REALTIME &&
-				   clock->sysoff_method >= 0) {
-				/* use reversed sysoff */
-				if (sysoff_measure(CLOCKID_TO_FD(clock->clkid),
-						   clock->sysoff_method,
-						   priv->phc_readings,
-						   &offset, &ts, &delay) < 0)
-					return -1;
-				offset = -offset;
-				ts += offset;
-			} else {
-				/* use phc */
-				if (!read_phc(priv->master->clkid, clock->clkid,
-					      priv->phc_readings,
-					      &offset, &ts, &delay))
-					continue;
+			updated = pmc_agent_update(priv->agent);
+			if (updated < 0)
+				continue;
+			pending = priv->utc_pending;
+			handle_agent_update(priv, updated);
+			if (priv->utc_pending && pending) {
+				/* Ask again, the response may have been lost. */
+				updated = pmc_agent_request_utc_offset(priv->agent);
+				handle_agent_update(priv, updated);
+			}
+			if (priv->utc_pending)
+				continue;
+			if (!priv->master)
+				continue;
+			if (sample_clocks(priv)) {
+				r = -1;
+				goto out;
 			}
-			update_clock(priv, clock, offset, ts, delay);
 		}
 	}
-	return 0;
+out:
+	close(ep);
+no_epoll:
+	close(tfd);
+	return r;
 }
 
 static int normalize_state(int state)
@@ -1057,6 +1774,7 @@ static void usage(char *progname)
 int main(int argc, char *argv[])
 {
 	char *config = NULL, *dst_name = NULL, *progname, *src_name = NULL;
+	char *cpus;
 	char uds_local[MAX_IFNAME_SIZE + 1];
 	int autocfg = 0, c, domain_number = 0, index, ntpshm_segment, offset;
 	int pps_fd = -1, print_level = LOG_INFO, r = -1, rt = 0;
@@ -1067,6 +1785,7 @@ int main(int argc, char *argv[])
 	struct phc2sys_private priv = {
 		.phc_readings = 5,
 		.phc_interval = 1.0,
+		.worker_efd = -1,
 	};
 
 	handle_term_signals();
@@ -1291,6 +2010,10 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (config_get_int(cfg, NULL, "logging_async") && print_set_async(1)) {
+		fprintf(stderr, "failed to start the logging thread\n");
+		goto end;
+	}
 
 	priv.servo_type = config_get_int(cfg, NULL, "clock_servo");
 	if (priv.servo_type == CLOCK_SERVO_NTPSHM) {
@@ -1299,6 +2022,23 @@ int main(int argc, char *argv[])
 	}
 	priv.kernel_leap = config_get_int(cfg, NULL, "kernel_leap");
 	priv.sanity_freq_limit = config_get_int(cfg, NULL, "sanity_freq_limit");
+	priv.precise_readings = config_get_int(cfg, NULL, "precise_readings");
+
+	cpus = config_get_string(cfg, NULL, "measurement_cpus");
+	if (cpus) {
+		priv.n_cpus = parse_cpu_list(cpus, &priv.cpus);
+		if (priv.n_cpus < 0) {
+			fprintf(stderr, "invalid CPU list '%s'\n", cpus);
+			goto end;
+		}
+	}
+	if (priv.n_cpus) {
+		priv.worker_efd = eventfd(0, EFD_CLOEXEC);
+		if (priv.worker_efd < 0) {
+			pr_err("failed to create eventfd: %m");
+			goto end;
+		}
+	}
 
 	snprintf(uds_local, sizeof(uds_local), "/var/run/phc2sys.%d",
 		 getpid());
@@ -1366,6 +2106,9 @@ end:
 	pmc_agent_destroy(priv.agent);
 	clock_cleanup(&priv);
 	port_cleanup(&priv);
+	if (priv.worker_efd >= 0)
+		close(priv.worker_efd);
+	free(priv.cpus);
 	config_destroy(cfg);
 	msg_cleanup();
 	return r;
@@ -154,6 +154,80 @@ static double pi_sample(struct servo *servo,
 	return ppb;
 }
 
+/*
+ * Locked servos whose offset is within the step threshold take the
+ * same path in pi_sample(). They are gathered SERVO_VEC_LEN at a time
+ * and updated together, while the others go through pi_sample().
+ */
+static void pi_lanes_run(struct pi_servo **s, const int *index,
+			 const int64_t *offset, const double *weight,
+			 double *freq, enum servo_state *state)
+{
+	servo_vec x, w, kp, ki, drift, max, ki_term, ppb, zero = { 0 };
+	servo_mask low, high;
+	int i;
+
+	for (i = 0; i < SERVO_VEC_LEN; i++) {
+		x[i] = offset[index[i]];
+		w[i] = weight[index[i]];
+		kp[i] = s[i]->kp;
+		ki[i] = s[i]->ki;
+		drift[i] = s[i]->drift;
+		max[i] = s[i]->servo.max_frequency;
+	}
+
+	ki_term = ki * x * w;
+	ppb = kp * x * w + drift + ki_term;
+	low = ppb < -max;
+	high = ppb > max;
+	ppb = servo_vec_select(low, -max, ppb);
+	ppb = servo_vec_select(high, max, ppb);
+	drift += servo_vec_select(low | high, zero, ki_term);
+
+	for (i = 0; i < SERVO_VEC_LEN; i++) {
+		s[i]->drift = drift[i];
+		s[i]->last_freq = ppb[i];
+		freq[index[i]] = ppb[i];
+		state[index[i]] = SERVO_LOCKED;
+	}
+}
+
+static void pi_sample_batch(struct servo **servo, int n,
+			    const int64_t *offset, const uint64_t *local_ts,
+			    const double *weight, double *freq,
+			    enum servo_state *state)
+{
+	struct pi_servo *s[SERVO_VEC_LEN];
+	int i, index[SERVO_VEC_LEN], k = 0;
+
+	for (i = 0; i < n; i++) {
+		s[k] = container_of(servo[i], struct pi_servo, servo);
+		if (s[k]->count != 2 ||
+		    (servo[i]->step_threshold &&
+		     servo[i]->step_threshold < llabs(offset[i]))) {
+			freq[i] = pi_sample(servo[i], offset[i], local_ts[i],
+					    weight[i], &state[i]);
+			continue;
+		}
+		index[k] = i;
+		if (++k == SERVO_VEC_LEN) {
+			pi_lanes_run(s, index, offset, weight, freq, state);
+			k = 0;
+		}
+	}
+	if (k) {
+		/*
+		 * Repeat the first servo in the unused lanes. Its update is
+		 * computed several times over, but gives the same result.
+		 */
+		for (i = k; i < SERVO_VEC_LEN; i++) {
+			s[i] = s[0];
+			index[i] = index[0];
+		}
+		pi_lanes_run(s, index, offset, weight, freq, state);
+	}
+}
+
 static void pi_sync_interval(struct servo *servo, double interval)
 {
 	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
@@ -187,25 +261,27 @@ struct servo *pi_servo_create(struct config *cfg, int fadj, int sw_ts)
 
 	s->servo.destroy = pi_destroy;
 	s->servo.sample  = pi_sample;
+	s->servo.sample_batch = pi_sample_batch;
 	s->servo.sync_interval = pi_sync_interval;
 	s->servo.reset   = pi_reset;
 	s->drift         = fadj;
 	s->last_freq     = fadj;
 	s->kp            = 0.0;
 	s->ki            = 0.0;
-	s->configured_pi_kp = config_get_double(cfg, NULL, "pi_proportional_const");
-	s->configured_pi_ki = config_get_double(cfg, NULL, "pi_integral_const");
-	s->configured_pi_kp_scale = config_get_double(cfg, NULL, "pi_proportional_scale");
+	s->configured_pi_kp = config_double(cfg, 0, CFG_PI_PROPORTIONAL_CONST);
+	s->configured_pi_ki = config_double(cfg, 0, CFG_PI_INTEGRAL_CONST);
+	s->configured_pi_kp_scale =
+		config_double(cfg, 0, CFG_PI_PROPORTIONAL_SCALE);
 	s->configured_pi_kp_exponent =
-		config_get_double(cfg, NULL, "pi_proportional_exponent");
+		config_double(cfg, 0, CFG_PI_PROPORTIONAL_EXPONENT);
 	s->configured_pi_kp_norm_max =
-		config_get_double(cfg, NULL, "pi_proportional_norm_max");
+		config_double(cfg, 0, CFG_PI_PROPORTIONAL_NORM_MAX);
 	s->configured_pi_ki_scale =
-		config_get_double(cfg, NULL, "pi_integral_scale");
+		config_double(cfg, 0, CFG_PI_INTEGRAL_SCALE);
 	s->configured_pi_ki_exponent =
-		config_get_double(cfg, NULL, "pi_integral_exponent");
+		config_double(cfg, 0, CFG_PI_INTEGRAL_EXPONENT);
 	s->configured_pi_ki_norm_max =
-		config_get_double(cfg, NULL, "pi_integral_norm_max");
+		config_double(cfg, 0, CFG_PI_INTEGRAL_NORM_MAX);
 
 	if (s->configured_pi_kp && s->configured_pi_ki) {
 		/* Use the constants as configured by the user without
@@ -143,7 +143,11 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct mgmt_clock_description *cd;
 	struct subscribe_events_np *sen;
 	struct management_tlv_datum *mtd;
+	struct port_foreign_stats_np *pfsn;
+	struct port_tc_stats_np *ptsn;
 	struct port_properties_np *ppn;
+	struct msg_pool_stats_np *mps;
+	struct clock_stats_np *csn;
 	struct timePropertiesDS *tp;
 	struct management_tlv *mgt;
 	struct time_status_np *tsn;
@@ -396,6 +400,33 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 		fprintf(fp, "SYNCHRONIZATION_UNCERTAIN_NP "
 			IFMT "uncertain %hhu", mtd->val);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		mps = (struct msg_pool_stats_np *) mgt->data;
+		fprintf(fp, "MSG_POOL_STATS_NP "
+			IFMT "total       %u"
+			IFMT "in_use      %u"
+			IFMT "high_water  %u"
+			IFMT "limit       %u"
+			IFMT "failures    %u",
+			mps->total, mps->in_use, mps->high_water,
+			mps->limit, mps->failures);
+		break;
+	case TLV_CLOCK_STATS_NP:
+		csn = (struct clock_stats_np *) mgt->data;
+		fprintf(fp, "CLOCK_STATS_NP "
+			IFMT "samples     %u"
+			IFMT "offset_rms  %" PRId64
+			IFMT "offset_max  %" PRId64
+			IFMT "offset_p50  %" PRId64
+			IFMT "offset_p99  %" PRId64
+			IFMT "offset_p999 %" PRId64
+			IFMT "delay_mean  %" PRId64
+			IFMT "delay_p99   %" PRId64
+			IFMT "delay_p999  %" PRId64,
+			csn->samples, csn->offset_rms, csn->offset_max,
+			csn->offset_p50, csn->offset_p99, csn->offset_p999,
+			csn->delay_mean, csn->delay_p99, csn->delay_p999);
+		break;
 	case TLV_PORT_DATA_SET:
 		p = (struct portDS *) mgt->data;
 		if (p->portState > PS_SLAVE) {
@@ -487,6 +518,32 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 			pcp->stats.txMsgType[SIGNALING],
 			pcp->stats.txMsgType[MANAGEMENT]);
 		break;
+	case TLV_PORT_TC_STATS_NP:
+		ptsn = (struct port_tc_stats_np *) mgt->data;
+		fprintf(fp, "PORT_TC_STATS_NP "
+			IFMT "portIdentity            %s"
+			IFMT "records                 %u"
+			IFMT "in_use                  %u"
+			IFMT "high_water              %u"
+			IFMT "evicted                 %u"
+			IFMT "dropped                 %u",
+			pid2str(&ptsn->portIdentity), ptsn->records,
+			ptsn->in_use, ptsn->high_water, ptsn->evicted,
+			ptsn->dropped);
+		break;
+	case TLV_PORT_FOREIGN_STATS_NP:
+		pfsn = (struct port_foreign_stats_np *) mgt->data;
+		fprintf(fp, "PORT_FOREIGN_STATS_NP "
+			IFMT "portIdentity            %s"
+			IFMT "records                 %u"
+			IFMT "in_use                  %u"
+			IFMT "high_water              %u"
+			IFMT "evicted                 %u"
+			IFMT "dropped                 %u",
+			pid2str(&pfsn->portIdentity), pfsn->records,
+			pfsn->in_use, pfsn->high_water, pfsn->evicted,
+			pfsn->dropped);
+		break;
 	case TLV_LOG_ANNOUNCE_INTERVAL:
 		mtd = (struct management_tlv_datum *) mgt->data;
 		fprintf(fp, "LOG_ANNOUNCE_INTERVAL "
@@ -25,6 +25,7 @@
 #include "notification.h"
 #include "pmc_agent.h"
 #include "print.h"
+#include "shm_status.h"
 #include "util.h"
 
 #define PMC_UPDATE_INTERVAL (60 * NS_PER_SEC)
@@ -33,10 +34,13 @@
  * PMC_UPDATE_INTERVAL otherwise subscription will time out before it is
  * renewed.
  */
+#define PMC_STATUS_MAX_AGE (5ULL * SHM_STATUS_INTERVAL_MS * 1000000)
 
 struct pmc_agent {
 	struct pmc *pmc;
 	uint64_t pmc_last_update;
+	struct shm_status *shm;
+	const char *uds_address;
 
 	struct defaultDS dds;
 	bool dds_valid;
@@ -61,6 +65,40 @@ static void send_subscription(struct pmc_agent *node)
 	pmc_send_set_action(node->pmc, TLV_SUBSCRIBE_EVENTS_NP, &sen, sizeof(sen));
 }
 
+/*
+ * Takes a snapshot of the status region of ptp4l, opening it first if
+ * needed. Any failure means the caller falls back to the UDS port.
+ */
+static int read_status(struct pmc_agent *node, struct shm_status_data *data)
+{
+	if (!node->uds_address) {
+		return -1;
+	}
+	if (!node->shm) {
+		node->shm = shm_status_open(node->uds_address);
+		if (!node->shm) {
+			return -1;
+		}
+		pr_debug("reading ptp4l status from shared memory");
+	}
+	if (!shm_status_read(node->shm, data, PMC_STATUS_MAX_AGE)) {
+		return 0;
+	}
+	pr_debug("ptp4l status region is stale, using UDS");
+	shm_status_close(node->shm);
+	node->shm = NULL;
+	return -1;
+}
+
+static void close_status(struct pmc_agent *node)
+{
+	if (node->shm) {
+		shm_status_close(node->shm);
+		node->shm = NULL;
+	}
+	node->uds_address = NULL;
+}
+
 static int check_clock_identity(struct pmc_agent *node, struct ptp_message *msg)
 {
 	if (!node->dds_valid) {
@@ -205,10 +243,24 @@ static int renew_subscription(struct pmc_agent *node, int timeout)
 
 int run_pmc_wait_sync(struct pmc_agent *node, int timeout)
 {
+	struct shm_status_data status;
 	struct ptp_message *msg;
 	Enumeration8 portState;
 	void *data;
-	int res;
+	int i, res;
+
+	if (!read_status(node, &status)) {
+		for (i = 0; i < status.num_ports; i++) {
+			switch (status.port[i].state) {
+			case PS_MASTER:
+			case PS_SLAVE:
+				return 1;
+			}
+		}
+		/* Behave like a request which timed out. */
+		poll(NULL, 0, timeout);
+		return RUN_PMC_TMO;
+	}
 
 	while (1) {
 		res = run_pmc(node, timeout, TLV_PORT_DATA_SET, &msg);
@@ -241,6 +293,7 @@ int init_pmc_node(struct config *cfg, struct pmc_agent *node, const char *uds,
 	}
 	node->recv_subscribed = recv_subscribed;
 	node->recv_context = context;
+	node->uds_address = config_get_string(cfg, NULL, "uds_address");
 
 	return 0;
 }
@@ -253,6 +306,7 @@ struct pmc_agent *pmc_agent_create(void)
 
 void pmc_agent_destroy(struct pmc_agent *agent)
 {
+	close_status(agent);
 	if (agent->pmc) {
 		pmc_destroy(agent->pmc);
 	}
@@ -261,6 +315,7 @@ void pmc_agent_destroy(struct pmc_agent *agent)
 
 void pmc_agent_disable(struct pmc_agent *agent)
 {
+	close_status(agent);
 	if (agent->pmc) {
 		pmc_destroy(agent->pmc);
 	}
@@ -287,10 +342,16 @@ int pmc_agent_get_number_ports(struct pmc_agent *node)
 
 int pmc_agent_query_dds(struct pmc_agent *node, int timeout)
 {
+	struct shm_status_data status;
 	struct ptp_message *msg;
 	struct defaultDS *dds;
 	int res;
 
+	if (!read_status(node, &status)) {
+		node->dds = status.dds;
+		node->dds_valid = true;
+		return 0;
+	}
 	res = run_pmc(node, timeout, TLV_DEFAULT_DATA_SET, &msg);
 	if (is_run_pmc_error(res)) {
 		return run_pmc_err2errno(res);
@@ -307,8 +368,28 @@ int pmc_agent_query_port_properties(struct pmc_agent *node, int timeout,
 				    int *tstamping, char *iface)
 {
 	struct port_properties_np *ppn;
+	struct shm_status_data status;
+	struct shm_status_port *sp;
 	struct ptp_message *msg;
-	int res, len;
+	int i, res, len;
+
+	if (!read_status(node, &status)) {
+		for (i = 0; i < status.num_ports; i++) {
+			sp = &status.port[i];
+			if (sp->portIdentity.portNumber != port) {
+				continue;
+			}
+			*state = sp->state;
+			*tstamping = sp->timestamping;
+			memcpy(iface, sp->interface, IFNAMSIZ);
+			iface[IFNAMSIZ - 1] = '\0';
+			return 0;
+		}
+		/* Ports beyond the end of a full table are only on UDS. */
+		if (status.num_ports < SHM_STATUS_MAX_PORTS) {
+			return -ENODEV;
+		}
+	}
 
 	pmc_target_port(node->pmc, port);
 	while (1) {
@@ -339,18 +420,9 @@ out:
 	return run_pmc_err2errno(res);
 }
 
-int pmc_agent_query_utc_offset(struct pmc_agent *node, int timeout)
+static void update_utc_offset(struct pmc_agent *node,
+			      struct timePropertiesDS *tds)
 {
-	struct timePropertiesDS *tds;
-	struct ptp_message *msg;
-	int res;
-
-	res = run_pmc(node, timeout, TLV_TIME_PROPERTIES_DATA_SET, &msg);
-	if (is_run_pmc_error(res)) {
-		return run_pmc_err2errno(res);
-	}
-
-	tds = (struct timePropertiesDS *) management_tlv_data(msg);
 	if (tds->flags & PTP_TIMESCALE) {
 		node->sync_offset = tds->currentUtcOffset;
 		if (tds->flags & LEAP_61)
@@ -366,10 +438,85 @@ int pmc_agent_query_utc_offset(struct pmc_agent *node, int timeout)
 		node->leap = 0;
 		node->utc_offset_traceable = 0;
 	}
+}
+
+int pmc_agent_query_utc_offset(struct pmc_agent *node, int timeout)
+{
+	struct shm_status_data status;
+	struct ptp_message *msg;
+	int res;
+
+	if (!read_status(node, &status)) {
+		update_utc_offset(node, &status.tds);
+		return 0;
+	}
+	res = run_pmc(node, timeout, TLV_TIME_PROPERTIES_DATA_SET, &msg);
+	if (is_run_pmc_error(res)) {
+		return run_pmc_err2errno(res);
+	}
+	update_utc_offset(node, management_tlv_data(msg));
 	msg_put(msg);
 	return 0;
 }
 
+int pmc_agent_request_utc_offset(struct pmc_agent *node)
+{
+	struct shm_status_data status;
+
+	if (!node->pmc) {
+		return 0;
+	}
+	if (!read_status(node, &status)) {
+		update_utc_offset(node, &status.tds);
+		return 1;
+	}
+	if (pmc_send_get_action(node->pmc, TLV_TIME_PROPERTIES_DATA_SET)) {
+		return -EIO;
+	}
+	return 0;
+}
+
+int pmc_agent_fd(struct pmc_agent *node)
+{
+	return node->pmc ? pmc_get_transport_fd(node->pmc) : -1;
+}
+
+int pmc_agent_process(struct pmc_agent *node)
+{
+	struct ptp_message *msg;
+	struct pollfd pfd;
+	int cnt, updated = 0;
+
+	if (!node->pmc) {
+		return 0;
+	}
+	pfd.fd = pmc_get_transport_fd(node->pmc);
+	pfd.events = POLLIN|POLLPRI;
+
+	while (1) {
+		cnt = poll(&pfd, 1, 0);
+		if (cnt < 0) {
+			pr_err("poll failed");
+			return -errno;
+		}
+		if (!cnt) {
+			break;
+		}
+		msg = pmc_recv(node->pmc);
+		if (!msg) {
+			continue;
+		}
+		if (check_clock_identity(node, msg) && is_msg_mgt(msg) > 0 &&
+		    !node->recv_subscribed(node->recv_context, msg, -1) &&
+		    management_tlv_id(msg) == TLV_TIME_PROPERTIES_DATA_SET) {
+			update_utc_offset(node, management_tlv_data(msg));
+			updated = 1;
+		}
+		msg_put(msg);
+	}
+	return updated;
+}
+
 void pmc_agent_set_sync_offset(struct pmc_agent *agent, int offset)
 {
 	agent->sync_offset = offset;
@@ -383,7 +530,7 @@ int pmc_agent_subscribe(struct pmc_agent *node, int timeout)
 
 int pmc_agent_update(struct pmc_agent *node)
 {
-	struct ptp_message *msg;
+	int res = 0, updated = 0;
 	struct timespec tp;
 	uint64_t ts;
 
@@ -396,18 +543,28 @@ int pmc_agent_update(struct pmc_agent *node)
 	}
 	ts = tp.tv_sec * NS_PER_SEC + tp.tv_nsec;
 
+	/*
+	 * Only send the requests here. The responses are processed
+	 * as they arrive, without waiting for them. The shared memory
+	 * region is cheap enough to be read on every update.
+	 */
+	if (node->shm || ts - node->pmc_last_update >= PMC_UPDATE_INTERVAL) {
+		res = pmc_agent_request_utc_offset(node);
+		if (res > 0) {
+			updated = 1;
+		}
+	}
 	if (ts - node->pmc_last_update >= PMC_UPDATE_INTERVAL) {
 		if (node->stay_subscribed) {
-			renew_subscription(node, 0);
+			send_subscription(node);
 		}
-		if (!pmc_agent_query_utc_offset(node, 0)) {
+		if (res >= 0) {
 			node->pmc_last_update = ts;
 		}
 	}
 
-	run_pmc(node, 0, -1, &msg);
-
-	return 0;
+	res = pmc_agent_process(node);
+	return res < 0 ? res : res | updated;
 }
 
 bool pmc_agent_utc_offset_traceable(struct pmc_agent *agent)
@@ -155,11 +155,45 @@ int pmc_agent_subscribe(struct pmc_agent *agent, int timeout);
  * minute, and so the caller may safely invoke this method more often
  * than that.
  *
+ * The function never waits for a response. The responses are
+ * processed by this function or by @ref pmc_agent_process() as they
+ * arrive.
+ *
  * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
- * @return       Zero on success, negative error code otherwise.
+ * @return       One if the TAI-UTC offset was updated, zero if not,
+ *               negative error code otherwise.
  */
 int pmc_agent_update(struct pmc_agent *agent);
 
+/**
+ * Obtains the file descriptor of the connection to the local ptp4l
+ * service, for waiting on it in an event loop.
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       The descriptor, or -1 if the agent is disabled.
+ */
+int pmc_agent_fd(struct pmc_agent *agent);
+
+/**
+ * Processes all the messages pending on the connection to the local
+ * ptp4l service without blocking. Push notifications are passed to
+ * the callback, and responses to @ref pmc_agent_request_utc_offset()
+ * update the TAI-UTC offset and the leap second flags.
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       One if the TAI-UTC offset was updated, zero if not,
+ *               negative error code otherwise.
+ */
+int pmc_agent_process(struct pmc_agent *agent);
+
+/**
+ * Requests the current TAI-UTC offset and leap second flags from the
+ * local ptp4l service without waiting for the response. When ptp4l
+ * publishes its status in shared memory, the offset is updated at once.
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       One if the offset was updated, zero if the request was
+ *               sent, negative error code otherwise.
+ */
+int pmc_agent_request_utc_offset(struct pmc_agent *agent);
+
 /**
  * Tests whether the current UTC offset is traceable.
  * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
@@ -110,6 +110,8 @@ struct management_id idtab[] = {
 	{ "GRANDMASTER_SETTINGS_NP", TLV_GRANDMASTER_SETTINGS_NP, do_set_action },
 	{ "SUBSCRIBE_EVENTS_NP", TLV_SUBSCRIBE_EVENTS_NP, do_set_action },
 	{ "SYNCHRONIZATION_UNCERTAIN_NP", TLV_SYNCHRONIZATION_UNCERTAIN_NP, do_set_action },
+	{ "MSG_POOL_STATS_NP", TLV_MSG_POOL_STATS_NP, do_get_action },
+	{ "CLOCK_STATS_NP", TLV_CLOCK_STATS_NP, do_get_action },
 /* Port management ID values */
 	{ "NULL_MANAGEMENT", TLV_NULL_MANAGEMENT, null_management },
 	{ "CLOCK_DESCRIPTION", TLV_CLOCK_DESCRIPTION, do_get_action },
@@ -131,6 +133,8 @@ struct management_id idtab[] = {
 	{ "PORT_DATA_SET_NP", TLV_PORT_DATA_SET_NP, do_set_action },
 	{ "PORT_STATS_NP", TLV_PORT_STATS_NP, do_get_action },
 	{ "PORT_PROPERTIES_NP", TLV_PORT_PROPERTIES_NP, do_get_action },
+	{ "PORT_TC_STATS_NP", TLV_PORT_TC_STATS_NP, do_get_action },
+	{ "PORT_FOREIGN_STATS_NP", TLV_PORT_FOREIGN_STATS_NP, do_get_action },
 };
 
 static void do_get_action(struct pmc *pmc, int action, int index, char *str)
@@ -511,6 +515,12 @@ static int pmc_tlv_datalen(struct pmc *pmc, int id)
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		len += sizeof(struct grandmaster_settings_np);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		len += sizeof(struct msg_pool_stats_np);
+		break;
+	case TLV_CLOCK_STATS_NP:
+		len += sizeof(struct clock_stats_np);
+		break;
 	case TLV_NULL_MANAGEMENT:
 		break;
 	case TLV_CLOCK_DESCRIPTION:
@@ -19,6 +19,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <malloc.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -36,16 +37,20 @@
 #include "port_private.h"
 #include "print.h"
 #include "rtnl.h"
+#include "shm_status.h"
 #include "sk.h"
 #include "tc.h"
 #include "tlv.h"
 #include "tmv.h"
 #include "tsproc.h"
+#include "twheel.h"
 #include "unicast_client.h"
 #include "unicast_service.h"
 #include "util.h"
 
 #define ALLOWED_LOST_RESPONSES 3
+#define NS_PER_MSEC 1000000LL
+#define TX_PKT_LEN 1600
 #define ANNOUNCE_SPAN 1
 
 enum syfu_event {
@@ -58,17 +63,16 @@ enum syfu_event {
 static int port_is_ieee8021as(struct port *p);
 static void port_nrate_initialize(struct port *p);
 
-static int announce_compare(struct ptp_message *m1, struct ptp_message *m2)
+static int announce_compare(struct ptp_message *m, struct dataset *ds)
 {
-	struct announce_msg *a = &m1->announce, *b = &m2->announce;
-	int len =
-		sizeof(a->grandmasterPriority1) +
-		sizeof(a->grandmasterClockQuality) +
-		sizeof(a->grandmasterPriority2) +
-		sizeof(a->grandmasterIdentity) +
-		sizeof(a->stepsRemoved);
+	struct announce_msg *a = &m->announce;
 
-	return memcmp(&a->grandmasterPriority1, &b->grandmasterPriority1, len);
+	return a->grandmasterPriority1 != ds->priority1 ||
+		memcmp(&a->grandmasterClockQuality, &ds->quality,
+		       sizeof(ds->quality)) ||
+		a->grandmasterPriority2 != ds->priority2 ||
+		!cid_eq(&a->grandmasterIdentity, &ds->identity) ||
+		a->stepsRemoved != ds->stepsRemoved;
 }
 
 static void announce_to_dataset(struct ptp_message *m, struct port *p,
@@ -109,22 +113,22 @@ static int check_source_identity(struct port *p, struct ptp_message *m)
 	return pid_eq(&master, &m->header.sourcePortIdentity) ? 0 : -1;
 }
 
-static void extract_address(struct ptp_message *m, struct PortAddress *paddr)
+static void extract_address(struct address *a, struct PortAddress *paddr)
 {
 	int len = 0;
 
 	switch (paddr->networkProtocol) {
 	case TRANS_UDP_IPV4:
-		len = sizeof(m->address.sin.sin_addr.s_addr);
-		memcpy(paddr->address, &m->address.sin.sin_addr.s_addr, len);
+		len = sizeof(a->sin.sin_addr.s_addr);
+		memcpy(paddr->address, &a->sin.sin_addr.s_addr, len);
 		break;
 	case TRANS_UDP_IPV6:
-		len = sizeof(m->address.sin6.sin6_addr.s6_addr);
-		memcpy(paddr->address, &m->address.sin6.sin6_addr.s6_addr, len);
+		len = sizeof(a->sin6.sin6_addr.s6_addr);
+		memcpy(paddr->address, &a->sin6.sin6_addr.s6_addr, len);
 		break;
 	case TRANS_IEEE_802_3:
 		len = MAC_LEN;
-		memcpy(paddr->address, &m->address.sll.sll_addr, len);
+		memcpy(paddr->address, &a->sll.sll_addr, len);
 		break;
 	default:
 		return;
@@ -132,21 +136,21 @@ static void extract_address(struct ptp_message *m, struct PortAddress *paddr)
 	paddr->addressLength = len;
 }
 
-static int msg_current(struct ptp_message *m, struct timespec now)
+static int announce_current(struct foreign_announce *a, struct timespec now)
 {
 	int64_t t1, t2, tmo;
 
-	t1 = m->ts.host.tv_sec * NSEC2SEC + m->ts.host.tv_nsec;
+	t1 = a->ts.tv_sec * NSEC2SEC + a->ts.tv_nsec;
 	t2 = now.tv_sec * NSEC2SEC + now.tv_nsec;
 
-	if (m->header.logMessageInterval <= -31) {
+	if (a->logMessageInterval <= -31) {
 		tmo = 0;
-	} else if (m->header.logMessageInterval >= 31) {
+	} else if (a->logMessageInterval >= 31) {
 		tmo = INT64_MAX;
-	} else if (m->header.logMessageInterval < 0) {
-		tmo = 4LL * NSEC2SEC / (1 << -m->header.logMessageInterval);
+	} else if (a->logMessageInterval < 0) {
+		tmo = 4LL * NSEC2SEC / (1 << -a->logMessageInterval);
 	} else {
-		tmo = 4LL * (1 << m->header.logMessageInterval) * NSEC2SEC;
+		tmo = 4LL * (1 << a->logMessageInterval) * NSEC2SEC;
 	}
 
 	return t2 - t1 < tmo;
@@ -183,59 +187,48 @@ void fault_interval(struct port *port, enum fault_type ft,
 	i->val = port->flt_interval_pertype[ft].val;
 }
 
-int port_fault_fd(struct port *port)
+struct fdarray *port_fda(struct port *port)
 {
-	return port->fault_fd;
+	return &port->fda;
 }
 
-struct fdarray *port_fda(struct port *port)
+struct twheel_timer *port_timer(struct port *port, int index)
 {
-	return &port->fda;
+	if (index == N_POLLFD) {
+		return &port->fault_timer;
+	}
+	if (index < FD_FIRST_TIMER || index >= FD_FIRST_TIMER + N_TIMER_FDS) {
+		return NULL;
+	}
+	return &port->timer[index - FD_FIRST_TIMER];
 }
 
-int set_tmo_log(int fd, unsigned int scale, int log_seconds)
+static int port_set_tmo(struct port *p, int index, uint64_t ns)
+{
+	return twheel_set(clock_twheel(p->clock), port_timer(p, index), ns);
+}
+
+int set_tmo_log(struct port *p, int index, unsigned int scale, int log_seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 	uint64_t ns;
-	int i;
 
 	if (log_seconds < 0) {
-
-		log_seconds *= -1;
-		for (i = 1, ns = scale * 500000000ULL; i < log_seconds; i++) {
-			ns >>= 1;
-		}
-		tmo.it_value.tv_nsec = ns;
-
-		while (tmo.it_value.tv_nsec >= NS_PER_SEC) {
-			tmo.it_value.tv_nsec -= NS_PER_SEC;
-			tmo.it_value.tv_sec++;
-		}
-
-	} else
-		tmo.it_value.tv_sec = scale * (1 << log_seconds);
-
-	return timerfd_settime(fd, 0, &tmo, NULL);
+		ns = (scale * NS_PER_SEC) >> -log_seconds;
+	} else {
+		ns = scale * (1ULL << log_seconds) * NS_PER_SEC;
+	}
+	return port_set_tmo(p, index, ns);
 }
 
-int set_tmo_lin(int fd, int seconds)
+int set_tmo_lin(struct port *p, int index, int seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-
-	tmo.it_value.tv_sec = seconds;
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return port_set_tmo(p, index, seconds * NS_PER_SEC);
 }
 
-int set_tmo_random(int fd, int min, int span, int log_seconds)
+int set_tmo_random(struct port *p, int index, int min, int span,
+		   int log_seconds)
 {
 	uint64_t value_ns, min_ns, span_ns;
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 
 	if (log_seconds >= 0) {
 		min_ns = min * NS_PER_SEC << log_seconds;
@@ -247,57 +240,126 @@ int set_tmo_random(int fd, int min, int span, int log_seconds)
 
 	value_ns = min_ns + (span_ns * (random() % (1 << 15) + 1) >> 15);
 
-	tmo.it_value.tv_sec = value_ns / NS_PER_SEC;
-	tmo.it_value.tv_nsec = value_ns % NS_PER_SEC;
-
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return port_set_tmo(p, index, value_ns);
 }
 
 int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds)
 {
-	return set_tmo_log(port->fault_fd, scale, log_seconds);
+	return set_tmo_log(port, N_POLLFD, scale, log_seconds);
 }
 
 int port_set_fault_timer_lin(struct port *port, int seconds)
 {
-	return set_tmo_lin(port->fault_fd, seconds);
+	return set_tmo_lin(port, N_POLLFD, seconds);
 }
 
 void fc_clear(struct foreign_clock *fc)
 {
-	struct ptp_message *m;
-
-	while (fc->n_messages) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		TAILQ_REMOVE(&fc->messages, m, list);
-		fc->n_messages--;
-		msg_put(m);
+	if (fc->n_messages) {
+		fc->port->best_dirty = 1;
 	}
+	fc->n_messages = 0;
 }
 
 static void fc_prune(struct foreign_clock *fc)
 {
 	struct timespec now;
-	struct ptp_message *m;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	while (fc->n_messages > FOREIGN_MASTER_THRESHOLD) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		TAILQ_REMOVE(&fc->messages, m, list);
+	while (fc->n_messages &&
+	       !announce_current(&fc->rx[fc->n_messages - 1], now)) {
 		fc->n_messages--;
-		msg_put(m);
+		/* An aged out message may disqualify the foreign master. */
+		fc->port->best_dirty = 1;
 	}
+}
 
-	while (!TAILQ_EMPTY(&fc->messages)) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		if (msg_current(m, now))
-			break;
-		TAILQ_REMOVE(&fc->messages, m, list);
-		fc->n_messages--;
-		msg_put(m);
+/*
+ * Records the announce message of a known foreign master. Only the
+ * receipt time and the data set of the message are kept.
+ * Returns non-zero if the announce message is different than last.
+ */
+static int fc_update(struct foreign_clock *fc, struct ptp_message *m)
+{
+	struct port *p = fc->port;
+	int diff = 0;
+
+	if (fc->n_messages) {
+		diff = announce_compare(m, &fc->dataset);
+	}
+	memmove(&fc->rx[1], &fc->rx[0], sizeof(fc->rx) - sizeof(fc->rx[0]));
+	fc->rx[0].ts = m->ts.host;
+	fc->rx[0].logMessageInterval = m->header.logMessageInterval;
+	if (fc->n_messages < FOREIGN_MASTER_THRESHOLD) {
+		fc->n_messages++;
+	}
+
+	announce_to_dataset(m, p, &fc->dataset);
+	fc->currentUtcOffset = m->announce.currentUtcOffset;
+	fc->flags = m->header.flagField[1];
+	fc->timeSource = m->announce.timeSource;
+	fc->address = m->address;
+
+	TAILQ_REMOVE(&p->foreign_masters, fc, lru);
+	TAILQ_INSERT_TAIL(&p->foreign_masters, fc, lru);
+	return diff;
+}
+
+static struct fm *fc_bucket(struct port *p, struct PortIdentity *pid)
+{
+	unsigned char *buf = (unsigned char *) pid;
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < sizeof(*pid); i++) {
+		hash ^= buf[i];
+		hash *= 16777619u;
+	}
+	return &p->fm_hash[(hash ^ (hash >> 16)) & p->fm_hash_mask];
+}
+
+static void fc_recycle(struct port *p, struct foreign_clock *fc)
+{
+	fc_clear(fc);
+	LIST_REMOVE(fc, list);
+	TAILQ_REMOVE(&p->foreign_masters, fc, lru);
+	TAILQ_INSERT_HEAD(&p->fm_free, fc, lru);
+	p->fm_stats.in_use--;
+}
+
+/*
+ * Takes a free foreign master record. When all of them are in use, the
+ * least recently heard foreign master is forgotten, unless it is the
+ * best one of the port.
+ */
+static struct foreign_clock *fc_allocate(struct port *p)
+{
+	struct foreign_clock *fc;
+
+	fc = TAILQ_FIRST(&p->fm_free);
+	if (!fc) {
+		fc = TAILQ_FIRST(&p->foreign_masters);
+		if (fc && fc == p->best) {
+			fc = TAILQ_NEXT(fc, lru);
+		}
+		if (!fc) {
+			p->fm_stats.dropped++;
+			return NULL;
+		}
+		pr_debug("port %hu: forgetting foreign master %s", portnum(p),
+			 pid2str(&fc->dataset.sender));
+		fc_recycle(p, fc);
+		p->fm_stats.evicted++;
 	}
+	TAILQ_REMOVE(&p->fm_free, fc, lru);
+	p->fm_stats.in_use++;
+	if (p->fm_stats.in_use > p->fm_stats.high_water) {
+		p->fm_stats.high_water = p->fm_stats.in_use;
+	}
+	return fc;
 }
 
 static int delay_req_current(struct ptp_message *m, struct timespec now)
@@ -339,29 +401,32 @@ void ts_add(tmv_t *ts, Integer64 correction)
  */
 static int add_foreign_master(struct port *p, struct ptp_message *m)
 {
-	struct foreign_clock *fc;
-	struct ptp_message *tmp;
+	struct PortIdentity *pid = &m->header.sourcePortIdentity;
 	int broke_threshold = 0, diff = 0;
+	struct foreign_clock *fc;
+	struct fm *bucket;
 
-	LIST_FOREACH(fc, &p->foreign_masters, list) {
+	bucket = fc_bucket(p, pid);
+	LIST_FOREACH(fc, bucket, list) {
 		if (msg_source_equal(m, fc)) {
 			break;
 		}
 	}
 	if (!fc) {
 		pr_notice("port %hu: new foreign master %s", portnum(p),
-			pid2str(&m->header.sourcePortIdentity));
+			pid2str(pid));
 
-		fc = malloc(sizeof(*fc));
+		fc = fc_allocate(p);
 		if (!fc) {
-			pr_err("low memory, failed to add foreign master");
+			pl_warning(60, "port %hu: foreign master table full",
+				   portnum(p));
 			return 0;
 		}
 		memset(fc, 0, sizeof(*fc));
-		TAILQ_INIT(&fc->messages);
-		LIST_INSERT_HEAD(&p->foreign_masters, fc, list);
+		LIST_INSERT_HEAD(bucket, fc, list);
+		TAILQ_INSERT_TAIL(&p->foreign_masters, fc, lru);
 		fc->port = p;
-		fc->dataset.sender = m->header.sourcePortIdentity;
+		fc->dataset.sender = *pid;
 		/* We do not count this first message, see 9.5.3(b) */
 		return 0;
 	}
@@ -375,18 +440,12 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 	}
 
 	/*
-	 * Okay, go ahead and add this announcement.
-	 */
-	msg_get(m);
-	fc->n_messages++;
-	TAILQ_INSERT_HEAD(&fc->messages, m, list);
-
-	/*
-	 * Test if this announcement contains changed information.
+	 * Okay, go ahead and add this announcement, and test if it
+	 * contains changed information.
 	 */
-	if (fc->n_messages > 1) {
-		tmp = TAILQ_NEXT(m, list);
-		diff = announce_compare(m, tmp);
+	diff = fc_update(fc, m);
+	if (broke_threshold || diff) {
+		p->best_dirty = 1;
 	}
 
 	return broke_threshold || diff;
@@ -420,7 +479,6 @@ static int net_sync_resp_append(struct port *p, struct ptp_message *m)
 	struct nsm_resp_tlv_head *head;
 	struct Timestamp last_sync;
 	struct PortAddress *paddr;
-	struct ptp_message *tmp;
 	struct tlv_extra *extra;
 	unsigned char *ptr;
 	int tlv_len;
@@ -437,8 +495,7 @@ static int net_sync_resp_append(struct port *p, struct ptp_message *m)
 		paddr->addressLength =
 			transport_protocol_addr(best->trp, paddr->address);
 		if (best->best) {
-			tmp = TAILQ_FIRST(&best->best->messages);
-			extract_address(tmp, paddr);
+			extract_address(&best->best->address, paddr);
 		}
 	} else {
 		/* We are our own parent. */
@@ -494,11 +551,42 @@ static struct follow_up_info_tlv *follow_up_info_extract(struct ptp_message *m)
 static void free_foreign_masters(struct port *p)
 {
 	struct foreign_clock *fc;
-	while ((fc = LIST_FIRST(&p->foreign_masters)) != NULL) {
-		LIST_REMOVE(fc, list);
-		fc_clear(fc);
-		free(fc);
+	while ((fc = TAILQ_FIRST(&p->foreign_masters)) != NULL) {
+		fc_recycle(p, fc);
+	}
+}
+
+static int foreign_masters_init(struct port *p)
+{
+	struct config *cfg = clock_config(p->clock);
+	unsigned int i, n, size = 1;
+
+	n = config_int(cfg, p->cfg_section, CFG_MAX_FOREIGN_MASTERS);
+	while (size < n) {
+		size <<= 1;
+	}
+	p->fm_hash = calloc(size, sizeof(*p->fm_hash));
+	p->fm_arena = calloc(n, sizeof(*p->fm_arena));
+	if (!p->fm_hash || !p->fm_arena) {
+		pr_err("port %hu: failed to allocate %u foreign master records",
+		       portnum(p), n);
+		free(p->fm_hash);
+		free(p->fm_arena);
+		return -1;
+	}
+	p->fm_hash_mask = size - 1;
+	for (i = 0; i < n; i++) {
+		TAILQ_INSERT_TAIL(&p->fm_free, &p->fm_arena[i], lru);
 	}
+	p->fm_stats.records = n;
+	return 0;
+}
+
+static void foreign_masters_cleanup(struct port *p)
+{
+	free_foreign_masters(p);
+	free(p->fm_hash);
+	free(p->fm_arena);
 }
 
 static int fup_sync_ok(struct ptp_message *fup, struct ptp_message *sync)
@@ -679,12 +767,10 @@ not_capable:
 	return 0;
 }
 
-int port_clr_tmo(int fd)
+int port_clr_tmo(struct port *p, int index)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	twheel_clr(clock_twheel(p->clock), port_timer(p, index));
+	return 0;
 }
 
 static int port_ignore(struct port *p, struct ptp_message *m)
@@ -785,8 +871,10 @@ static int port_management_fill_response(struct port *target,
 					 struct ptp_message *rsp, int id)
 {
 	struct mgmt_clock_description *cd;
+	struct port_foreign_stats_np *pfsn;
 	struct management_tlv_datum *mtd;
 	struct clock_description *desc;
+	struct port_tc_stats_np *ptsn;
 	struct port_properties_np *ppn;
 	struct port_stats_np *psn;
 	struct management_tlv *tlv;
@@ -952,6 +1040,26 @@ static int port_management_fill_response(struct port *target,
 		psn->stats = target->stats;
 		datalen = sizeof(*psn);
 		break;
+	case TLV_PORT_TC_STATS_NP:
+		ptsn = (struct port_tc_stats_np *) tlv->data;
+		ptsn->portIdentity = target->portIdentity;
+		ptsn->records = target->tc_stats.records;
+		ptsn->in_use = target->tc_stats.in_use;
+		ptsn->high_water = target->tc_stats.high_water;
+		ptsn->evicted = target->tc_stats.evicted;
+		ptsn->dropped = target->tc_stats.dropped;
+		datalen = sizeof(*ptsn);
+		break;
+	case TLV_PORT_FOREIGN_STATS_NP:
+		pfsn = (struct port_foreign_stats_np *) tlv->data;
+		pfsn->portIdentity = target->portIdentity;
+		pfsn->records = target->fm_stats.records;
+		pfsn->in_use = target->fm_stats.in_use;
+		pfsn->high_water = target->fm_stats.high_water;
+		pfsn->evicted = target->fm_stats.evicted;
+		pfsn->dropped = target->fm_stats.dropped;
+		datalen = sizeof(*pfsn);
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		tlv_extra_recycle(extra);
@@ -1069,8 +1177,7 @@ static void port_nrate_initialize(struct port *p)
 
 int port_set_announce_tmo(struct port *p)
 {
-	return set_tmo_random(p->fda.fd[FD_ANNOUNCE_TIMER],
-			      p->announceReceiptTimeout,
+	return set_tmo_random(p, FD_ANNOUNCE_TIMER, p->announceReceiptTimeout,
 			      p->announce_span, p->logAnnounceInterval);
 }
 
@@ -1081,34 +1188,35 @@ int port_set_delay_tmo(struct port *p)
 	}
 
 	if (p->delayMechanism == DM_P2P) {
-		return set_tmo_log(p->fda.fd[FD_DELAY_TIMER], 1,
+		return set_tmo_log(p, FD_DELAY_TIMER, 1,
 			       p->logPdelayReqInterval);
 	} else {
-		return set_tmo_random(p->fda.fd[FD_DELAY_TIMER], 0, 2,
+		return set_tmo_random(p, FD_DELAY_TIMER, 0, 2,
 				p->logMinDelayReqInterval);
 	}
 }
 
 static int port_set_manno_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, p->logAnnounceInterval);
+	return set_tmo_log(p, FD_MANNO_TIMER, 1, p->logAnnounceInterval);
 }
 
 int port_set_qualification_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_QUALIFICATION_TIMER],
-		       1+clock_steps_removed(p->clock), p->logAnnounceInterval);
+	return set_tmo_log(p, FD_QUALIFICATION_TIMER,
+			   1+clock_steps_removed(p->clock),
+			   p->logAnnounceInterval);
 }
 
 static int port_set_sync_rx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_RX_TIMER],
-			   p->syncReceiptTimeout, p->logSyncInterval);
+	return set_tmo_log(p, FD_SYNC_RX_TIMER, p->syncReceiptTimeout,
+			   p->logSyncInterval);
 }
 
 static int port_set_sync_tx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_TX_TIMER], 1, p->logSyncInterval);
+	return set_tmo_log(p, FD_SYNC_TX_TIMER, 1, p->logSyncInterval);
 }
 
 void port_show_transition(struct port *p, enum port_state next,
@@ -1325,6 +1433,237 @@ static void port_syfufsm(struct port *p, enum syfu_event event,
 	}
 }
 
+static struct ptp_message *port_announce_msg(struct port *p,
+					     struct address *dst)
+{
+	struct timePropertiesDS tp = clock_time_properties(p->clock);
+	struct parent_ds *dad = clock_parent_ds(p->clock);
+	struct ptp_message *msg;
+
+	msg = msg_allocate();
+	if (!msg) {
+		return NULL;
+	}
+
+	msg->hwts.type = p->timestamping;
+
+	msg->header.tsmt               = ANNOUNCE | p->transportSpecific;
+	msg->header.ver                = PTP_VERSION;
+	msg->header.messageLength      = sizeof(struct announce_msg);
+	msg->header.domainNumber       = clock_domain_number(p->clock);
+	msg->header.sourcePortIdentity = p->portIdentity;
+	msg->header.sequenceId         = p->seqnum.announce++;
+	msg->header.control            = CTL_OTHER;
+	msg->header.logMessageInterval = p->logAnnounceInterval;
+
+	msg->header.flagField[1] = tp.flags;
+
+	if (dst) {
+		msg->address = *dst;
+		msg->header.flagField[0] |= UNICAST;
+	}
+	msg->announce.currentUtcOffset        = tp.currentUtcOffset;
+	msg->announce.grandmasterPriority1    = dad->pds.grandmasterPriority1;
+	msg->announce.grandmasterClockQuality = dad->pds.grandmasterClockQuality;
+	msg->announce.grandmasterPriority2    = dad->pds.grandmasterPriority2;
+	msg->announce.grandmasterIdentity     = dad->pds.grandmasterIdentity;
+	msg->announce.stepsRemoved            = clock_steps_removed(p->clock);
+	msg->announce.timeSource              = tp.timeSource;
+
+	if (p->path_trace_enabled && path_trace_append(p, msg, dad)) {
+		pr_err("port %hu: append path trace failed", portnum(p));
+	}
+	return msg;
+}
+
+static int port_sync_event(struct port *p)
+{
+	switch (p->timestamping) {
+	case TS_SOFTWARE:
+	case TS_LEGACY_HW:
+	case TS_HARDWARE:
+		return TRANS_EVENT;
+	case TS_ONESTEP:
+		return TRANS_ONESTEP;
+	case TS_P2P1STEP:
+		return TRANS_P2P1STEP;
+	default:
+		return -1;
+	}
+}
+
+static int port_one_step(struct port *p)
+{
+	return p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP;
+}
+
+static struct ptp_message *port_sync_msg(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+
+	msg = msg_allocate();
+	if (!msg) {
+		return NULL;
+	}
+
+	msg->hwts.type = p->timestamping;
+
+	msg->header.tsmt               = SYNC | p->transportSpecific;
+	msg->header.ver                = PTP_VERSION;
+	msg->header.messageLength      = sizeof(struct sync_msg);
+	msg->header.domainNumber       = clock_domain_number(p->clock);
+	msg->header.sourcePortIdentity = p->portIdentity;
+	msg->header.sequenceId         = p->seqnum.sync++;
+	msg->header.control            = CTL_SYNC;
+	msg->header.logMessageInterval = p->logSyncInterval;
+
+	if (!port_one_step(p)) {
+		msg->header.flagField[0] |= TWO_STEP;
+	}
+
+	if (dst) {
+		msg->address = *dst;
+		msg->header.flagField[0] |= UNICAST;
+		msg->header.logMessageInterval = 0x7f;
+	}
+	return msg;
+}
+
+/*
+ * Builds the follow up for a sync message which has already been
+ * sent, and therefore carries its header in network byte order.
+ */
+static struct ptp_message *port_fup_msg(struct port *p,
+					struct ptp_message *sync,
+					struct address *dst)
+{
+	struct ptp_message *fup;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return NULL;
+	}
+
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = PTP_VERSION;
+	fup->header.messageLength      = sizeof(struct follow_up_msg);
+	fup->header.domainNumber       = clock_domain_number(p->clock);
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.sequenceId         = ntohs(sync->header.sequenceId);
+	fup->header.control            = CTL_FOLLOW_UP;
+	fup->header.logMessageInterval = p->logSyncInterval;
+
+	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(sync->hwts.ts);
+
+	if (dst) {
+		fup->address = *dst;
+		fup->header.flagField[0] |= UNICAST;
+	}
+	if (p->follow_up_info && follow_up_info_append(fup)) {
+		pr_err("port %hu: append fup info failed", portnum(p));
+		msg_put(fup);
+		return NULL;
+	}
+	return fup;
+}
+
+/*
+ * Sends a batch of unicast messages. Returns the number of messages
+ * sent, which are always the first ones of the array.
+ */
+static int port_send_batch(struct port *p, struct ptp_message **msg, int n,
+			   enum transport_event event)
+{
+	int cnt, i;
+
+	for (i = 0; i < n; i++) {
+		if (msg_pre_send(msg[i])) {
+			return -1;
+		}
+	}
+	cnt = transport_sendto_batch(p->trp, &p->fda, event, msg, n);
+	for (i = 0; i < cnt; i++) {
+		port_stats_inc_tx(p, msg[i]);
+	}
+	return cnt;
+}
+
+static void port_put_batch(struct ptp_message **msg, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		msg_put(msg[i]);
+	}
+}
+
+static int64_t port_tx_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+/*
+ * Parks an event message, which was sent with TRANS_DEFER_EVENT, until
+ * its transmit time stamp arrives on the error queue. The main loop
+ * then completes it in port_tx_event(), sending the given follow up.
+ */
+static struct tx_pending *port_tx_park(struct port *p, struct ptp_message *msg,
+				       struct ptp_message *fup)
+{
+	struct tx_pending *txp;
+	int64_t tmo = sk_tx_timeout * NS_PER_MSEC;
+
+	txp = TAILQ_FIRST(&p->tx_free);
+	if (txp) {
+		TAILQ_REMOVE(&p->tx_free, txp, list);
+	} else {
+		txp = malloc(sizeof(*txp));
+		if (!txp) {
+			pr_err("low memory, failed to park tx time stamp");
+			return NULL;
+		}
+	}
+	if (TAILQ_EMPTY(&p->tx_pending)) {
+		port_set_tmo(p, FD_TXTS_TIMER, tmo);
+	}
+	msg->hwts.ts = tmv_zero();
+	msg_get(msg);
+	if (fup) {
+		msg_get(fup);
+	}
+	txp->msg = msg;
+	txp->fup = fup;
+	txp->deadline = port_tx_now() + tmo;
+	txp->ingress = NULL;
+	TAILQ_INSERT_TAIL(&p->tx_pending, txp, list);
+	return txp;
+}
+
+static void port_tx_release(struct port *p, struct tx_pending *txp)
+{
+	TAILQ_REMOVE(&p->tx_pending, txp, list);
+	msg_put(txp->msg);
+	if (txp->fup) {
+		msg_put(txp->fup);
+	}
+	TAILQ_INSERT_HEAD(&p->tx_free, txp, list);
+}
+
+static void flush_tx_pending(struct port *p)
+{
+	struct tx_pending *txp;
+
+	while ((txp = TAILQ_FIRST(&p->tx_pending)) != NULL) {
+		port_tx_release(p, txp);
+	}
+	port_clr_tmo(p, FD_TXTS_TIMER);
+}
+
 static int port_pdelay_request(struct port *p)
 {
 	struct ptp_message *msg;
@@ -1359,13 +1698,12 @@ static int port_pdelay_request(struct port *p)
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	err = peer_prepare_and_send(p, msg, TRANS_EVENT);
+	err = peer_prepare_and_send(p, msg, TRANS_DEFER_EVENT);
 	if (err) {
 		pr_err("port %hu: send peer delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
-		pr_err("missing timestamp on transmitted peer delay request");
+	if (!port_tx_park(p, msg, NULL)) {
 		goto out;
 	}
 
@@ -1418,17 +1756,15 @@ int port_delay_request(struct port *p)
 	msg->header.logMessageInterval = 0x7f;
 
 	if (p->hybrid_e2e) {
-		struct ptp_message *dst = TAILQ_FIRST(&p->best->messages);
-		msg->address = dst->address;
+		msg->address = p->best->address;
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	if (port_prepare_and_send(p, msg, TRANS_EVENT)) {
+	if (port_prepare_and_send(p, msg, TRANS_DEFER_EVENT)) {
 		pr_err("port %hu: send delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
-		pr_err("missing timestamp on transmitted delay request");
+	if (!port_tx_park(p, msg, NULL)) {
 		goto out;
 	}
 
@@ -1442,8 +1778,6 @@ out:
 
 int port_tx_announce(struct port *p, struct address *dst)
 {
-	struct timePropertiesDS tp = clock_time_properties(p->clock);
-	struct parent_ds *dad = clock_parent_ds(p->clock);
 	struct ptp_message *msg;
 	int err;
 
@@ -1453,66 +1787,53 @@ int port_tx_announce(struct port *p, struct address *dst)
 	if (!port_capable(p)) {
 		return 0;
 	}
-	msg = msg_allocate();
+	msg = port_announce_msg(p, dst);
 	if (!msg) {
 		return -1;
 	}
 
-	msg->hwts.type = p->timestamping;
+	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
+	if (err) {
+		pr_err("port %hu: send announce failed", portnum(p));
+	}
+	msg_put(msg);
+	return err;
+}
 
-	msg->header.tsmt               = ANNOUNCE | p->transportSpecific;
-	msg->header.ver                = PTP_VERSION;
-	msg->header.messageLength      = sizeof(struct announce_msg);
-	msg->header.domainNumber       = clock_domain_number(p->clock);
-	msg->header.sourcePortIdentity = p->portIdentity;
-	msg->header.sequenceId         = p->seqnum.announce++;
-	msg->header.control            = CTL_OTHER;
-	msg->header.logMessageInterval = p->logAnnounceInterval;
-
-	msg->header.flagField[1] = tp.flags;
+int port_tx_announce_batch(struct port *p, struct address **dst, int n)
+{
+	struct ptp_message *msg[SK_TX_BATCH_MAX];
+	int cnt, err = 0, i;
 
-	if (dst) {
-		msg->address = *dst;
-		msg->header.flagField[0] |= UNICAST;
+	if (!port_capable(p)) {
+		return 0;
 	}
-	msg->announce.currentUtcOffset        = tp.currentUtcOffset;
-	msg->announce.grandmasterPriority1    = dad->pds.grandmasterPriority1;
-	msg->announce.grandmasterClockQuality = dad->pds.grandmasterClockQuality;
-	msg->announce.grandmasterPriority2    = dad->pds.grandmasterPriority2;
-	msg->announce.grandmasterIdentity     = dad->pds.grandmasterIdentity;
-	msg->announce.stepsRemoved            = clock_steps_removed(p->clock);
-	msg->announce.timeSource              = tp.timeSource;
-
-	if (p->path_trace_enabled && path_trace_append(p, msg, dad)) {
-		pr_err("port %hu: append path trace failed", portnum(p));
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
 	}
-
-	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
-	if (err) {
+	for (i = 0; i < n; i++) {
+		msg[i] = port_announce_msg(p, dst[i]);
+		if (!msg[i]) {
+			port_put_batch(msg, i);
+			return -1;
+		}
+	}
+	cnt = port_send_batch(p, msg, n, TRANS_GENERAL);
+	if (cnt < n) {
 		pr_err("port %hu: send announce failed", portnum(p));
+		err = -1;
 	}
-	msg_put(msg);
+	port_put_batch(msg, n);
 	return err;
 }
 
 int port_tx_sync(struct port *p, struct address *dst)
 {
-	struct ptp_message *msg, *fup;
+	struct ptp_message *msg;
 	int err, event;
 
-	switch (p->timestamping) {
-	case TS_SOFTWARE:
-	case TS_LEGACY_HW:
-	case TS_HARDWARE:
-		event = TRANS_EVENT;
-		break;
-	case TS_ONESTEP:
-		event = TRANS_ONESTEP;
-		break;
-	case TS_P2P1STEP:
-		event = TRANS_P2P1STEP;
-		break;
-	default:
+	event = port_sync_event(p);
+	if (event < 0) {
 		return -1;
 	}
 
@@ -1525,82 +1846,81 @@ int port_tx_sync(struct port *p, struct address *dst)
 	if (port_sync_incapable(p)) {
 		return 0;
 	}
-	msg = msg_allocate();
+	msg = port_sync_msg(p, dst);
 	if (!msg) {
 		return -1;
 	}
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(msg);
-		return -1;
-	}
-
-	msg->hwts.type = p->timestamping;
 
-	msg->header.tsmt               = SYNC | p->transportSpecific;
-	msg->header.ver                = PTP_VERSION;
-	msg->header.messageLength      = sizeof(struct sync_msg);
-	msg->header.domainNumber       = clock_domain_number(p->clock);
-	msg->header.sourcePortIdentity = p->portIdentity;
-	msg->header.sequenceId         = p->seqnum.sync++;
-	msg->header.control            = CTL_SYNC;
-	msg->header.logMessageInterval = p->logSyncInterval;
-
-	if (p->timestamping != TS_ONESTEP && p->timestamping != TS_P2P1STEP) {
-		msg->header.flagField[0] |= TWO_STEP;
-	}
-
-	if (dst) {
-		msg->address = *dst;
-		msg->header.flagField[0] |= UNICAST;
-		msg->header.logMessageInterval = 0x7f;
+	if (!port_one_step(p)) {
+		event = TRANS_DEFER_EVENT;
 	}
 	err = port_prepare_and_send(p, msg, event);
 	if (err) {
 		pr_err("port %hu: send sync failed", portnum(p));
 		goto out;
 	}
-	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
-		goto out;
-	} else if (msg_sots_missing(msg)) {
-		pr_err("missing timestamp on transmitted sync");
-		err = -1;
-		goto out;
-	}
 
 	/*
-	 * Send the follow up message right away.
+	 * The follow up goes out as soon as the time stamp arrives.
 	 */
-	fup->hwts.type = p->timestamping;
-
-	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = PTP_VERSION;
-	fup->header.messageLength      = sizeof(struct follow_up_msg);
-	fup->header.domainNumber       = clock_domain_number(p->clock);
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = p->seqnum.sync - 1;
-	fup->header.control            = CTL_FOLLOW_UP;
-	fup->header.logMessageInterval = p->logSyncInterval;
+	if (!port_one_step(p) && !port_tx_park(p, msg, NULL)) {
+		err = -1;
+	}
+out:
+	msg_put(msg);
+	return err;
+}
 
-	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
+int port_tx_sync_batch(struct port *p, struct address **dst, int n)
+{
+	struct ptp_message *msg[SK_TX_BATCH_MAX];
+	int cnt, err = 0, event, i;
 
-	if (dst) {
-		fup->address = *dst;
-		fup->header.flagField[0] |= UNICAST;
+	event = port_sync_event(p);
+	if (event < 0) {
+		return -1;
 	}
-	if (p->follow_up_info && follow_up_info_append(fup)) {
-		pr_err("port %hu: append fup info failed", portnum(p));
-		err = -1;
+	if (!port_capable(p)) {
+		return 0;
+	}
+	if (port_sync_incapable(p)) {
+		return 0;
+	}
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	for (i = 0; i < n; i++) {
+		msg[i] = port_sync_msg(p, dst[i]);
+		if (!msg[i]) {
+			port_put_batch(msg, i);
+			return -1;
+		}
+	}
+	if (port_one_step(p)) {
+		cnt = port_send_batch(p, msg, n, event);
+		if (cnt < n) {
+			pr_err("port %hu: send sync failed", portnum(p));
+			err = -1;
+		}
 		goto out;
 	}
 
-	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
-	if (err) {
-		pr_err("port %hu: send follow up failed", portnum(p));
+	/*
+	 * The time stamps of the batch are completed by the main loop,
+	 * which then sends the follow ups in batches as well.
+	 */
+	cnt = port_send_batch(p, msg, n, TRANS_DEFER_EVENT);
+	if (cnt < n) {
+		pr_err("port %hu: send sync failed", portnum(p));
+		err = -1;
+	}
+	for (i = 0; i < cnt; i++) {
+		if (!port_tx_park(p, msg[i], NULL)) {
+			err = -1;
+		}
 	}
 out:
-	msg_put(msg);
-	msg_put(fup);
+	port_put_batch(msg, n);
 	return err;
 }
 
@@ -1641,6 +1961,10 @@ void flush_delay_req(struct port *p)
 		TAILQ_REMOVE(&p->delay_req, m, list);
 		msg_put(m);
 	}
+	if (p->delay_resp) {
+		msg_put(p->delay_resp);
+		p->delay_resp = NULL;
+	}
 }
 
 static void flush_peer_delay(struct port *p)
@@ -1672,80 +1996,82 @@ void port_disable(struct port *p)
 	int i;
 
 	tc_flush(p);
+	flush_tx_pending(p);
 	flush_last_sync(p);
 	flush_delay_req(p);
 	flush_peer_delay(p);
 
 	p->best = NULL;
+	p->best_dirty = 1;
 	free_foreign_masters(p);
 	transport_close(p->trp, &p->fda);
 
 	for (i = 0; i < N_TIMER_FDS; i++) {
-		close(p->fda.fd[FD_FIRST_TIMER + i]);
+		port_clr_tmo(p, FD_FIRST_TIMER + i);
 	}
 
 	/* Keep rtnl socket to get link status info. */
 	port_clear_fda(p, FD_RTNL);
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 }
 
 int port_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
-	int fd[N_TIMER_FDS], i;
+	int sec = p->cfg_section;
 
 	p->multiple_seq_pdr_count  = 0;
 	p->multiple_pdr_detected   = 0;
 	p->last_fault_type         = FT_UNSPECIFIED;
-	p->logMinDelayReqInterval  = config_get_int(cfg, p->name, "logMinDelayReqInterval");
+	p->logMinDelayReqInterval =
+		config_int(cfg, sec, CFG_LOG_MIN_DELAY_REQ_INTERVAL);
 	p->peerMeanPathDelay       = 0;
-	p->initialLogAnnounceInterval = config_get_int(cfg, p->name, "logAnnounceInterval");
+	p->initialLogAnnounceInterval =
+		config_int(cfg, sec, CFG_LOG_ANNOUNCE_INTERVAL);
 	p->logAnnounceInterval     = p->initialLogAnnounceInterval;
-	p->inhibit_announce        = config_get_int(cfg, p->name, "inhibit_announce");
-	p->ignore_source_id        = config_get_int(cfg, p->name, "ignore_source_id");
-	p->announceReceiptTimeout  = config_get_int(cfg, p->name, "announceReceiptTimeout");
-	p->syncReceiptTimeout      = config_get_int(cfg, p->name, "syncReceiptTimeout");
-	p->transportSpecific       = config_get_int(cfg, p->name, "transportSpecific");
+	p->inhibit_announce        = config_int(cfg, sec, CFG_INHIBIT_ANNOUNCE);
+	p->ignore_source_id        = config_int(cfg, sec, CFG_IGNORE_SOURCE_ID);
+	p->rx_filter               = config_int(cfg, sec, CFG_RX_FILTER);
+	p->announceReceiptTimeout =
+		config_int(cfg, sec, CFG_ANNOUNCE_RECEIPT_TIMEOUT);
+	p->syncReceiptTimeout =
+		config_int(cfg, sec, CFG_SYNC_RECEIPT_TIMEOUT);
+	p->transportSpecific =
+		config_int(cfg, sec, CFG_TRANSPORT_SPECIFIC);
 	p->transportSpecific     <<= 4;
-	p->match_transport_specific = !config_get_int(cfg, p->name, "ignore_transport_specific");
-	p->localPriority           = config_get_int(cfg, p->name, "G.8275.portDS.localPriority");
-	p->initialLogSyncInterval  = config_get_int(cfg, p->name, "logSyncInterval");
+	p->match_transport_specific =
+		!config_int(cfg, sec, CFG_IGNORE_TRANSPORT_SPECIFIC);
+	p->localPriority =
+		config_int(cfg, sec, CFG_G8275_PORT_DS_LOCAL_PRIORITY);
+	p->initialLogSyncInterval =
+		config_int(cfg, sec, CFG_LOG_SYNC_INTERVAL);
 	p->logSyncInterval         = p->initialLogSyncInterval;
-	p->operLogSyncInterval     = config_get_int(cfg, p->name, "operLogSyncInterval");
-	p->logMinPdelayReqInterval = config_get_int(cfg, p->name, "logMinPdelayReqInterval");
+	p->operLogSyncInterval =
+		config_int(cfg, sec, CFG_OPER_LOG_SYNC_INTERVAL);
+	p->logMinPdelayReqInterval =
+		config_int(cfg, sec, CFG_LOG_MIN_PDELAY_REQ_INTERVAL);
 	p->logPdelayReqInterval    = p->logMinPdelayReqInterval;
-	p->operLogPdelayReqInterval = config_get_int(cfg, p->name, "operLogPdelayReqInterval");
-	p->neighborPropDelayThresh = config_get_int(cfg, p->name, "neighborPropDelayThresh");
-	p->min_neighbor_prop_delay = config_get_int(cfg, p->name, "min_neighbor_prop_delay");
-
-	if (config_get_int(cfg, p->name, "asCapable") == AS_CAPABLE_TRUE) {
+	p->operLogPdelayReqInterval =
+		config_int(cfg, sec, CFG_OPER_LOG_PDELAY_REQ_INTERVAL);
+	p->neighborPropDelayThresh =
+		config_int(cfg, sec, CFG_NEIGHBOR_PROP_DELAY_THRESH);
+	p->min_neighbor_prop_delay =
+		config_int(cfg, sec, CFG_MIN_NEIGHBOR_PROP_DELAY);
+
+	if (config_int(cfg, sec, CFG_AS_CAPABLE) == AS_CAPABLE_TRUE) {
 		p->asCapable = ALWAYS_CAPABLE;
 	} else {
 		p->asCapable = NOT_CAPABLE;
 	}
 
-	p->inhibit_delay_req = config_get_int(cfg, p->name, "inhibit_delay_req");
+	p->inhibit_delay_req = config_int(cfg, sec, CFG_INHIBIT_DELAY_REQ);
 	if (p->inhibit_delay_req && p->asCapable != ALWAYS_CAPABLE) {
 		pr_err("inhibit_delay_req can only be set when asCapable == 'true'.");
 		return -1;
 	}
 
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = -1;
-	}
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (fd[i] < 0) {
-			pr_err("timerfd_create: %s", strerror(errno));
-			goto no_timers;
-		}
-	}
 	if (transport_open(p->trp, p->iface, &p->fda, p->timestamping))
-		goto no_tropen;
-
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		p->fda.fd[FD_FIRST_TIMER + i] = fd[i];
-	}
+		return -1;
 
 	if (port_set_announce_tmo(p)) {
 		goto no_tmo;
@@ -1775,20 +2101,71 @@ int port_initialize(struct port *p)
 
 	port_nrate_initialize(p);
 
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return 0;
 
 no_tmo:
 	transport_close(p->trp, &p->fda);
-no_tropen:
-no_timers:
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		if (fd[i] >= 0)
-			close(fd[i]);
-	}
+	port_clr_tmo(p, FD_ANNOUNCE_TIMER);
+	port_clr_tmo(p, FD_UNICAST_REQ_TIMER);
 	return -1;
 }
 
+/*
+ * Lets the transport drop the messages which port_ignore() or the
+ * handlers of the current state would drop anyway, before they are
+ * copied to user space.
+ */
+static void port_update_filter(struct port *p)
+{
+	struct transport_filter f;
+	struct ClockIdentity cid;
+
+	if (!p->rx_filter || p->fda.fd[FD_EVENT] < 0) {
+		return;
+	}
+	/* Transparent clocks forward the messages of all domains. */
+	switch (clock_type(p->clock)) {
+	case CLOCK_TYPE_ORDINARY:
+	case CLOCK_TYPE_BOUNDARY:
+		break;
+	default:
+		return;
+	}
+
+	memset(&f, 0, sizeof(f));
+	f.domain = clock_domain_number(p->clock);
+	f.tsp = p->match_transport_specific ? p->transportSpecific : -1;
+	cid = clock_identity(p->clock);
+	f.block = &cid;
+
+	switch (p->state) {
+	case PS_UNCALIBRATED:
+	case PS_SLAVE:
+		/* Requests of the NetSync Monitor are always unicast. */
+		f.drop_multicast = 1 << DELAY_REQ;
+		if (!p->ignore_source_id) {
+			f.parent_only = 1 << SYNC | 1 << FOLLOW_UP |
+					1 << DELAY_RESP;
+			f.parent = clock_parent_identity(p->clock);
+		}
+		break;
+	case PS_MASTER:
+	case PS_GRAND_MASTER:
+		f.drop = 1 << SYNC | 1 << FOLLOW_UP | 1 << DELAY_RESP;
+		break;
+	default:
+		f.drop = 1 << SYNC | 1 << FOLLOW_UP | 1 << DELAY_RESP;
+		f.drop_multicast = 1 << DELAY_REQ;
+		break;
+	}
+
+	if (transport_set_filter(p->trp, &p->fda, &f)) {
+		pr_warning("port %hu: failed to update the receive filter",
+			   portnum(p));
+	}
+}
+
 static int port_renew_transport(struct port *p)
 {
 	int res;
@@ -1796,12 +2173,16 @@ static int port_renew_transport(struct port *p)
 	if (!port_is_enabled(p)) {
 		return 0;
 	}
+	flush_tx_pending(p);
 	transport_close(p->trp, &p->fda);
 	port_clear_fda(p, FD_FIRST_TIMER);
 	res = transport_open(p->trp, p->iface, &p->fda, p->timestamping);
+	if (!res) {
+		port_update_filter(p);
+	}
 	/* Need to call clock_fda_changed even if transport_open failed in
 	 * order to update clock to the now closed descriptors. */
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return res;
 }
 
@@ -1811,7 +2192,6 @@ static int port_renew_transport(struct port *p)
 static int update_current_master(struct port *p, struct ptp_message *m)
 {
 	struct foreign_clock *fc = p->best;
-	struct ptp_message *tmp;
 	struct parent_ds *dad;
 	struct path_trace_tlv *ptt;
 	struct timePropertiesDS tds;
@@ -1833,12 +2213,9 @@ static int update_current_master(struct port *p, struct ptp_message *m)
 	}
 	port_set_announce_tmo(p);
 	fc_prune(fc);
-	msg_get(m);
-	fc->n_messages++;
-	TAILQ_INSERT_HEAD(&fc->messages, m, list);
-	if (fc->n_messages > 1) {
-		tmp = TAILQ_NEXT(m, list);
-		return announce_compare(m, tmp);
+	if (fc_update(fc, m)) {
+		p->best_dirty = 1;
+		return 1;
 	}
 	return 0;
 }
@@ -1967,6 +2344,17 @@ void process_delay_resp(struct port *p, struct ptp_message *m)
 	if (!req) {
 		return;
 	}
+	if (!msg_sots_valid(req)) {
+		/* Completed by port_tx_complete() once t3 arrives. */
+		pr_debug("port %hu: delay response before tx time stamp",
+			 portnum(p));
+		if (p->delay_resp) {
+			msg_put(p->delay_resp);
+		}
+		msg_get(m);
+		p->delay_resp = m;
+		return;
+	}
 
 	c3 = correction_to_tmv(m->header.correction);
 	t3 = req->hwts.ts;
@@ -2125,21 +2513,9 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 		rsp->header.flagField[0] |= UNICAST;
 	}
 
-	err = peer_prepare_and_send(p, rsp, event);
-	if (err) {
-		pr_err("port %hu: send peer delay response failed", portnum(p));
-		goto out;
-	}
-	if (p->timestamping == TS_P2P1STEP) {
-		goto out;
-	} else if (msg_sots_missing(rsp)) {
-		pr_err("missing timestamp on transmitted peer delay response");
-		err = -1;
-		goto out;
-	}
-
 	/*
-	 * Send the follow up message right away.
+	 * Prepare the follow up message, which is sent as soon as the
+	 * time stamp of the response arrives.
 	 */
 	fup->hwts.type = p->timestamping;
 
@@ -2155,17 +2531,21 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 
 	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
 
-	fup->pdelay_resp_fup.responseOriginTimestamp =
-		tmv_to_Timestamp(rsp->hwts.ts);
-
 	if (msg_unicast(m)) {
 		fup->address = m->address;
 		fup->header.flagField[0] |= UNICAST;
 	}
 
-	err = peer_prepare_and_send(p, fup, TRANS_GENERAL);
+	if (event == TRANS_EVENT) {
+		event = TRANS_DEFER_EVENT;
+	}
+	err = peer_prepare_and_send(p, rsp, event);
 	if (err) {
-		pr_err("port %hu: send pdelay_resp_fup failed", portnum(p));
+		pr_err("port %hu: send peer delay response failed", portnum(p));
+		goto out;
+	}
+	if (event == TRANS_DEFER_EVENT && !port_tx_park(p, rsp, fup)) {
+		err = -1;
 	}
 out:
 	msg_put(rsp);
@@ -2191,6 +2571,10 @@ static void port_peer_delay(struct port *p)
 	if (rsp->header.sequenceId != ntohs(req->header.sequenceId))
 		return;
 
+	/* The transmit time stamp completes this again. */
+	if (!msg_sots_valid(req))
+		return;
+
 	t1 = req->hwts.ts;
 	t4 = rsp->hwts.ts;
 	c1 = correction_to_tmv(rsp->header.correction + p->asymmetry);
@@ -2357,9 +2741,16 @@ void process_sync(struct port *p, struct ptp_message *m)
 
 void port_close(struct port *p)
 {
+	struct tx_pending *txp;
+
 	if (port_is_enabled(p)) {
 		port_disable(p);
 	}
+	flush_tx_pending(p);
+	while ((txp = TAILQ_FIRST(&p->tx_free)) != NULL) {
+		TAILQ_REMOVE(&p->tx_free, txp, list);
+		free(txp);
+	}
 
 	if (p->fda.fd[FD_RTNL] >= 0) {
 		rtnl_close(p->fda.fd[FD_RTNL]);
@@ -2367,11 +2758,11 @@ void port_close(struct port *p)
 
 	unicast_client_cleanup(p);
 	unicast_service_cleanup(p);
+	tc_cleanup(p);
+	foreign_masters_cleanup(p);
 	transport_destroy(p->trp);
 	tsproc_destroy(p->tsproc);
-	if (p->fault_fd >= 0) {
-		close(p->fault_fd);
-	}
+	port_clr_tmo(p, N_POLLFD);
 	free(p);
 }
 
@@ -2379,21 +2770,26 @@ struct foreign_clock *port_compute_best(struct port *p)
 {
 	int (*dscmp)(struct dataset *a, struct dataset *b);
 	struct foreign_clock *fc;
-	struct ptp_message *tmp;
+
+	/*
+	 * Unless an announce message arrived or aged out, only the
+	 * current best may have lost its qualification in the meantime.
+	 */
+	if (!p->best_dirty) {
+		if (p->best)
+			fc_prune(p->best);
+		if (!p->best_dirty)
+			return p->best;
+	}
 
 	dscmp = clock_dscmp(p->clock);
 	p->best = NULL;
+	p->best_dirty = 0;
 
 	if (p->master_only)
 		return p->best;
 
-	LIST_FOREACH(fc, &p->foreign_masters, list) {
-		tmp = TAILQ_FIRST(&fc->messages);
-		if (!tmp)
-			continue;
-
-		announce_to_dataset(tmp, p, &fc->dataset);
-
+	TAILQ_FOREACH(fc, &p->foreign_masters, lru) {
 		fc_prune(fc);
 
 		if (fc->n_messages < FOREIGN_MASTER_THRESHOLD)
@@ -2406,18 +2802,25 @@ struct foreign_clock *port_compute_best(struct port *p)
 		else
 			fc_clear(fc);
 	}
+	/* Clearing the losers does not change the result. */
+	p->best_dirty = 0;
 
 	return p->best;
 }
 
+int port_best_dirty(struct port *p)
+{
+	return p->best_dirty;
+}
+
 static void port_e2e_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_DELAY_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(p, FD_ANNOUNCE_TIMER);
+	port_clr_tmo(p, FD_SYNC_RX_TIMER);
+	port_clr_tmo(p, FD_DELAY_TIMER);
+	port_clr_tmo(p, FD_QUALIFICATION_TIMER);
+	port_clr_tmo(p, FD_MANNO_TIMER);
+	port_clr_tmo(p, FD_SYNC_TX_TIMER);
 	/* Leave FD_UNICAST_REQ_TIMER running. */
 
 	switch (next) {
@@ -2436,7 +2839,7 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
 		if (!p->inhibit_announce) {
-			set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+			set_tmo_log(p, FD_MANNO_TIMER, 1, -10); /*~1ms*/
 		}
 		port_set_sync_tx_tmo(p);
 		break;
@@ -2456,12 +2859,12 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 
 static void port_p2p_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(p, FD_ANNOUNCE_TIMER);
+	port_clr_tmo(p, FD_SYNC_RX_TIMER);
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(p, FD_QUALIFICATION_TIMER);
+	port_clr_tmo(p, FD_MANNO_TIMER);
+	port_clr_tmo(p, FD_SYNC_TX_TIMER);
 	/* Leave FD_UNICAST_REQ_TIMER running. */
 
 	switch (next) {
@@ -2481,7 +2884,7 @@ static void port_p2p_transition(struct port *p, enum port_state next)
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
 		if (!p->inhibit_announce) {
-			set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+			set_tmo_log(p, FD_MANNO_TIMER, 1, -10); /*~1ms*/
 		}
 		port_set_sync_tx_tmo(p);
 		break;
@@ -2599,99 +3002,294 @@ enum fsm_event port_event(struct port *p, int fd_index)
 	return p->event(p, fd_index);
 }
 
-static enum fsm_event bc_event(struct port *p, int fd_index)
+/*
+ * The looped back packet includes the lower layer headers. Locate the
+ * PTP header within it by means of the source port identity, and then
+ * match the message type and sequenceId. Both messages are in network
+ * byte order.
+ */
+static struct tx_pending *port_tx_match(struct port *p, unsigned char *pkt,
+					int len)
 {
-	enum fsm_event event = EV_NONE;
-	struct ptp_message *msg;
-	int cnt, fd = p->fda.fd[fd_index], err;
+	size_t offset = offsetof(struct ptp_header, sourcePortIdentity);
+	struct PortIdentity *pid = NULL;
+	struct ptp_header *hdr = NULL;
+	struct tx_pending *txp;
+	unsigned char *ptr;
 
-	switch (fd_index) {
-	case FD_ANNOUNCE_TIMER:
-	case FD_SYNC_RX_TIMER:
-		pr_debug("port %hu: %s timeout", portnum(p),
-			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
-		if (p->best) {
-			fc_clear(p->best);
+	TAILQ_FOREACH(txp, &p->tx_pending, list) {
+		/* Forwarded messages carry a foreign identity. */
+		if (!pid || memcmp(pid, &txp->msg->header.sourcePortIdentity,
+				   sizeof(*pid))) {
+			pid = &txp->msg->header.sourcePortIdentity;
+			ptr = memmem(pkt, len, pid, sizeof(*pid));
+			if (ptr && ptr >= pkt + offset &&
+			    ptr - offset + sizeof(*hdr) <= pkt + len) {
+				hdr = (struct ptp_header *) (ptr - offset);
+			} else {
+				hdr = NULL;
+			}
 		}
-
-		/*
-		 * Clear out the event returned by poll(). It is only cleared
-		 * in port_*_transition(). But, when BMCA == 'noop', there is no
-		 * state transition. So, it won't be cleared anywhere else.
-		 */
-		if (p->bmca == BMCA_NOOP) {
-			port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+		if (hdr && hdr->tsmt == txp->msg->header.tsmt &&
+		    hdr->sequenceId == txp->msg->header.sequenceId) {
+			return txp;
 		}
+	}
+	return NULL;
+}
 
-		if (p->inhibit_announce) {
-			port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-		} else {
-			port_set_announce_tmo(p);
-		}
+static int port_tx_complete(struct port *p, struct tx_pending *txp,
+			    struct ptp_message **batch, int *n)
+{
+	struct ptp_message *msg = txp->msg, *fup, *rsp;
+	int err;
 
-		delay_req_prune(p);
-		if (clock_slave_only(p->clock) && p->delayMechanism != DM_P2P &&
-		    port_renew_transport(p)) {
-			return EV_FAULT_DETECTED;
+	switch (msg_type(msg)) {
+	case SYNC:
+		fup = port_fup_msg(p, msg,
+				   msg_unicast(msg) ? &msg->address : NULL);
+		if (!fup) {
+			return -1;
 		}
-
-		if (p->inhibit_announce) {
-			return EV_NONE;
+		if (msg_unicast(fup)) {
+			batch[(*n)++] = fup;
+			return 0;
 		}
-		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
+		err = port_prepare_and_send(p, fup, TRANS_GENERAL);
+		if (err) {
+			pr_err("port %hu: send follow up failed", portnum(p));
+		}
+		msg_put(fup);
+		return err;
+	case PDELAY_RESP:
+		txp->fup->pdelay_resp_fup.responseOriginTimestamp =
+			tmv_to_Timestamp(msg->hwts.ts);
+		err = peer_prepare_and_send(p, txp->fup, TRANS_GENERAL);
+		if (err) {
+			pr_err("port %hu: send pdelay_resp_fup failed",
+			       portnum(p));
+		}
+		return err;
+	case PDELAY_REQ:
+		if (msg == p->peer_delay_req) {
+			port_peer_delay(p);
+		}
+		return 0;
+	case DELAY_REQ:
+		rsp = p->delay_resp;
+		if (rsp && rsp->delay_resp.hdr.sequenceId ==
+		    ntohs(msg->delay_req.hdr.sequenceId)) {
+			p->delay_resp = NULL;
+			process_delay_resp(p, rsp);
+			msg_put(rsp);
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
 
-	case FD_DELAY_TIMER:
-		pr_debug("port %hu: delay timeout", portnum(p));
-		port_set_delay_tmo(p);
-		delay_req_prune(p);
-		return port_delay_request(p) ? EV_FAULT_DETECTED : EV_NONE;
+static int port_tx_flush_fup(struct port *p, struct ptp_message **fup, int n)
+{
+	int err = 0;
 
-	case FD_QUALIFICATION_TIMER:
-		pr_debug("port %hu: qualification timeout", portnum(p));
-		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
+	if (n && port_send_batch(p, fup, n, TRANS_GENERAL) < n) {
+		pr_err("port %hu: send follow up failed", portnum(p));
+		err = -1;
+	}
+	port_put_batch(fup, n);
+	return err;
+}
 
-	case FD_MANNO_TIMER:
-		pr_debug("port %hu: master tx announce timeout", portnum(p));
-		port_set_manno_tmo(p);
-		return port_tx_announce(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
+/*
+ * Hands the transmit time stamps of forwarded event messages over to
+ * the transparent clock. This runs only after the error queue has been
+ * drained, since a failure to forward disables the port.
+ */
+static void port_tx_flush_fwd(struct port *p, struct txp *done)
+{
+	struct tx_pending *txp;
 
-	case FD_SYNC_TX_TIMER:
-		pr_debug("port %hu: master sync timeout", portnum(p));
-		port_set_sync_tx_tmo(p);
-		return port_tx_sync(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
+	while ((txp = TAILQ_FIRST(done)) != NULL) {
+		TAILQ_REMOVE(done, txp, list);
+		if (port_is_enabled(p)) {
+			tc_fwd_complete(txp->ingress, p, txp->msg,
+					txp->ingress_ts, txp->egress_ts);
+		}
+		msg_put(txp->msg);
+		TAILQ_INSERT_HEAD(&p->tx_free, txp, list);
+	}
+}
 
-	case FD_UNICAST_SRV_TIMER:
-		pr_debug("port %hu: unicast service timeout", portnum(p));
-		return unicast_service_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+enum fsm_event port_tx_event(struct port *p, int fd_index)
+{
+	struct txp done = TAILQ_HEAD_INITIALIZER(done);
+	struct ptp_message *fup[SK_TX_BATCH_MAX];
+	int cnt, err = 0, nfup = 0, nts = 0;
+	unsigned char pkt[TX_PKT_LEN];
+	struct tx_pending *txp;
+	struct hw_timestamp hwts;
 
-	case FD_UNICAST_REQ_TIMER:
-		pr_debug("port %hu: unicast request timeout", portnum(p));
-		return unicast_client_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+	hwts.type = p->timestamping;
 
-	case FD_RTNL:
-		pr_debug("port %hu: received link status notification", portnum(p));
-		rtnl_link_status(fd, p->name, port_link_status, p);
-		if (p->link_status == (LINK_UP | LINK_STATE_CHANGED))
-			return EV_FAULT_CLEARED;
-		else if ((p->link_status == (LINK_DOWN | LINK_STATE_CHANGED)) ||
-			 (p->link_status & TS_LABEL_CHANGED))
-			return EV_FAULT_DETECTED;
-		else
-			return EV_NONE;
+	while ((cnt = transport_txts_recv(&p->fda, fd_index, pkt, sizeof(pkt),
+					  &hwts)) > 0) {
+		nts++;
+		if (tmv_is_zero(hwts.ts)) {
+			continue;
+		}
+		txp = port_tx_match(p, pkt, cnt);
+		if (!txp) {
+			pr_debug("port %hu: unmatched tx time stamp",
+				 portnum(p));
+			continue;
+		}
+		ts_add(&hwts.ts, p->tx_timestamp_offset);
+		if (txp->ingress) {
+			/* The message is shared by all of the egress ports. */
+			txp->egress_ts = hwts.ts;
+			TAILQ_REMOVE(&p->tx_pending, txp, list);
+			TAILQ_INSERT_TAIL(&done, txp, list);
+			continue;
+		}
+		txp->msg->hwts.ts = hwts.ts;
+		if (port_tx_complete(p, txp, fup, &nfup)) {
+			err = -1;
+		}
+		port_tx_release(p, txp);
+		if (nfup == SK_TX_BATCH_MAX) {
+			err |= port_tx_flush_fup(p, fup, nfup);
+			nfup = 0;
+		}
 	}
+	err |= port_tx_flush_fup(p, fup, nfup);
 
-	msg = msg_allocate();
-	if (!msg)
+	if (TAILQ_EMPTY(&p->tx_pending)) {
+		port_clr_tmo(p, FD_TXTS_TIMER);
+	}
+	port_tx_flush_fwd(p, &done);
+
+	/* An empty error queue means a real socket error. */
+	if (cnt < 0 || !nts) {
+		pr_err("port %hu: unexpected socket error", portnum(p));
 		return EV_FAULT_DETECTED;
+	}
+	return err ? EV_FAULT_DETECTED : EV_NONE;
+}
 
-	msg->hwts.type = p->timestamping;
+enum fsm_event port_tx_timeout(struct port *p)
+{
+	struct tx_pending *txp;
+	int64_t now = port_tx_now();
+	int expired = 0;
 
-	cnt = transport_recv(p->trp, fd, msg);
-	if (cnt < 0) {
-		pr_err("port %hu: recv message failed", portnum(p));
-		msg_put(msg);
+	while ((txp = TAILQ_FIRST(&p->tx_pending)) != NULL &&
+	       txp->deadline <= now) {
+		pr_err("port %hu: timed out waiting for tx timestamp of %s",
+		       portnum(p), msg_type_string(msg_type(txp->msg)));
+		port_tx_release(p, txp);
+		expired++;
+	}
+	if (expired) {
+		pr_err("increasing tx_timestamp_timeout may correct "
+		       "this issue, but it is likely caused by a driver bug");
+		return EV_FAULT_DETECTED;
+	}
+	if (txp) {
+		port_set_tmo(p, FD_TXTS_TIMER, txp->deadline - now);
+	}
+	return EV_NONE;
+}
+
+int port_tx_forward(struct port *p, struct port *q, struct ptp_message *msg,
+		    tmv_t ingress)
+{
+	struct tx_pending *txp;
+
+	txp = port_tx_park(p, msg, NULL);
+	if (!txp) {
+		return -1;
+	}
+	txp->ingress = q;
+	txp->ingress_ts = ingress;
+	return 0;
+}
+
+enum fsm_event port_recv(struct port *p, int fd_index,
+			 enum fsm_event (*rx)(struct port *p,
+					      struct ptp_message *msg, int cnt))
+{
+	int cnt[SK_RX_BATCH_MAX], fd = p->fda.fd[fd_index], i, n, num;
+	struct ptp_message *msg[SK_RX_BATCH_MAX];
+	enum fsm_event event = EV_NONE, ev;
+
+	for (n = 0; n < p->rx_batch_size; n++) {
+		msg[n] = msg_allocate();
+		if (!msg[n]) {
+			break;
+		}
+		msg[n]->hwts.type = p->timestamping;
+	}
+	if (!n) {
 		return EV_FAULT_DETECTED;
 	}
+
+	num = transport_recv_batch(p->trp, fd, msg, cnt, n);
+	if (num == -EAGAIN) {
+		/* A packet ring may wake us up for a block already read. */
+		num = 0;
+	} else if (num < 0) {
+		pr_err("port %hu: recv message failed", portnum(p));
+		num = 0;
+		event = EV_FAULT_DETECTED;
+	}
+	for (i = 0; i < num; i++) {
+		/*
+		 * Once the port has faulted or replaced its descriptors,
+		 * the rest of the batch is stale.
+		 */
+		if (event == EV_FAULT_DETECTED || p->fda.fd[fd_index] != fd) {
+			msg_put(msg[i]);
+			continue;
+		}
+		if (cnt[i] < 0) {
+			pr_err("port %hu: recv message failed", portnum(p));
+			msg_put(msg[i]);
+			event = EV_FAULT_DETECTED;
+			continue;
+		}
+		/*
+		 * Merge the events of the batch. A fault ends the batch, and
+		 * one state decision covers all of the messages, as it is
+		 * taken over all of the ports. Anything else is dispatched
+		 * before the next message is handled.
+		 */
+		ev = rx(p, msg[i], cnt[i]);
+		switch (ev) {
+		case EV_NONE:
+			break;
+		case EV_FAULT_DETECTED:
+		case EV_STATE_DECISION_EVENT:
+			if (event != EV_FAULT_DETECTED) {
+				event = ev;
+			}
+			break;
+		default:
+			port_dispatch(p, ev, 0);
+			break;
+		}
+	}
+	for (i = num; i < n; i++) {
+		msg_put(msg[i]);
+	}
+	return event;
+}
+
+static enum fsm_event bc_rx(struct port *p, struct ptp_message *msg, int cnt)
+{
+	enum fsm_event event = EV_NONE;
+	int err;
+
 	err = msg_post_recv(msg, cnt);
 	if (err) {
 		switch (err) {
@@ -2766,6 +3364,92 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 	return event;
 }
 
+static enum fsm_event bc_event(struct port *p, int fd_index)
+{
+	int fd = p->fda.fd[fd_index];
+
+	switch (fd_index) {
+	case FD_ANNOUNCE_TIMER:
+	case FD_SYNC_RX_TIMER:
+		pr_debug("port %hu: %s timeout", portnum(p),
+			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
+		if (p->best) {
+			fc_clear(p->best);
+		}
+
+		/*
+		 * Clear out the event returned by poll(). It is only cleared
+		 * in port_*_transition(). But, when BMCA == 'noop', there is no
+		 * state transition. So, it won't be cleared anywhere else.
+		 */
+		if (p->bmca == BMCA_NOOP) {
+			port_clr_tmo(p, FD_SYNC_RX_TIMER);
+		}
+
+		if (p->inhibit_announce) {
+			port_clr_tmo(p, FD_ANNOUNCE_TIMER);
+		} else {
+			port_set_announce_tmo(p);
+		}
+
+		delay_req_prune(p);
+		if (clock_slave_only(p->clock) && p->delayMechanism != DM_P2P &&
+		    port_renew_transport(p)) {
+			return EV_FAULT_DETECTED;
+		}
+
+		if (p->inhibit_announce) {
+			return EV_NONE;
+		}
+		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
+
+	case FD_DELAY_TIMER:
+		pr_debug("port %hu: delay timeout", portnum(p));
+		port_set_delay_tmo(p);
+		delay_req_prune(p);
+		return port_delay_request(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_QUALIFICATION_TIMER:
+		pr_debug("port %hu: qualification timeout", portnum(p));
+		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
+
+	case FD_MANNO_TIMER:
+		pr_debug("port %hu: master tx announce timeout", portnum(p));
+		port_set_manno_tmo(p);
+		return port_tx_announce(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_SYNC_TX_TIMER:
+		pr_debug("port %hu: master sync timeout", portnum(p));
+		port_set_sync_tx_tmo(p);
+		return port_tx_sync(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_UNICAST_SRV_TIMER:
+		pr_debug("port %hu: unicast service timeout", portnum(p));
+		return unicast_service_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_UNICAST_REQ_TIMER:
+		pr_debug("port %hu: unicast request timeout", portnum(p));
+		return unicast_client_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_TXTS_TIMER:
+		return port_tx_timeout(p);
+
+	case FD_RTNL:
+		pr_debug("port %hu: received link status notification", portnum(p));
+		rtnl_link_status(fd, p->name, port_link_status, p);
+		if (p->link_status == (LINK_UP | LINK_STATE_CHANGED))
+			return EV_FAULT_CLEARED;
+		else if ((p->link_status == (LINK_DOWN | LINK_STATE_CHANGED)) ||
+			 (p->link_status & TS_LABEL_CHANGED))
+			return EV_FAULT_DETECTED;
+		else
+			return EV_NONE;
+	}
+
+	return port_recv(p, fd_index, bc_rx);
+}
+
+
 int port_forward(struct port *p, struct ptp_message *msg)
 {
 	int cnt;
@@ -3017,6 +3701,11 @@ struct port *port_open(const char *phc_device,
 
 	memset(p, 0, sizeof(*p));
 	TAILQ_INIT(&p->tc_transmitted);
+	TAILQ_INIT(&p->tc_free);
+	TAILQ_INIT(&p->foreign_masters);
+	TAILQ_INIT(&p->fm_free);
+	TAILQ_INIT(&p->tx_pending);
+	TAILQ_INIT(&p->tx_free);
 
 	switch (type) {
 	case CLOCK_TYPE_ORDINARY:
@@ -3037,10 +3726,14 @@ struct port *port_open(const char *phc_device,
 	}
 
 	p->phc_index = phc_index;
-	p->jbod = config_get_int(cfg, interface_name(interface), "boundary_clock_jbod");
-	transport = config_get_int(cfg, interface_name(interface), "network_transport");
-	p->master_only = config_get_int(cfg, interface_name(interface), "masterOnly");
-	p->bmca = config_get_int(cfg, interface_name(interface), "BMCA");
+	p->cfg_section = config_section(cfg, interface_name(interface));
+	if (p->cfg_section < 0) {
+		goto err_port;
+	}
+	p->jbod = config_int(cfg, p->cfg_section, CFG_BOUNDARY_CLOCK_JBOD);
+	transport = config_int(cfg, p->cfg_section, CFG_NETWORK_TRANSPORT);
+	p->master_only = config_int(cfg, p->cfg_section, CFG_MASTER_ONLY);
+	p->bmca = config_int(cfg, p->cfg_section, CFG_BMCA);
 
 	if (p->bmca == BMCA_NOOP && transport != TRANS_UDS) {
 		if (p->master_only) {
@@ -3081,18 +3774,26 @@ struct port *port_open(const char *phc_device,
 
 	p->name = interface_name(interface);
 	p->iface = interface;
-	p->asymmetry = config_get_int(cfg, p->name, "delayAsymmetry");
+	p->asymmetry = config_int(cfg, p->cfg_section, CFG_DELAY_ASYMMETRY);
 	p->asymmetry <<= 16;
 	p->announce_span = transport == TRANS_UDS ? 0 : ANNOUNCE_SPAN;
-	p->follow_up_info = config_get_int(cfg, p->name, "follow_up_info");
-	p->freq_est_interval = config_get_int(cfg, p->name, "freq_est_interval");
-	p->msg_interval_request = config_get_int(cfg, p->name, "msg_interval_request");
-	p->net_sync_monitor = config_get_int(cfg, p->name, "net_sync_monitor");
-	p->path_trace_enabled = config_get_int(cfg, p->name, "path_trace_enabled");
-	p->tc_spanning_tree = config_get_int(cfg, p->name, "tc_spanning_tree");
-	p->rx_timestamp_offset = config_get_int(cfg, p->name, "ingressLatency");
+	p->follow_up_info = config_int(cfg, p->cfg_section, CFG_FOLLOW_UP_INFO);
+	p->freq_est_interval =
+		config_int(cfg, p->cfg_section, CFG_FREQ_EST_INTERVAL);
+	p->msg_interval_request =
+		config_int(cfg, p->cfg_section, CFG_MSG_INTERVAL_REQUEST);
+	p->net_sync_monitor =
+		config_int(cfg, p->cfg_section, CFG_NET_SYNC_MONITOR);
+	p->path_trace_enabled =
+		config_int(cfg, p->cfg_section, CFG_PATH_TRACE_ENABLED);
+	p->tc_spanning_tree =
+		config_int(cfg, p->cfg_section, CFG_TC_SPANNING_TREE);
+	p->rx_batch_size = config_int(cfg, p->cfg_section, CFG_RX_BATCH_SIZE);
+	p->rx_timestamp_offset =
+		config_int(cfg, p->cfg_section, CFG_INGRESS_LATENCY);
 	p->rx_timestamp_offset <<= 16;
-	p->tx_timestamp_offset = config_get_int(cfg, p->name, "egressLatency");
+	p->tx_timestamp_offset =
+		config_int(cfg, p->cfg_section, CFG_EGRESS_LATENCY);
 	p->tx_timestamp_offset <<= 16;
 	p->link_status = LINK_UP;
 	p->clock = clock;
@@ -3104,7 +3805,8 @@ struct port *port_open(const char *phc_device,
 	p->portIdentity.clockIdentity = clock_identity(clock);
 	p->portIdentity.portNumber = number;
 	p->state = PS_INITIALIZING;
-	p->delayMechanism = config_get_int(cfg, p->name, "delay_mechanism");
+	p->delayMechanism =
+		config_int(cfg, p->cfg_section, CFG_DELAY_MECHANISM);
 	p->versionNumber = PTP_VERSION;
 	p->slave_event_monitor = clock_slave_monitor(clock);
 
@@ -3118,7 +3820,7 @@ struct port *port_open(const char *phc_device,
 	if (number && unicast_service_initialize(p)) {
 		goto err_uc_client;
 	}
-	p->hybrid_e2e = config_get_int(cfg, p->name, "hybrid_e2e");
+	p->hybrid_e2e = config_int(cfg, p->cfg_section, CFG_HYBRID_E2E);
 
 	if (number && type == CLOCK_TYPE_P2P && p->delayMechanism != DM_P2P) {
 		pr_err("port %d: P2P TC needs P2P ports", number);
@@ -3134,6 +3836,13 @@ struct port *port_open(const char *phc_device,
 	if (p->net_sync_monitor && !p->hybrid_e2e) {
 		pr_warning("port %d: net_sync_monitor needs hybrid_e2e", number);
 	}
+	if (number && (type == CLOCK_TYPE_P2P || type == CLOCK_TYPE_E2E) &&
+	    tc_init(p)) {
+		goto err_uc_service;
+	}
+	if (number && foreign_masters_init(p)) {
+		goto err_tc;
+	}
 
 	/* Set fault timeouts to a default value */
 	for (i = 0; i < FT_CNT; i++) {
@@ -3142,33 +3851,28 @@ struct port *port_open(const char *phc_device,
 	}
 	p->flt_interval_pertype[FT_BAD_PEER_NETWORK].type = FTMO_LINEAR_SECONDS;
 	p->flt_interval_pertype[FT_BAD_PEER_NETWORK].val =
-		config_get_int(cfg, p->name, "fault_badpeernet_interval");
+		config_int(cfg, p->cfg_section, CFG_FAULT_BADPEERNET_INTERVAL);
 
 	p->flt_interval_pertype[FT_UNSPECIFIED].val =
-		config_get_int(cfg, p->name, "fault_reset_interval");
+		config_int(cfg, p->cfg_section, CFG_FAULT_RESET_INTERVAL);
 
-	p->tsproc = tsproc_create(config_get_int(cfg, p->name, "tsproc_mode"),
-				  config_get_int(cfg, p->name, "delay_filter"),
-				  config_get_int(cfg, p->name, "delay_filter_length"));
+	p->tsproc = tsproc_create(
+		config_int(cfg, p->cfg_section, CFG_TSPROC_MODE),
+		config_int(cfg, p->cfg_section, CFG_DELAY_FILTER),
+		config_int(cfg, p->cfg_section, CFG_DELAY_FILTER_LENGTH));
 	if (!p->tsproc) {
 		pr_err("Failed to create time stamp processor");
-		goto err_uc_service;
+		goto err_fm;
 	}
 	p->nrate.ratio = 1.0;
 
 	port_clear_fda(p, N_POLLFD);
-	p->fault_fd = -1;
-	if (number) {
-		p->fault_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (p->fault_fd < 0) {
-			pr_err("timerfd_create failed: %m");
-			goto err_tsproc;
-		}
-	}
 	return p;
 
-err_tsproc:
-	tsproc_destroy(p->tsproc);
+err_fm:
+	foreign_masters_cleanup(p);
+err_tc:
+	tc_cleanup(p);
 err_uc_service:
 	unicast_service_cleanup(p);
 err_uc_client:
@@ -3185,6 +3889,19 @@ enum port_state port_state(struct port *port)
 	return port->state;
 }
 
+void port_status(struct port *port, struct shm_status_port *status)
+{
+	status->portIdentity = port->portIdentity;
+	if (port->state == PS_GRAND_MASTER)
+		status->state = PS_MASTER;
+	else
+		status->state = port->state;
+	status->timestamping = port->timestamping;
+	strncpy(status->interface, interface_label(port->iface),
+		sizeof(status->interface) - 1);
+	status->interface[sizeof(status->interface) - 1] = '\0';
+}
+
 int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 {
 	enum port_state next = p->state_machine(p->state, event, mdiff);
@@ -3221,10 +3938,15 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 	if (next != p->state) {
 		port_show_transition(p, next, event);
 		p->state = next;
+		port_update_filter(p);
 		port_notify_event(p, NOTIFY_PORT_STATE);
 		unicast_client_state_changed(p);
 		return 1;
 	}
+	if (mdiff) {
+		/* The parent may have changed. */
+		port_update_filter(p);
+	}
 
 	return 0;
 }
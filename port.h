@@ -29,6 +29,8 @@
 /* forward declarations */
 struct interface;
 struct clock;
+struct shm_status_port;
+struct twheel_timer;
 
 /** Opaque type. */
 struct port;
@@ -58,13 +60,24 @@ void port_close(struct port *port);
 /**
  * Computes the 'best' foreign master discovered on a port. This has
  * the side effect of updating the 'dataset' field of the returned
- * foreign master.
+ * foreign master. The result is cached, and the foreign masters are
+ * only compared again after they changed.
  *
  * @param port A pointer previously obtained via port_open().
  * @return A pointer to the port's best foreign master, or NULL.
  */
 struct foreign_clock *port_compute_best(struct port *port);
 
+/**
+ * Tell whether the foreign masters of a port changed since the last
+ * call to port_compute_best(), so that its result may differ.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return     One if the best foreign master must be computed again,
+ *             zero otherwise.
+ */
+int port_best_dirty(struct port *port);
+
 /**
  * Dispatch a port event. This may cause a state transition on the
  * port, with the associated side effect.
@@ -85,6 +98,17 @@ void port_dispatch(struct port *p, enum fsm_event event, int mdiff);
  */
 enum fsm_event port_event(struct port *port, int fd_index);
 
+/**
+ * Completes the event messages whose transmit time stamps have arrived
+ * on the error queue of one of a port's file descriptors. This sends
+ * the pending follow up messages.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @param fd_index The index of the file descriptor with a pending error.
+ * @return One of the @a fsm_event codes.
+ */
+enum fsm_event port_tx_event(struct port *port, int fd_index);
+
 /**
  * Forward a message on a given port.
  * @param port    A pointer previously obtained via port_open().
@@ -220,6 +244,13 @@ struct ptp_message *port_signaling_construct(struct port *p,
  */
 enum port_state port_state(struct port *port);
 
+/**
+ * Fill in the status of a port for publication.
+ * @param port    A port instance.
+ * @param status  Returns the status.
+ */
+void port_status(struct port *port, struct shm_status_port *status);
+
 /**
  * Update a port's current state based on a given event.
  * @param p        A pointer previously obtained via port_open().
@@ -230,8 +261,8 @@ enum port_state port_state(struct port *port);
 int port_state_update(struct port *p, enum fsm_event event, int mdiff);
 
 /**
- * Return array of file descriptors for this port. The fault fd is not
- * included.
+ * Return array of file descriptors for this port. The timers are not
+ * included, see port_timer().
  * @param port	A port instance
  * @return	Array of file descriptors. Unused descriptors are guranteed
  *		to be set to -1.
@@ -239,58 +270,66 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff);
 struct fdarray *port_fda(struct port *port);
 
 /**
- * Return file descriptor of the port.
+ * Return one of the timers of the port.
  * @param port	A port instance.
- * @return	File descriptor or -1 if not applicable.
+ * @param index	One of the FD_xxx_TIMER values, or N_POLLFD for the
+ *		fault timer.
+ * @return	The timer, or NULL if the index does not denote a timer.
  */
-int port_fault_fd(struct port *port);
+struct twheel_timer *port_timer(struct port *port, int index);
 
 /**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a port timer.
  *
- * This function sets the timer 'fd' to the value M(2^N), where M is
+ * This function sets the timer 'index' to the value M(2^N), where M is
  * the value of the 'scale' parameter and N in the value of the
  * 'log_seconds' parameter.
  *
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param p A port instance.
+ * @param index The timer, as accepted by port_timer().
  * @param scale The multiplicative factor for the timer.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_log(int fd, unsigned int scale, int log_seconds);
+int set_tmo_log(struct port *p, int index, unsigned int scale, int log_seconds);
 
 /**
- * Utility function for setting a file descriptor timer.
+ * Utility function for setting a port timer.
  *
- * This function sets the timer 'fd' to a random value between M * 2^N and
- * (M + S) * 2^N, where M is the value of the 'min' parameter, S is the value
- * of the 'span' parameter, and N in the value of the 'log_seconds' parameter.
+ * This function sets the timer 'index' to a random value between M * 2^N
+ * and (M + S) * 2^N, where M is the value of the 'min' parameter, S is the
+ * value of the 'span' parameter, and N in the value of the 'log_seconds'
+ * parameter.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param p A port instance.
+ * @param index The timer, as accepted by port_timer().
  * @param min The minimum value for the timer.
  * @param span The span value for the timer. Must be a positive value.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_random(int fd, int min, int span, int log_seconds);
+int set_tmo_random(struct port *p, int index, int min, int span,
+		   int log_seconds);
 
 /**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a port timer.
  *
- * This function sets the timer 'fd' to the value of the 'seconds' parameter.
+ * This function sets the timer 'index' to the value of the 'seconds'
+ * parameter.
  *
  * Passing 'seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param p A port instance.
+ * @param index The timer, as accepted by port_timer().
  * @param seconds The timeout value for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_lin(int fd, int seconds);
+int set_tmo_lin(struct port *p, int index, int seconds);
 
 /**
- * Sets port's fault file descriptor timer.
+ * Sets port's fault timer.
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
  * @param fd		A port instance.
@@ -302,7 +341,7 @@ int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds);
 
 /**
- * Sets port's fault file descriptor timer.
+ * Sets port's fault timer.
  * Passing 'seconds' as zero disables the timer.
  *
  * @param fd		A port instance.
@@ -338,9 +377,4 @@ void fault_interval(struct port *port, enum fault_type ft,
  */
 enum bmca_select port_bmca(struct port *p);
 
-/**
- * Release all of the memory in the TC transmit descriptor cache.
- */
-void tc_cleanup(void);
-
 #endif
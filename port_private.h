@@ -27,6 +27,7 @@
 #include "monitor.h"
 #include "msg.h"
 #include "tmv.h"
+#include "twheel.h"
 
 #define NSEC2SEC 1000000000LL
 
@@ -52,22 +53,64 @@ struct nrate_estimator {
 	int ratio_valid;
 };
 
+/*
+ * Accounting of the preallocated records of a transparent clock port.
+ */
+struct tc_stats {
+	unsigned int records;
+	unsigned int in_use;
+	unsigned int high_water;
+	unsigned int evicted;	/* oldest records reused */
+	unsigned int dropped;	/* new records refused */
+};
+
+/*
+ * Accounting of the preallocated foreign master records of a port.
+ */
+struct fm_stats {
+	unsigned int records;
+	unsigned int in_use;
+	unsigned int high_water;
+	unsigned int evicted;	/* least recently heard masters replaced */
+	unsigned int dropped;	/* new masters refused */
+};
+
 struct tc_txd {
 	TAILQ_ENTRY(tc_txd) list;
+	LIST_ENTRY(tc_txd) hash;
 	struct ptp_message *msg;
 	tmv_t residence;
 	int ingress_port;
+	int egress_port;
+};
+
+/*
+ * An event message waiting for its transmit time stamp. Once the time
+ * stamp arrives on the error queue, the follow up, if any, is sent.
+ * Messages forwarded by a transparent clock are completed by tc.c.
+ */
+struct tx_pending {
+	TAILQ_ENTRY(tx_pending) list;
+	struct ptp_message *msg;
+	struct ptp_message *fup;
+	int64_t deadline;	/* CLOCK_MONOTONIC, in nanoseconds */
+	struct port *ingress;	/* ingress port of a forwarded message */
+	tmv_t ingress_ts;
+	tmv_t egress_ts;
 };
 
 struct port {
 	LIST_ENTRY(port) list;
 	const char *name;
+	int cfg_section;
 	struct interface *iface;
 	struct clock *clock;
 	struct transport *trp;
 	enum timestamp_type timestamping;
 	struct fdarray fda;
-	int fault_fd;
+	int rx_batch_size;
+	struct twheel_timer timer[N_TIMER_FDS];
+	struct twheel_timer fault_timer;
 	int phc_index;
 	int phc_from_cmdline;
 
@@ -76,9 +119,11 @@ struct port {
 
 	int jbod;
 	struct foreign_clock *best;
+	int best_dirty; /* foreign masters changed since port_compute_best() */
 	enum syfu_state syfu;
 	struct ptp_message *last_syncfup;
 	TAILQ_HEAD(delay_req, ptp_message) delay_req;
+	struct ptp_message *delay_resp; /* arrived before the t3 time stamp */
 	struct ptp_message *peer_delay_req;
 	struct ptp_message *peer_delay_resp;
 	struct ptp_message *peer_delay_fup;
@@ -102,6 +147,7 @@ struct port {
 	int bmca;
 	int inhibit_announce;
 	int ignore_source_id;
+	int rx_filter;
 	int inhibit_delay_req;
 	/* portDS */
 	struct PortIdentity portIdentity;
@@ -144,9 +190,21 @@ struct port {
 	unsigned int        versionNumber; /*UInteger4*/
 	struct PortStats    stats;
 	/* foreignMasterDS */
-	LIST_HEAD(fm, foreign_clock) foreign_masters;
+	TAILQ_HEAD(fml, foreign_clock) foreign_masters;
+	struct fml fm_free;
+	LIST_HEAD(fm, foreign_clock) *fm_hash;
+	unsigned int fm_hash_mask;
+	struct foreign_clock *fm_arena;
+	struct fm_stats fm_stats;
 	/* TC book keeping */
 	TAILQ_HEAD(tct, tc_txd) tc_transmitted;
+	struct tct tc_free;
+	struct tc_txd *tc_arena;
+	struct tc_stats tc_stats;
+	int tc_evict_oldest;
+	/* transmit time stamps in flight */
+	TAILQ_HEAD(txp, tx_pending) tx_pending;
+	TAILQ_HEAD(txf, tx_pending) tx_free;
 	/* unicast client mode */
 	struct unicast_master_table *unicast_master_table;
 	/* unicast service mode */
@@ -170,7 +228,10 @@ void fc_clear(struct foreign_clock *fc);
 void flush_delay_req(struct port *p);
 void flush_last_sync(struct port *p);
 int port_capable(struct port *p);
-int port_clr_tmo(int fd);
+int port_clr_tmo(struct port *p, int index);
+enum fsm_event port_recv(struct port *p, int fd_index,
+			 enum fsm_event (*rx)(struct port *p,
+					      struct ptp_message *msg, int cnt));
 int port_delay_request(struct port *p);
 void port_disable(struct port *p);
 int port_initialize(struct port *p);
@@ -185,11 +246,16 @@ struct ptp_message *port_signaling_uc_construct(struct port *p,
 						struct address *address,
 						struct PortIdentity *tpid);
 int port_tx_announce(struct port *p, struct address *dst);
+int port_tx_announce_batch(struct port *p, struct address **dst, int n);
+int port_tx_forward(struct port *p, struct port *q, struct ptp_message *msg,
+		    tmv_t ingress);
 int port_tx_interval_request(struct port *p,
 			     Integer8 announceInterval,
 			     Integer8 timeSyncInterval,
 			     Integer8 linkDelayInterval);
 int port_tx_sync(struct port *p, struct address *dst);
+int port_tx_sync_batch(struct port *p, struct address **dst, int n);
+enum fsm_event port_tx_timeout(struct port *p);
 int process_announce(struct port *p, struct ptp_message *m);
 void process_delay_resp(struct port *p, struct ptp_message *m);
 void process_follow_up(struct port *p, struct ptp_message *m);
@@ -16,19 +16,57 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "print.h"
 
+#define PRINT_BUF_SIZE	1024
+
+/*
+ * In the asynchronous mode, the messages are formatted by the caller
+ * into the slots of a bounded ring, and a writer thread passes them
+ * on to the standard output and the system log. A full ring drops the
+ * message rather than blocking the caller.
+ *
+ * The ring is a bounded multi producer queue in which each slot carries
+ * a sequence number. A slot is free for the producer at position 'pos'
+ * when its sequence equals 'pos', and ready for the writer when it
+ * equals 'pos + 1'.
+ */
+#define PRINT_RING_SIZE	256	/* must be a power of two */
+
+struct print_slot {
+	unsigned long seq;
+	int level;
+	struct timespec ts;
+	char buf[PRINT_BUF_SIZE];	/* as in the synchronous mode */
+};
+
+struct print_ring {
+	unsigned long head;	/* next position to be claimed */
+	unsigned long tail;	/* next position to be written out */
+	unsigned long dropped;
+	int sleeping;
+	int stop;
+	int efd;
+	pthread_t writer;
+	struct print_slot slot[PRINT_RING_SIZE];
+};
+
 static int verbose = 0;
 static int print_level = LOG_INFO;
 static int use_syslog = 1;
 static const char *progname;
 static const char *message_tag;
+static struct print_ring *ring;
 
 void print_set_progname(const char *name)
 {
@@ -55,35 +93,193 @@ void print_set_verbose(int value)
 	verbose = value ? 1 : 0;
 }
 
-void print(int level, char const *format, ...)
+static void print_emit(int level, struct timespec *ts, const char *buf)
 {
-	struct timespec ts;
-	va_list ap;
-	char buf[1024];
 	FILE *f;
 
-	if (level > print_level)
-		return;
-
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-
-	va_start(ap, format);
-	vsnprintf(buf, sizeof(buf), format, ap);
-	va_end(ap);
-
 	if (verbose) {
 		f = level >= LOG_NOTICE ? stdout : stderr;
 		fprintf(f, "%s[%lld.%03ld]: %s%s%s\n",
 			progname ? progname : "",
-			(long long)ts.tv_sec, ts.tv_nsec / 1000000,
+			(long long)ts->tv_sec, ts->tv_nsec / 1000000,
 			message_tag ? message_tag : "", message_tag ? " " : "",
 			buf);
 		fflush(f);
 	}
 	if (use_syslog) {
 		syslog(level, "[%lld.%03ld] %s%s%s",
-		       (long long)ts.tv_sec, ts.tv_nsec / 1000000,
+		       (long long)ts->tv_sec, ts->tv_nsec / 1000000,
 		       message_tag ? message_tag : "", message_tag ? " " : "",
 		       buf);
 	}
 }
+
+static void print_ring_push(int level, struct timespec *ts,
+			    char const *format, va_list ap)
+{
+	unsigned long pos, seq;
+	struct print_slot *s;
+	uint64_t one = 1;
+
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	for (;;) {
+		s = &ring->slot[pos & (PRINT_RING_SIZE - 1)];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos,
+							pos + 1, 0,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if ((long)(seq - pos) < 0) {
+			/* The writer is behind by a full ring. */
+			__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+	s->level = level;
+	s->ts = *ts;
+	vsnprintf(s->buf, sizeof(s->buf), format, ap);
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+
+	/* Only wake the writer when it went to sleep. */
+	if (__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST)) {
+		if (write(ring->efd, &one, sizeof(one)) < 0) {
+			; /* The writer wakes up on the next message. */
+		}
+	}
+}
+
+static int print_ring_ready(void)
+{
+	struct print_slot *s = &ring->slot[ring->tail & (PRINT_RING_SIZE - 1)];
+
+	return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) == ring->tail + 1;
+}
+
+static void *print_writer(void *arg)
+{
+	unsigned long dropped, reported = 0;
+	struct print_slot *s;
+	struct timespec ts;
+	char buf[64];
+	uint64_t cnt;
+
+	for (;;) {
+		while (print_ring_ready()) {
+			s = &ring->slot[ring->tail & (PRINT_RING_SIZE - 1)];
+			print_emit(s->level, &s->ts, s->buf);
+			__atomic_store_n(&s->seq, ring->tail + PRINT_RING_SIZE,
+					 __ATOMIC_RELEASE);
+			ring->tail++;
+		}
+		dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+		if (dropped != reported) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			snprintf(buf, sizeof(buf), "dropped %lu log messages",
+				 dropped - reported);
+			print_emit(LOG_WARNING, &ts, buf);
+			reported = dropped;
+		}
+		if (__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (print_ring_ready() ||
+		    __atomic_load_n(&ring->stop, __ATOMIC_SEQ_CST)) {
+			__atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (read(ring->efd, &cnt, sizeof(cnt)) < 0) {
+			; /* Interrupted, simply look again. */
+		}
+	}
+	return NULL;
+}
+
+static void print_stop(void)
+{
+	print_set_async(0);
+}
+
+int print_set_async(int value)
+{
+	static int registered;
+	sigset_t all, old;
+	uint64_t one = 1;
+	int i;
+
+	if (!value) {
+		if (!ring) {
+			return 0;
+		}
+		__atomic_store_n(&ring->stop, 1, __ATOMIC_SEQ_CST);
+		if (write(ring->efd, &one, sizeof(one)) < 0) {
+			; /* The writer sees the flag on its next pass. */
+		}
+		pthread_join(ring->writer, NULL);
+		close(ring->efd);
+		free(ring);
+		ring = NULL;
+		return 0;
+	}
+	if (ring) {
+		return 0;
+	}
+	ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		return -1;
+	}
+	for (i = 0; i < PRINT_RING_SIZE; i++) {
+		ring->slot[i].seq = i;
+	}
+	ring->efd = eventfd(0, EFD_CLOEXEC);
+	if (ring->efd < 0) {
+		goto no_efd;
+	}
+	/* Leave the signals to the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	i = pthread_create(&ring->writer, NULL, print_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (i) {
+		goto no_thread;
+	}
+	if (!registered) {
+		atexit(print_stop);
+		registered = 1;
+	}
+	return 0;
+no_thread:
+	close(ring->efd);
+no_efd:
+	free(ring);
+	ring = NULL;
+	return -1;
+}
+
+void print(int level, char const *format, ...)
+{
+	struct timespec ts;
+	va_list ap;
+	char buf[PRINT_BUF_SIZE];
+
+	if (level > print_level)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	va_start(ap, format);
+	if (ring) {
+		print_ring_push(level, &ts, format, ap);
+		va_end(ap);
+		return;
+	}
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+
+	print_emit(level, &ts, buf);
+}
@@ -38,6 +38,15 @@ void print_set_syslog(int value);
 void print_set_level(int level);
 void print_set_verbose(int value);
 
+/**
+ * Enable or disable the asynchronous mode. In this mode, the messages
+ * are queued to a writer thread in a bounded ring, and messages which
+ * do not fit are dropped and counted.
+ * @param value  Non-zero to enable, zero to flush and disable.
+ * @return       Zero on success, non-zero otherwise.
+ */
+int print_set_async(int value);
+
 #define pr_emerg(x...)   print(LOG_EMERG, x)
 #define pr_alert(x...)   print(LOG_ALERT, x)
 #define pr_crit(x...)    print(LOG_CRIT, x)
@@ -41,6 +41,7 @@
 #include "ether.h"
 #include "print.h"
 #include "raw.h"
+#include "raw_ring.h"
 #include "sk.h"
 #include "transport_private.h"
 #include "util.h"
@@ -51,53 +52,53 @@ struct raw {
 	struct address ptp_addr;
 	struct address p2p_addr;
 	int vlan;
+	/* Optional receive rings, indexed like the descriptors. */
+	int ring_fd[FD_FIRST_TIMER];
+	struct raw_ring *ring[FD_FIRST_TIMER];
 };
 
-#define OP_AND  (BPF_ALU | BPF_AND | BPF_K)
 #define OP_JEQ  (BPF_JMP | BPF_JEQ | BPF_K)
 #define OP_JUN  (BPF_JMP | BPF_JA)
-#define OP_LDB  (BPF_LD  | BPF_B   | BPF_ABS)
 #define OP_LDH  (BPF_LD  | BPF_H   | BPF_ABS)
-#define OP_RETK (BPF_RET | BPF_K)
-
-#define PTP_GEN_BIT 0x08 /* indicates general message, if set in message type */
-
-#define N_RAW_FILTER    12
-#define RAW_FILTER_TEST 9
-
-static struct sock_filter raw_filter[N_RAW_FILTER] = {
-	{OP_LDH,  0, 0, OFF_ETYPE   },
-	{OP_JEQ,  0, 4, ETH_P_8021Q          }, /*f goto non-vlan block*/
-	{OP_LDH,  0, 0, OFF_ETYPE + 4        },
-	{OP_JEQ,  0, 7, ETH_P_1588           }, /*f goto reject*/
-	{OP_LDB,  0, 0, ETH_HLEN + VLAN_HLEN },
-	{OP_JUN,  0, 0, 2                    }, /*goto test general bit*/
-	{OP_JEQ,  0, 4, ETH_P_1588  }, /*f goto reject*/
-	{OP_LDB,  0, 0, ETH_HLEN    },
-	{OP_AND,  0, 0, PTP_GEN_BIT }, /*test general bit*/
-	{OP_JEQ,  0, 1, 0           }, /*0,1=accept event; 1,0=accept general*/
-	{OP_RETK, 0, 0, 1500        }, /*accept*/
-	{OP_RETK, 0, 0, 0           }, /*reject*/
+#define OP_LDXK (BPF_LDX | BPF_W   | BPF_IMM)
+
+#define REJECT SK_FILTER_REJECT
+#define RAW_SNAPLEN 1500
+
+/* Accepts PTP frames with or without a VLAN tag, see sk_set_filter(). */
+#define N_RAW_PROLOGUE 8
+
+static struct sock_filter raw_prologue[N_RAW_PROLOGUE] = {
+	{OP_LDH,  0, 0,      OFF_ETYPE     },
+	{OP_JEQ,  0, 4,      ETH_P_8021Q   }, /*f goto non-vlan block*/
+	{OP_LDH,  0, 0,      OFF_ETYPE + 4 },
+	{OP_JEQ,  0, REJECT, ETH_P_1588    },
+	{OP_LDXK, 0, 0,      VLAN_HLEN     },
+	{OP_JUN,  0, 0,      2             }, /*goto the PTP header tests*/
+	{OP_JEQ,  0, REJECT, ETH_P_1588    },
+	{OP_LDXK, 0, 0,      0             },
 };
 
+static int raw_set_filter(struct transport *t, struct fdarray *fda,
+			  struct transport_filter *f)
+{
+	if (sk_set_filter(fda->fd[FD_EVENT], raw_prologue, N_RAW_PROLOGUE,
+			  ETH_HLEN, RAW_SNAPLEN, 1, f) ||
+	    sk_set_filter(fda->fd[FD_GENERAL], raw_prologue, N_RAW_PROLOGUE,
+			  ETH_HLEN, RAW_SNAPLEN, 0, f)) {
+		return -1;
+	}
+	return 0;
+}
+
 static int raw_configure(int fd, int event, int index,
 			 unsigned char *addr1, unsigned char *addr2, int enable)
 {
-	int err1, err2, filter_test, option;
+	int err1, err2, option;
 	struct packet_mreq mreq;
-	struct sock_fprog prg = { N_RAW_FILTER, raw_filter };
 
-	filter_test = RAW_FILTER_TEST;
-	if (event) {
-		raw_filter[filter_test].jt = 0;
-		raw_filter[filter_test].jf = 1;
-	} else {
-		raw_filter[filter_test].jt = 1;
-		raw_filter[filter_test].jf = 0;
-	}
-
-	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prg, sizeof(prg))) {
-		pr_err("setsockopt SO_ATTACH_FILTER failed: %m");
+	if (sk_set_filter(fd, raw_prologue, N_RAW_PROLOGUE, ETH_HLEN,
+			  RAW_SNAPLEN, event, NULL)) {
 		return -1;
 	}
 
@@ -144,6 +145,15 @@ static int raw_configure(int fd, int event, int index,
 
 static int raw_close(struct transport *t, struct fdarray *fda)
 {
+	struct raw *raw = container_of(t, struct raw, t);
+	int i;
+
+	for (i = 0; i < FD_FIRST_TIMER; i++) {
+		if (raw->ring[i]) {
+			raw_ring_destroy(raw->ring[i]);
+			raw->ring[i] = NULL;
+		}
+	}
 	close(fda->fd[0]);
 	close(fda->fd[1]);
 	return 0;
@@ -212,7 +222,8 @@ static int raw_open(struct transport *t, struct interface *iface,
 	struct raw *raw = container_of(t, struct raw, t);
 	unsigned char ptp_dst_mac[MAC_LEN];
 	unsigned char p2p_dst_mac[MAC_LEN];
-	int efd, gfd, socket_priority;
+	int socket_priority;
+	int efd, gfd, i, ring_blocks;
 	const char *name;
 	char *str;
 
@@ -249,10 +260,33 @@ static int raw_open(struct transport *t, struct interface *iface,
 	if (sk_general_init(gfd))
 		goto no_timestamping;
 
+	ring_blocks = config_get_int(t->cfg, name, "rx_ring_blocks");
+	if (ring_blocks && ts_type == TS_LEGACY_HW) {
+		pr_warning("rx_ring_blocks not supported with legacy hardware "
+			   "time stamping");
+		ring_blocks = 0;
+	}
+	if (ring_blocks) {
+		raw->ring_fd[FD_EVENT] = efd;
+		raw->ring_fd[FD_GENERAL] = gfd;
+		raw->ring[FD_EVENT] =
+			raw_ring_create(efd, ring_blocks, ts_type != TS_SOFTWARE);
+		raw->ring[FD_GENERAL] = raw_ring_create(gfd, ring_blocks, 0);
+		if (!raw->ring[FD_EVENT] || !raw->ring[FD_GENERAL])
+			goto no_ring;
+	}
+
 	fda->fd[FD_EVENT] = efd;
 	fda->fd[FD_GENERAL] = gfd;
 	return 0;
 
+no_ring:
+	for (i = 0; i < FD_FIRST_TIMER; i++) {
+		if (raw->ring[i]) {
+			raw_ring_destroy(raw->ring[i]);
+			raw->ring[i] = NULL;
+		}
+	}
 no_timestamping:
 	close(gfd);
 no_general:
@@ -262,6 +296,93 @@ no_mac:
 	return -1;
 }
 
+static void raw_check_vlan(struct raw *raw, struct eth_hdr *hdr)
+{
+	if (raw->vlan) {
+		if (ETH_P_1588 == ntohs(hdr->type)) {
+			pr_notice("raw: disabling VLAN mode");
+			raw->vlan = 0;
+		}
+	} else {
+		if (ETH_P_8021Q == ntohs(hdr->type)) {
+			pr_notice("raw: switching to VLAN mode");
+			raw->vlan = 1;
+		}
+	}
+}
+
+static struct raw_ring *raw_fd_ring(struct raw *raw, int fd)
+{
+	int i;
+
+	for (i = 0; i < FD_FIRST_TIMER; i++) {
+		if (raw->ring[i] && raw->ring_fd[i] == fd) {
+			return raw->ring[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Reads one frame from a receive ring. The headers are inspected in
+ * place, and only the PTP message is copied, as it outlives the frame.
+ */
+static int raw_ring_recv(struct raw *raw, struct raw_ring *ring, void *buf,
+			 int buflen, struct address *addr,
+			 struct hw_timestamp *hwts)
+{
+	struct raw_ring_frame f;
+	int cnt, hlen;
+
+	if (!raw_ring_next(ring, &f)) {
+		return -EAGAIN;
+	}
+	if (raw->vlan) {
+		hlen = sizeof(struct vlan_hdr);
+	} else {
+		hlen = sizeof(struct eth_hdr);
+	}
+	cnt = f.len - hlen;
+	if (cnt < 0) {
+		cnt = 0;
+	}
+	if (cnt > buflen) {
+		cnt = buflen;
+	}
+	memcpy(buf, (unsigned char *) f.data + hlen, cnt);
+
+	if (addr) {
+		memcpy(&addr->sll, f.addr, sizeof(addr->sll));
+		addr->len = sizeof(addr->sll);
+	}
+	/* Like a missing control message, a wrong kind of stamp is none. */
+	memset(&hwts->sw, 0, sizeof(hwts->sw));
+	switch (hwts->type) {
+	case TS_SOFTWARE:
+		if (f.ts_type == RAW_RING_TS_SOFTWARE) {
+			hwts->ts = timespec_to_tmv(f.ts);
+		} else {
+			memset(&hwts->ts, 0, sizeof(hwts->ts));
+		}
+		break;
+	case TS_HARDWARE:
+	case TS_ONESTEP:
+	case TS_P2P1STEP:
+		if (f.ts_type == RAW_RING_TS_HARDWARE) {
+			hwts->ts = timespec_to_tmv(f.ts);
+		} else {
+			memset(&hwts->ts, 0, sizeof(hwts->ts));
+		}
+		break;
+	case TS_LEGACY_HW:
+		memset(&hwts->ts, 0, sizeof(hwts->ts));
+		break;
+	}
+
+	raw_check_vlan(raw, f.data);
+	return cnt;
+}
+
 static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts)
 {
@@ -269,6 +390,14 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	unsigned char *ptr = buf;
 	struct eth_hdr *hdr;
 	struct raw *raw = container_of(t, struct raw, t);
+	struct raw_ring *ring;
+
+	ring = raw_fd_ring(raw, fd);
+	if (ring) {
+		cnt = raw_ring_recv(raw, ring, buf, buflen, addr, hwts);
+		raw_ring_release(ring);
+		return cnt;
+	}
 
 	if (raw->vlan) {
 		hlen = sizeof(struct vlan_hdr);
@@ -286,16 +415,55 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	if (cnt < 0)
 		return cnt;
 
-	if (raw->vlan) {
-		if (ETH_P_1588 == ntohs(hdr->type)) {
-			pr_notice("raw: disabling VLAN mode");
-			raw->vlan = 0;
+	raw_check_vlan(raw, hdr);
+	return cnt;
+}
+
+static int raw_recv_batch(struct transport *t, int fd, struct sk_rx *rx, int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct raw_ring *ring;
+	int cnt, hlen, i;
+
+	ring = raw_fd_ring(raw, fd);
+	if (ring) {
+		for (i = 0; i < n; i++) {
+			rx[i].cnt = raw_ring_recv(raw, ring, rx[i].buf,
+						  rx[i].buflen, rx[i].addr,
+						  rx[i].hwts);
+			if (rx[i].cnt == -EAGAIN) {
+				break;
+			}
 		}
+		raw_ring_release(ring);
+		return i ? i : -EAGAIN;
+	}
+
+	if (raw->vlan) {
+		hlen = sizeof(struct vlan_hdr);
 	} else {
-		if (ETH_P_8021Q == ntohs(hdr->type)) {
-			pr_notice("raw: switching to VLAN mode");
-			raw->vlan = 1;
-		}
+		hlen = sizeof(struct eth_hdr);
+	}
+	for (i = 0; i < n; i++) {
+		rx[i].buf = (unsigned char *) rx[i].buf - hlen;
+		rx[i].buflen += hlen;
+	}
+
+	cnt = sk_receive_batch(fd, rx, n, MSG_DONTWAIT);
+
+	/*
+	 * As with single messages, a change of the VLAN mode only takes
+	 * effect on the next call.
+	 */
+	for (i = 0; i < cnt; i++) {
+		if (rx[i].cnt >= 0)
+			rx[i].cnt -= hlen;
+		if (rx[i].cnt >= 0)
+			raw_check_vlan(raw, rx[i].buf);
+	}
+	for (i = 0; i < n; i++) {
+		rx[i].buf = (unsigned char *) rx[i].buf + hlen;
+		rx[i].buflen -= hlen;
 	}
 	return cnt;
 }
@@ -344,6 +512,30 @@ static int raw_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, pkt, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int raw_send_batch(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, struct sk_tx *tx, int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct address *addr;
+	struct eth_hdr *hdr;
+	int fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	for (i = 0; i < n; i++) {
+		hdr = (struct eth_hdr *) ((unsigned char *) tx[i].buf -
+					  sizeof(*hdr));
+		addr = tx[i].addr ? tx[i].addr : &raw->ptp_addr;
+		addr_to_mac(&hdr->dst, addr);
+		addr_to_mac(&hdr->src, &raw->src_addr);
+		hdr->type = htons(ETH_P_1588);
+
+		tx[i].buf = hdr;
+		tx[i].len += sizeof(*hdr);
+	}
+	return sk_send_batch(fd, tx, n, 0);
+}
+
 static void raw_release(struct transport *t)
 {
 	struct raw *raw = container_of(t, struct raw, t);
@@ -373,7 +565,10 @@ struct transport *raw_transport_create(void)
 	raw->t.close   = raw_close;
 	raw->t.open    = raw_open;
 	raw->t.recv    = raw_recv;
+	raw->t.recv_batch = raw_recv_batch;
 	raw->t.send    = raw_send;
+	raw->t.send_batch = raw_send_batch;
+	raw->t.set_filter = raw_set_filter;
 	raw->t.release = raw_release;
 	raw->t.physical_addr = raw_physical_addr;
 	raw->t.protocol_addr = raw_protocol_addr;
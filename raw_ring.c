@@ -0,0 +1,178 @@
+/**
+ * @file raw_ring.c
+ * @brief Receives packets through a memory mapped TPACKET_V3 ring.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * The kernel header with the ring layout clashes with the definitions
+ * of <netpacket/packet.h>, which the other headers pull in.
+ */
+#define sockaddr_ll kernel_sockaddr_ll
+#define packet_mreq kernel_packet_mreq
+#include <linux/if_packet.h>
+#undef sockaddr_ll
+#undef packet_mreq
+#include <linux/net_tstamp.h>
+
+#include "print.h"
+#include "raw_ring.h"
+
+/*
+ * The frame size only bounds the largest frame, as TPACKET_V3 packs
+ * the frames of a block back to back. A block which is not full is
+ * handed over to user space after the retire timeout.
+ */
+#define RAW_RING_FRAME_SIZE	2048
+#define RAW_RING_RETIRE_MS	1
+
+struct raw_ring {
+	unsigned char *map;
+	size_t map_size;
+	unsigned int block_size;
+	unsigned int nr_blocks;
+	unsigned int block;		/* the block being read */
+	unsigned int left;		/* frames left in that block */
+	int busy;			/* the block belongs to us */
+	struct tpacket3_hdr *frame;	/* the next frame of the block */
+};
+
+static struct tpacket_block_desc *raw_ring_block(struct raw_ring *r)
+{
+	return (struct tpacket_block_desc *) (r->map + r->block * r->block_size);
+}
+
+struct raw_ring *raw_ring_create(int fd, int blocks, int hwts)
+{
+	struct tpacket_req3 req;
+	struct raw_ring *r;
+	char buf[1];
+	int val;
+
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		return NULL;
+	}
+	val = TPACKET_V3;
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val))) {
+		pr_err("setsockopt PACKET_VERSION failed: %m");
+		goto failed;
+	}
+	if (hwts) {
+		val = SOF_TIMESTAMPING_RAW_HARDWARE;
+		if (setsockopt(fd, SOL_PACKET, PACKET_TIMESTAMP,
+			       &val, sizeof(val))) {
+			pr_err("setsockopt PACKET_TIMESTAMP failed: %m");
+			goto failed;
+		}
+	}
+
+	r->block_size = sysconf(_SC_PAGESIZE);
+	r->nr_blocks = blocks;
+	r->map_size = r->block_size * r->nr_blocks;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = r->block_size;
+	req.tp_block_nr = r->nr_blocks;
+	req.tp_frame_size = RAW_RING_FRAME_SIZE;
+	req.tp_frame_nr = r->map_size / RAW_RING_FRAME_SIZE;
+	req.tp_retire_blk_tov = RAW_RING_RETIRE_MS;
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req))) {
+		pr_err("setsockopt PACKET_RX_RING failed: %m");
+		goto failed;
+	}
+	r->map = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+	if (r->map == MAP_FAILED) {
+		pr_err("mmap of the packet ring failed: %m");
+		goto failed;
+	}
+
+	/* Frames queued before the ring existed would keep the socket readable. */
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT | MSG_TRUNC) >= 0)
+		;
+
+	return r;
+failed:
+	free(r);
+	return NULL;
+}
+
+void raw_ring_destroy(struct raw_ring *r)
+{
+	munmap(r->map, r->map_size);
+	free(r);
+}
+
+void raw_ring_release(struct raw_ring *r)
+{
+	struct tpacket_block_desc *bd;
+
+	if (!r->busy || r->left) {
+		return;
+	}
+	bd = raw_ring_block(r);
+	__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+			 __ATOMIC_RELEASE);
+	r->busy = 0;
+	r->block = (r->block + 1) % r->nr_blocks;
+}
+
+int raw_ring_next(struct raw_ring *r, struct raw_ring_frame *f)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+
+	while (!r->left) {
+		raw_ring_release(r);
+		bd = raw_ring_block(r);
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status,
+				      __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+			return 0;
+		}
+		r->busy = 1;
+		r->left = bd->hdr.bh1.num_pkts;
+		r->frame = (struct tpacket3_hdr *)
+			((unsigned char *) bd + bd->hdr.bh1.offset_to_first_pkt);
+	}
+
+	hdr = r->frame;
+	f->data = (unsigned char *) hdr + hdr->tp_mac;
+	f->len = hdr->tp_snaplen;
+	f->addr = (unsigned char *) hdr +
+		TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+	f->ts.tv_sec = hdr->tp_sec;
+	f->ts.tv_nsec = hdr->tp_nsec;
+	if (hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE) {
+		f->ts_type = RAW_RING_TS_HARDWARE;
+	} else if (hdr->tp_status & TP_STATUS_TS_SOFTWARE) {
+		f->ts_type = RAW_RING_TS_SOFTWARE;
+	} else {
+		f->ts_type = RAW_RING_TS_NONE;
+	}
+
+	r->left--;
+	r->frame = (struct tpacket3_hdr *)
+		((unsigned char *) hdr + hdr->tp_next_offset);
+	return 1;
+}
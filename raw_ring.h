@@ -0,0 +1,84 @@
+/**
+ * @file raw_ring.h
+ * @brief Receives packets through a memory mapped TPACKET_V3 ring.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_RAW_RING_H
+#define HAVE_RAW_RING_H
+
+#include <time.h>
+
+/** Opaque type */
+struct raw_ring;
+
+enum raw_ring_ts {
+	RAW_RING_TS_NONE,
+	RAW_RING_TS_SOFTWARE,
+	RAW_RING_TS_HARDWARE,
+};
+
+/**
+ * Describes one frame in the ring. The pointers refer to the ring
+ * itself and stay valid until the next call to @ref raw_ring_next()
+ * or @ref raw_ring_release().
+ * @data:    the frame, starting with the Ethernet header.
+ * @len:     length of the frame in bytes.
+ * @addr:    the source address, a struct sockaddr_ll.
+ * @ts:      the receive time stamp of the frame.
+ * @ts_type: the kind of time stamp in 'ts'.
+ */
+struct raw_ring_frame {
+	void *data;
+	int len;
+	void *addr;
+	struct timespec ts;
+	enum raw_ring_ts ts_type;
+};
+
+/**
+ * Attach a receive ring to a packet socket. Frames already queued on
+ * the socket are discarded.
+ * @param fd      An open AF_PACKET socket.
+ * @param blocks  The number of blocks of one page each in the ring.
+ * @param hwts    Non-zero to time stamp the frames in hardware.
+ * @return        A pointer to a new raw_ring on success, NULL otherwise.
+ */
+struct raw_ring *raw_ring_create(int fd, int blocks, int hwts);
+
+/**
+ * Unmap a receive ring. The socket itself is not closed.
+ * @param r  Pointer obtained via @ref raw_ring_create().
+ */
+void raw_ring_destroy(struct raw_ring *r);
+
+/**
+ * Obtain the next frame from the ring without any system call.
+ * @param r  Pointer obtained via @ref raw_ring_create().
+ * @param f  Returns the frame.
+ * @return   One if a frame was returned, zero if the ring is empty.
+ */
+int raw_ring_next(struct raw_ring *r, struct raw_ring_frame *f);
+
+/**
+ * Hand the current block back to the kernel once all of its frames
+ * were read. The caller must be done with the frames returned so far,
+ * otherwise the socket stays readable for a block which is empty.
+ * @param r  Pointer obtained via @ref raw_ring_create().
+ */
+void raw_ring_release(struct raw_ring *r);
+
+#endif
@@ -43,7 +43,7 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 		servo = pi_servo_create(cfg, fadj, sw_ts);
 		break;
 	case CLOCK_SERVO_LINREG:
-		servo = linreg_servo_create(fadj);
+		servo = linreg_servo_create(cfg, fadj);
 		break;
 	case CLOCK_SERVO_NTPSHM:
 		servo = ntpshm_servo_create(cfg);
@@ -58,7 +58,7 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 	if (!servo)
 		return NULL;
 
-	servo_step_threshold = config_get_double(cfg, NULL, "step_threshold");
+	servo_step_threshold = config_double(cfg, 0, CFG_STEP_THRESHOLD);
 	if (servo_step_threshold > 0.0) {
 		servo->step_threshold = servo_step_threshold * NSEC_PER_SEC;
 	} else {
@@ -66,7 +66,7 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 	}
 
 	servo_first_step_threshold =
-		config_get_double(cfg, NULL, "first_step_threshold");
+		config_double(cfg, 0, CFG_FIRST_STEP_THRESHOLD);
 
 	if (servo_first_step_threshold > 0.0) {
 		servo->first_step_threshold =
@@ -75,15 +75,17 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 		servo->first_step_threshold = 0.0;
 	}
 
-	servo_max_frequency = config_get_int(cfg, NULL, "max_frequency");
+	servo_max_frequency = config_int(cfg, 0, CFG_MAX_FREQUENCY);
 	servo->max_frequency = max_ppb;
 	if (servo_max_frequency && servo->max_frequency > servo_max_frequency) {
 		servo->max_frequency = servo_max_frequency;
 	}
 
 	servo->first_update = 1;
-	servo->offset_threshold = config_get_int(cfg, NULL, "servo_offset_threshold");
-	servo->num_offset_values = config_get_int(cfg, NULL, "servo_num_offset_values");
+	servo->offset_threshold =
+		config_int(cfg, 0, CFG_SERVO_OFFSET_THRESHOLD);
+	servo->num_offset_values =
+		config_int(cfg, 0, CFG_SERVO_NUM_OFFSET_VALUES);
 	servo->curr_offset_values = servo->num_offset_values;
 
 	return servo;
@@ -106,16 +108,9 @@ static int check_offset_threshold(struct servo *s, int64_t offset)
 	return 0;
 }
 
-double servo_sample(struct servo *servo,
-		    int64_t offset,
-		    uint64_t local_ts,
-		    double weight,
-		    enum servo_state *state)
+static void servo_update_state(struct servo *servo, int64_t offset,
+			       enum servo_state *state)
 {
-	double r;
-
-	r = servo->sample(servo, offset, local_ts, weight, state);
-
 	switch (*state) {
 	case SERVO_UNLOCKED:
 		servo->curr_offset_values = servo->num_offset_values;
@@ -138,10 +133,55 @@ double servo_sample(struct servo *servo,
 		 */
 		break;
 	}
+}
+
+double servo_sample(struct servo *servo,
+		    int64_t offset,
+		    uint64_t local_ts,
+		    double weight,
+		    enum servo_state *state)
+{
+	double r;
+
+	r = servo->sample(servo, offset, local_ts, weight, state);
+
+	servo_update_state(servo, offset, state);
 
 	return r;
 }
 
+void servo_sample_batch(struct servo **servo, int n,
+			const int64_t *offset,
+			const uint64_t *local_ts,
+			const double *weight,
+			double *freq,
+			enum servo_state *state)
+{
+	int i, j, k;
+
+	for (i = 0; i < n; i = j) {
+		/* Find the run of servos with the same kernel. */
+		for (j = i + 1; j < n; j++) {
+			if (servo[j]->sample_batch != servo[i]->sample_batch)
+				break;
+		}
+		if (servo[i]->sample_batch) {
+			servo[i]->sample_batch(servo + i, j - i, offset + i,
+					       local_ts + i, weight + i,
+					       freq + i, state + i);
+			continue;
+		}
+		for (k = i; k < j; k++) {
+			freq[k] = servo[k]->sample(servo[k], offset[k],
+						   local_ts[k], weight[k],
+						   &state[k]);
+		}
+	}
+	for (i = 0; i < n; i++) {
+		servo_update_state(servo[i], offset[i], &state[i]);
+	}
+}
+
 void servo_sync_interval(struct servo *servo, double interval)
 {
 	servo->sync_interval(servo, interval);
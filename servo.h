@@ -101,6 +101,27 @@ double servo_sample(struct servo *servo,
 		    double weight,
 		    enum servo_state *state);
 
+/**
+ * Feed one sample into each of a number of clock servos. The samples
+ * and the results are passed as parallel arrays, one entry per servo.
+ * Consecutive servos of the same type are handed to a vectorized kernel
+ * where the type has one, and the results equal those of calling
+ * @ref servo_sample() for each servo in turn.
+ * @param servo     Array of servos obtained via @ref servo_create().
+ * @param n         The number of servos.
+ * @param offset    The estimated clock offsets in nanoseconds.
+ * @param local_ts  The local time stamps of the samples in nanoseconds.
+ * @param weight    The weights of the samples, as in @ref servo_sample().
+ * @param freq      Returns the clock adjustments in parts per billion.
+ * @param state     Returns the servos' states.
+ */
+void servo_sample_batch(struct servo **servo, int n,
+			const int64_t *offset,
+			const uint64_t *local_ts,
+			const double *weight,
+			double *freq,
+			enum servo_state *state);
+
 /**
  * Inform a clock servo about the master's sync interval.
  * @param servo   Pointer to a servo obtained via @ref servo_create().
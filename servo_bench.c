@@ -0,0 +1,236 @@
+/**
+ * @file servo_bench.c
+ * @brief Compares the batch and the per-clock sampling of the servos.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "print.h"
+#include "servo.h"
+#include "version.h"
+
+#define MAX_CLOCKS	1024
+#define MAX_PPB		500000
+
+/*
+ * A simulated clock, drifting from its master and steered by the
+ * output of a servo. Two identical sets of clocks are run, one sampled
+ * per clock and one in a batch, and their results are compared.
+ */
+struct sim {
+	struct servo *servo[MAX_CLOCKS];
+	double phase[MAX_CLOCKS];
+	double drift[MAX_CLOCKS];
+	int64_t offset[MAX_CLOCKS];
+	uint64_t ts[MAX_CLOCKS];
+	double weight[MAX_CLOCKS];
+	double freq[MAX_CLOCKS];
+	enum servo_state state[MAX_CLOCKS];
+	int64_t elapsed;
+};
+
+static uint32_t noise_seed = 1;
+
+static int noise(void)
+{
+	/* A fixed sequence, so that both sets see the same samples. */
+	noise_seed = noise_seed * 1103515245 + 12345;
+	return (int)((noise_seed >> 16) % 201) - 100;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static int sim_init(struct sim *s, struct config *cfg, enum servo_type type,
+		    int n)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < n; i++) {
+		s->servo[i] = servo_create(cfg, type, 0, MAX_PPB, 0);
+		if (!s->servo[i])
+			return -1;
+		servo_sync_interval(s->servo[i], 1.0);
+		s->drift[i] = (i * 37 % 200 - 100) * 1000.0;
+		s->phase[i] = (i * 53 % 100) * 1000.0;
+		s->ts[i] = 1000000 * NS_PER_SEC;
+		s->weight[i] = 1.0;
+	}
+	return 0;
+}
+
+static void sim_destroy(struct sim *s, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (s->servo[i])
+			servo_destroy(s->servo[i]);
+	}
+}
+
+static void sim_advance(struct sim *s, int n, const int *jitter)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		switch (s->state[i]) {
+		case SERVO_JUMP:
+			s->phase[i] -= s->offset[i];
+			break;
+		case SERVO_LOCKED:
+		case SERVO_LOCKED_STABLE:
+			s->phase[i] += s->freq[i];
+			break;
+		default:
+			break;
+		}
+		s->phase[i] += s->drift[i];
+		s->ts[i] += NS_PER_SEC;
+		s->offset[i] = (int64_t)s->phase[i] + jitter[i];
+	}
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\n"
+		"usage: %s [options]\n\n"
+		" -c [num]       number of sampling cycles (10000)\n"
+		" -n [num]       number of clocks (16)\n"
+		" -s [servo]     servo, pi or linreg (pi)\n"
+		" -h             prints this message and exits\n"
+		" -v             prints the software version and exits\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	enum servo_type type = CLOCK_SERVO_PI;
+	int c, cycles = 10000, i, k, n = 16;
+	int jitter[MAX_CLOCKS];
+	long mismatches = 0;
+	struct sim *a, *b;
+	struct config *cfg;
+	char *progname;
+	int64_t t;
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1 + progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "c:n:s:hv"))) {
+		switch (c) {
+		case 'c':
+			cycles = atoi(optarg);
+			break;
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 's':
+			if (!strcasecmp(optarg, "pi")) {
+				type = CLOCK_SERVO_PI;
+			} else if (!strcasecmp(optarg, "linreg")) {
+				type = CLOCK_SERVO_LINREG;
+			} else {
+				fprintf(stderr, "unknown servo %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'v':
+			version_show(stdout);
+			return 0;
+		case 'h':
+			usage(progname);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	if (cycles < 1 || n < 1 || n > MAX_CLOCKS) {
+		usage(progname);
+		return -1;
+	}
+
+	print_set_progname(progname);
+	print_set_syslog(0);
+	print_set_verbose(1);
+
+	cfg = config_create();
+	a = malloc(sizeof(*a));
+	b = malloc(sizeof(*b));
+	if (!cfg || !a || !b) {
+		fprintf(stderr, "failed to allocate memory\n");
+		return -1;
+	}
+	if (sim_init(a, cfg, type, n) || sim_init(b, cfg, type, n)) {
+		fprintf(stderr, "failed to create the servos\n");
+		return -1;
+	}
+
+	for (k = 0; k < cycles; k++) {
+		for (i = 0; i < n; i++) {
+			jitter[i] = noise();
+		}
+		sim_advance(a, n, jitter);
+		sim_advance(b, n, jitter);
+
+		t = now_ns();
+		for (i = 0; i < n; i++) {
+			a->freq[i] = servo_sample(a->servo[i], a->offset[i],
+						  a->ts[i], a->weight[i],
+						  &a->state[i]);
+		}
+		a->elapsed += now_ns() - t;
+
+		t = now_ns();
+		servo_sample_batch(b->servo, n, b->offset, b->ts, b->weight,
+				   b->freq, b->state);
+		b->elapsed += now_ns() - t;
+
+		for (i = 0; i < n; i++) {
+			if (a->freq[i] != b->freq[i] ||
+			    a->state[i] != b->state[i])
+				mismatches++;
+		}
+	}
+
+	printf("%s: %d clocks, %d cycles: %.1f ns per clock one at a time, "
+	       "%.1f ns batched, %ld mismatches\n",
+	       type == CLOCK_SERVO_PI ? "pi" : "linreg", n, cycles,
+	       (double)a->elapsed / cycles / n,
+	       (double)b->elapsed / cycles / n, mismatches);
+
+	sim_destroy(a, n);
+	sim_destroy(b, n);
+	free(a);
+	free(b);
+	config_destroy(cfg);
+	return mismatches ? 1 : 0;
+}
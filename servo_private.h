@@ -24,6 +24,24 @@
 #include "contain.h"
 #include "servo.h"
 
+/*
+ * The batch kernels process SERVO_VEC_LEN servos at a time, using the
+ * vector extension of the compiler. Two doubles fill the 16 byte vector
+ * registers of x86-64 and arm64; wider vectors are split up by the
+ * compiler and run slower than the scalar code. Comparisons yield lanes
+ * of all ones or all zeros, and servo_vec_select() picks from 'a' where
+ * they are set.
+ */
+#define SERVO_VEC_LEN 2
+
+typedef double servo_vec
+	__attribute__((vector_size(SERVO_VEC_LEN * sizeof(double))));
+typedef int64_t servo_mask
+	__attribute__((vector_size(SERVO_VEC_LEN * sizeof(int64_t))));
+
+#define servo_vec_select(m, a, b) \
+	((servo_vec)(((m) & (servo_mask)(a)) | (~(m) & (servo_mask)(b))))
+
 struct servo {
 	double max_frequency;
 	double step_threshold;
@@ -39,6 +57,12 @@ struct servo {
 			 int64_t offset, uint64_t local_ts, double weight,
 			 enum servo_state *state);
 
+	/* Optional, see servo_sample_batch(). */
+	void (*sample_batch)(struct servo **servo, int n,
+			     const int64_t *offset, const uint64_t *local_ts,
+			     const double *weight, double *freq,
+			     enum servo_state *state);
+
 	void (*sync_interval)(struct servo *servo, double interval);
 
 	void (*reset)(struct servo *servo);
@@ -0,0 +1,220 @@
+/**
+ * @file shm_status.c
+ * @brief Publishes the state of ptp4l in a shared memory region.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "shm_status.h"
+
+#define SHM_STATUS_MAGIC	0x50545053	/* "PTPS" */
+#define SHM_STATUS_RETRIES	1000
+
+/*
+ * The region is protected by a sequence lock. The writer makes the
+ * sequence odd while it updates the data, and readers retry when the
+ * sequence was odd or changed while they copied the data.
+ */
+struct shm_status_region {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t seq;
+	struct shm_status_data data;
+};
+
+struct shm_status {
+	struct shm_status_region *region;
+	char name[NAME_MAX];
+	int owner;
+};
+
+static int shm_status_name(char *name, size_t len, const char *uds_path)
+{
+	int i;
+
+	if (snprintf(name, len, "/linuxptp%s", uds_path) >= len) {
+		return -1;
+	}
+	/* Only the leading slash is allowed in the name. */
+	for (i = 1; name[i]; i++) {
+		if (name[i] == '/') {
+			name[i] = '.';
+		}
+	}
+	return 0;
+}
+
+static uint64_t shm_status_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+struct shm_status *shm_status_create(const char *uds_path)
+{
+	struct shm_status *s;
+	int fd;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+	if (shm_status_name(s->name, sizeof(s->name), uds_path)) {
+		pr_err("status region name too long");
+		goto no_fd;
+	}
+	shm_unlink(s->name);
+	fd = shm_open(s->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		pr_err("failed to create status region %s: %m", s->name);
+		goto no_fd;
+	}
+	if (ftruncate(fd, sizeof(*s->region))) {
+		pr_err("failed to size status region: %m");
+		goto no_map;
+	}
+	s->region = mmap(NULL, sizeof(*s->region), PROT_READ | PROT_WRITE,
+			 MAP_SHARED, fd, 0);
+	if (s->region == MAP_FAILED) {
+		pr_err("failed to map status region: %m");
+		goto no_map;
+	}
+	close(fd);
+
+	s->owner = 1;
+	s->region->version = SHM_STATUS_VERSION;
+	s->region->size = sizeof(*s->region);
+	__atomic_store_n(&s->region->magic, SHM_STATUS_MAGIC, __ATOMIC_RELEASE);
+	return s;
+no_map:
+	close(fd);
+	shm_unlink(s->name);
+no_fd:
+	free(s);
+	return NULL;
+}
+
+struct shm_status *shm_status_open(const char *uds_path)
+{
+	struct shm_status *s;
+	struct stat st;
+	int fd;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+	if (shm_status_name(s->name, sizeof(s->name), uds_path)) {
+		goto no_fd;
+	}
+	fd = shm_open(s->name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0) {
+		goto no_fd;
+	}
+	if (fstat(fd, &st) || st.st_size != sizeof(*s->region)) {
+		goto no_map;
+	}
+	s->region = mmap(NULL, sizeof(*s->region), PROT_READ, MAP_SHARED,
+			 fd, 0);
+	if (s->region == MAP_FAILED) {
+		goto no_map;
+	}
+	close(fd);
+
+	if (__atomic_load_n(&s->region->magic, __ATOMIC_ACQUIRE) !=
+	    SHM_STATUS_MAGIC ||
+	    s->region->version != SHM_STATUS_VERSION ||
+	    s->region->size != sizeof(*s->region)) {
+		munmap(s->region, sizeof(*s->region));
+		free(s);
+		return NULL;
+	}
+	return s;
+no_map:
+	close(fd);
+no_fd:
+	free(s);
+	return NULL;
+}
+
+void shm_status_close(struct shm_status *s)
+{
+	if (s->owner) {
+		/* Readers still mapping the region fall back. */
+		__atomic_store_n(&s->region->magic, 0, __ATOMIC_RELEASE);
+		shm_unlink(s->name);
+	}
+	munmap(s->region, sizeof(*s->region));
+	free(s);
+}
+
+struct shm_status_data *shm_status_write_begin(struct shm_status *s)
+{
+	__atomic_store_n(&s->region->seq, s->region->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return &s->region->data;
+}
+
+void shm_status_write_end(struct shm_status *s)
+{
+	s->region->data.update_time = shm_status_now();
+	__atomic_store_n(&s->region->seq, s->region->seq + 1, __ATOMIC_RELEASE);
+}
+
+int shm_status_read(struct shm_status *s, struct shm_status_data *data,
+		    uint64_t max_age)
+{
+	uint32_t seq;
+	int i;
+
+	for (i = 0; i < SHM_STATUS_RETRIES; i++) {
+		if (__atomic_load_n(&s->region->magic, __ATOMIC_ACQUIRE) !=
+		    SHM_STATUS_MAGIC) {
+			return -1;
+		}
+		seq = __atomic_load_n(&s->region->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+		memcpy(data, &s->region->data, sizeof(*data));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&s->region->seq, __ATOMIC_RELAXED) != seq) {
+			continue;
+		}
+		/* Nothing was published yet. */
+		if (!seq) {
+			return -1;
+		}
+		if (max_age && shm_status_now() - data->update_time > max_age) {
+			return -1;
+		}
+		return 0;
+	}
+	return -1;
+}
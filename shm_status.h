@@ -0,0 +1,114 @@
+/**
+ * @file shm_status.h
+ * @brief Publishes the state of ptp4l in a shared memory region.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_SHM_STATUS_H
+#define HAVE_SHM_STATUS_H
+
+#include <net/if.h>
+#include <stdint.h>
+
+#include "ds.h"
+
+/*
+ * The version changes whenever the layout of the region changes.
+ * Readers must reject a region with a different version.
+ */
+#define SHM_STATUS_VERSION	1
+#define SHM_STATUS_MAX_PORTS	64
+
+/*
+ * The writer refreshes the region at least this often, so that readers
+ * can tell a live region from one left behind by a crashed writer.
+ */
+#define SHM_STATUS_INTERVAL_MS	1000
+
+struct shm_status_port {
+	struct PortIdentity portIdentity;
+	uint8_t state;		/* enum port_state, GRAND_MASTER as MASTER */
+	uint8_t timestamping;	/* enum timestamp_type */
+	char interface[IFNAMSIZ];
+};
+
+struct shm_status_data {
+	uint64_t update_time;	/* CLOCK_MONOTONIC, in nanoseconds */
+	struct defaultDS dds;
+	struct currentDS cds;
+	struct parentDS pds;
+	struct timePropertiesDS tds;
+	int64_t master_offset;	/* nanoseconds */
+	double freq;		/* parts per billion */
+	int32_t servo_state;	/* enum servo_state */
+	uint16_t num_ports;	/* entries in port[] */
+	struct shm_status_port port[SHM_STATUS_MAX_PORTS];
+};
+
+/** Opaque type */
+struct shm_status;
+
+/**
+ * Create the status region of a ptp4l instance. An existing region of
+ * the same name is replaced.
+ * @param uds_path  The UDS address of the ptp4l instance, which names
+ *                  the region.
+ * @return          A pointer to a new shm_status on success, NULL otherwise.
+ */
+struct shm_status *shm_status_create(const char *uds_path);
+
+/**
+ * Open the status region of a ptp4l instance for reading.
+ * @param uds_path  The UDS address of the ptp4l instance.
+ * @return          A pointer to a new shm_status on success, NULL if the
+ *                  region does not exist or has an unknown version.
+ */
+struct shm_status *shm_status_open(const char *uds_path);
+
+/**
+ * Close a status region. The region is removed if it was created
+ * with @ref shm_status_create().
+ * @param s  Pointer obtained via @ref shm_status_create() or
+ *           @ref shm_status_open().
+ */
+void shm_status_close(struct shm_status *s);
+
+/**
+ * Start updating the region. Readers retry until the update is done.
+ * @param s  Pointer obtained via @ref shm_status_create().
+ * @return   The data to update in place.
+ */
+struct shm_status_data *shm_status_write_begin(struct shm_status *s);
+
+/**
+ * Finish updating the region.
+ * @param s  Pointer obtained via @ref shm_status_create().
+ */
+void shm_status_write_end(struct shm_status *s);
+
+/**
+ * Take a consistent snapshot of the region without any system call.
+ * @param s       Pointer obtained via @ref shm_status_open().
+ * @param data    Returns the snapshot.
+ * @param max_age The maximum age of the data in nanoseconds, or zero
+ *                for any age.
+ * @return        Zero on success, non-zero if the region was not updated
+ *                within max_age or is being updated for too long.
+ */
+int shm_status_read(struct shm_status *s, struct shm_status_data *data,
+		    uint64_t max_age);
+
+#endif
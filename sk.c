@@ -19,6 +19,7 @@
  */
 #include <errno.h>
 #include <time.h>
+#include <linux/filter.h>
 #include <linux/net_tstamp.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
@@ -146,6 +147,156 @@ int sk_interface_index(int fd, const char *name)
 	return ifreq.ifr_ifindex;
 }
 
+/*
+ * The generated filters are short, as each message type appears in at
+ * most one test. The jumps to the reject instruction are resolved once
+ * the length of the program is known.
+ */
+#define SK_FILTER_MAX 96
+
+#define OFF_TSMT	0
+#define OFF_DOMAIN	4
+#define OFF_FLAGS	6
+#define OFF_SOURCE	20
+
+struct sk_filter_prog {
+	struct sock_filter insn[SK_FILTER_MAX];
+	int len;
+};
+
+static void sk_emit(struct sk_filter_prog *prg, uint16_t code,
+		    uint8_t jt, uint8_t jf, uint32_t k)
+{
+	struct sock_filter insn = { code, jt, jf, k };
+
+	if (prg->len < SK_FILTER_MAX) {
+		prg->insn[prg->len] = insn;
+	}
+	prg->len++;
+}
+
+static uint32_t sk_word(const Octet *p)
+{
+	return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+int sk_set_filter(int fd, struct sock_filter *prologue, int len,
+		  uint32_t offset, uint32_t snaplen, int event,
+		  struct transport_filter *f)
+{
+	const uint16_t ldb = BPF_LD | BPF_B | BPF_IND;
+	const uint16_t ldh = BPF_LD | BPF_H | BPF_IND;
+	const uint16_t ldw = BPF_LD | BPF_W | BPF_IND;
+	const uint16_t jeq = BPF_JMP | BPF_JEQ | BPF_K;
+	const uint16_t jset = BPF_JMP | BPF_JSET | BPF_K;
+	struct sk_filter_prog prg = { .len = 0 };
+	struct sock_fprog fprog;
+	int i, n, t;
+
+	if (prologue) {
+		for (i = 0; i < len; i++) {
+			sk_emit(&prg, prologue[i].code, prologue[i].jt,
+				prologue[i].jf, prologue[i].k);
+		}
+	} else {
+		sk_emit(&prg, BPF_LDX | BPF_W | BPF_IMM, 0, 0, 0);
+	}
+
+	if (f && f->tsp >= 0) {
+		sk_emit(&prg, ldb, 0, 0, offset + OFF_TSMT);
+		sk_emit(&prg, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xf0);
+		sk_emit(&prg, jeq, 0, SK_FILTER_REJECT, f->tsp);
+	}
+
+	/* The message type stays in A for the following tests. */
+	sk_emit(&prg, ldb, 0, 0, offset + OFF_TSMT);
+	sk_emit(&prg, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x0f);
+	if (event > 0) {
+		sk_emit(&prg, jset, SK_FILTER_REJECT, 0, 0x08);
+	} else if (!event) {
+		sk_emit(&prg, jset, 0, SK_FILTER_REJECT, 0x08);
+	}
+	for (t = 0; f && t < 16; t++) {
+		if (f->drop & (1 << t)) {
+			sk_emit(&prg, jeq, SK_FILTER_REJECT, 0, t);
+		}
+	}
+
+	if (f && f->parent_only) {
+		n = __builtin_popcount(f->parent_only);
+		for (t = 0; t < 16; t++) {
+			if (f->parent_only & (1 << t)) {
+				/* Jump over the other tests and the 'ja'. */
+				sk_emit(&prg, jeq, n, 0, t);
+				n--;
+			}
+		}
+		sk_emit(&prg, BPF_JMP | BPF_JA, 0, 0, 6);
+		sk_emit(&prg, ldw, 0, 0, offset + OFF_SOURCE);
+		sk_emit(&prg, jeq, 0, SK_FILTER_REJECT,
+			sk_word(f->parent.clockIdentity.id));
+		sk_emit(&prg, ldw, 0, 0, offset + OFF_SOURCE + 4);
+		sk_emit(&prg, jeq, 0, SK_FILTER_REJECT,
+			sk_word(f->parent.clockIdentity.id + 4));
+		sk_emit(&prg, ldh, 0, 0, offset + OFF_SOURCE + 8);
+		sk_emit(&prg, jeq, 0, SK_FILTER_REJECT, f->parent.portNumber);
+		/* Reload the message type for the multicast tests. */
+		sk_emit(&prg, ldb, 0, 0, offset + OFF_TSMT);
+		sk_emit(&prg, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x0f);
+	}
+
+	for (t = 0; f && t < 16; t++) {
+		if (!(f->drop_multicast & (1 << t))) {
+			continue;
+		}
+		sk_emit(&prg, jeq, 0, 4, t);
+		sk_emit(&prg, ldb, 0, 0, offset + OFF_FLAGS);
+		sk_emit(&prg, jset, 0, SK_FILTER_REJECT, UNICAST);
+		sk_emit(&prg, ldb, 0, 0, offset + OFF_TSMT);
+		sk_emit(&prg, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x0f);
+	}
+
+	if (f && f->domain >= 0) {
+		sk_emit(&prg, ldb, 0, 0, offset + OFF_DOMAIN);
+		sk_emit(&prg, jeq, 0, SK_FILTER_REJECT, f->domain);
+	}
+	if (f && f->block) {
+		sk_emit(&prg, ldw, 0, 0, offset + OFF_SOURCE);
+		sk_emit(&prg, jeq, 0, 2, sk_word(f->block->id));
+		sk_emit(&prg, ldw, 0, 0, offset + OFF_SOURCE + 4);
+		sk_emit(&prg, jeq, SK_FILTER_REJECT, 0,
+			sk_word(f->block->id + 4));
+	}
+
+	sk_emit(&prg, BPF_RET | BPF_K, 0, 0, snaplen);
+	sk_emit(&prg, BPF_RET | BPF_K, 0, 0, 0);
+
+	if (prg.len > SK_FILTER_MAX) {
+		pr_err("socket filter too long");
+		return -1;
+	}
+	for (i = 0; i < prg.len; i++) {
+		if (BPF_CLASS(prg.insn[i].code) != BPF_JMP) {
+			continue;
+		}
+		if (prg.insn[i].jt == SK_FILTER_REJECT) {
+			prg.insn[i].jt = prg.len - 1 - (i + 1);
+		}
+		if (prg.insn[i].jf == SK_FILTER_REJECT) {
+			prg.insn[i].jf = prg.len - 1 - (i + 1);
+		}
+	}
+
+	fprog.len = prg.len;
+	fprog.filter = prg.insn;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+		       sizeof(fprog))) {
+		pr_err("setsockopt SO_ATTACH_FILTER failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
 int sk_general_init(int fd)
 {
 	int on = sk_check_fupsync ? 1 : 0;
@@ -325,15 +476,60 @@ int sk_interface_addr(const char *name, int family, struct address *addr)
 static short sk_events = POLLPRI;
 static short sk_revents = POLLPRI;
 
+static int sk_receive_cmsg(struct msghdr *msg, struct hw_timestamp *hwts)
+{
+	struct timespec *sw, *ts = NULL;
+	struct cmsghdr *cm;
+	int level, type;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		level = cm->cmsg_level;
+		type  = cm->cmsg_type;
+		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
+			if (cm->cmsg_len < sizeof(*ts) * 3) {
+				pr_warning("short SO_TIMESTAMPING message");
+				return -EMSGSIZE;
+			}
+			ts = (struct timespec *) CMSG_DATA(cm);
+		}
+		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
+			if (cm->cmsg_len < sizeof(*sw)) {
+				pr_warning("short SO_TIMESTAMPNS message");
+				return -EMSGSIZE;
+			}
+			sw = (struct timespec *) CMSG_DATA(cm);
+			hwts->sw = timespec_to_tmv(*sw);
+		}
+	}
+
+	if (!ts) {
+		memset(&hwts->ts, 0, sizeof(hwts->ts));
+		return 0;
+	}
+
+	switch (hwts->type) {
+	case TS_SOFTWARE:
+		hwts->ts = timespec_to_tmv(ts[0]);
+		break;
+	case TS_HARDWARE:
+	case TS_ONESTEP:
+	case TS_P2P1STEP:
+		hwts->ts = timespec_to_tmv(ts[2]);
+		break;
+	case TS_LEGACY_HW:
+		hwts->ts = timespec_to_tmv(ts[1]);
+		break;
+	}
+	return 0;
+}
+
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags)
 {
 	char control[256];
-	int cnt = 0, res = 0, level, type;
-	struct cmsghdr *cm;
+	int cnt = 0, res = 0;
 	struct iovec iov = { buf, buflen };
 	struct msghdr msg;
-	struct timespec *sw, *ts = NULL;
 
 	memset(control, 0, sizeof(control));
 	memset(&msg, 0, sizeof(msg));
@@ -363,51 +559,93 @@ int sk_receive(int fd, void *buf, int buflen,
 
 	cnt = recvmsg(fd, &msg, flags);
 	if (cnt < 0) {
+		/* Draining the error queue until it is empty is fine. */
+		if (flags == (MSG_ERRQUEUE | MSG_DONTWAIT) && errno == EAGAIN) {
+			return -EAGAIN;
+		}
 		pr_err("recvmsg%sfailed: %m",
-		       flags == MSG_ERRQUEUE ? " tx timestamp " : " ");
+		       flags & MSG_ERRQUEUE ? " tx timestamp " : " ");
 	}
-	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
-		level = cm->cmsg_level;
-		type  = cm->cmsg_type;
-		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
-			if (cm->cmsg_len < sizeof(*ts) * 3) {
-				pr_warning("short SO_TIMESTAMPING message");
-				return -EMSGSIZE;
-			}
-			ts = (struct timespec *) CMSG_DATA(cm);
-		}
-		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
-			if (cm->cmsg_len < sizeof(*sw)) {
-				pr_warning("short SO_TIMESTAMPNS message");
-				return -EMSGSIZE;
-			}
-			sw = (struct timespec *) CMSG_DATA(cm);
-			hwts->sw = timespec_to_tmv(*sw);
-		}
+	res = sk_receive_cmsg(&msg, hwts);
+	if (res) {
+		return res;
 	}
 
 	if (addr)
 		addr->len = msg.msg_namelen;
 
-	if (!ts) {
-		memset(&hwts->ts, 0, sizeof(hwts->ts));
-		return cnt < 1 ? -errno : cnt;
+	return cnt < 1 ? -errno : cnt;
+}
+
+int sk_send_batch(int fd, struct sk_tx *tx, int n, socklen_t addrlen)
+{
+	struct mmsghdr mmsg[SK_TX_BATCH_MAX];
+	struct iovec iov[SK_TX_BATCH_MAX];
+	int cnt, i, sent = 0;
+
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = tx[i].buf;
+		iov[i].iov_len = tx[i].len;
+		if (addrlen && tx[i].addr) {
+			mmsg[i].msg_hdr.msg_name = &tx[i].addr->sa;
+			mmsg[i].msg_hdr.msg_namelen = addrlen;
+		}
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
 	}
 
-	switch (hwts->type) {
-	case TS_SOFTWARE:
-		hwts->ts = timespec_to_tmv(ts[0]);
-		break;
-	case TS_HARDWARE:
-	case TS_ONESTEP:
-	case TS_P2P1STEP:
-		hwts->ts = timespec_to_tmv(ts[2]);
-		break;
-	case TS_LEGACY_HW:
-		hwts->ts = timespec_to_tmv(ts[1]);
-		break;
+	while (sent < n) {
+		cnt = sendmmsg(fd, mmsg + sent, n - sent, 0);
+		if (cnt < 1) {
+			pr_err("sendmmsg failed: %m");
+			return sent ? sent : -errno;
+		}
+		sent += cnt;
 	}
-	return cnt < 1 ? -errno : cnt;
+	return sent;
+}
+
+int sk_receive_batch(int fd, struct sk_rx *rx, int n, int flags)
+{
+	char control[SK_RX_BATCH_MAX][256];
+	struct mmsghdr mmsg[SK_RX_BATCH_MAX];
+	struct iovec iov[SK_RX_BATCH_MAX];
+	int cnt, err, i;
+
+	if (n > SK_RX_BATCH_MAX) {
+		n = SK_RX_BATCH_MAX;
+	}
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = rx[i].buf;
+		iov[i].iov_len = rx[i].buflen;
+		if (rx[i].addr) {
+			mmsg[i].msg_hdr.msg_name = &rx[i].addr->ss;
+			mmsg[i].msg_hdr.msg_namelen = sizeof(rx[i].addr->ss);
+		}
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+		mmsg[i].msg_hdr.msg_control = control[i];
+		mmsg[i].msg_hdr.msg_controllen = sizeof(control[i]);
+	}
+
+	cnt = recvmmsg(fd, mmsg, n, flags, NULL);
+	if (cnt < 1) {
+		pr_err("recvmmsg failed: %m");
+		return cnt < 0 ? -errno : -EAGAIN;
+	}
+	for (i = 0; i < cnt; i++) {
+		err = sk_receive_cmsg(&mmsg[i].msg_hdr, rx[i].hwts);
+		if (rx[i].addr) {
+			rx[i].addr->len = mmsg[i].msg_hdr.msg_namelen;
+		}
+		rx[i].cnt = err ? err : (int) mmsg[i].msg_len;
+	}
+	return cnt;
 }
 
 int sk_set_priority(int fd, int family, uint8_t dscp)
@@ -23,6 +23,8 @@
 #include "address.h"
 #include "transport.h"
 
+struct sock_filter;
+
 /**
  * Defines the available Hardware time-stamp setting modes.
  */
@@ -49,6 +51,41 @@ struct sk_ts_info {
 	unsigned int rx_filters;
 };
 
+/** The largest number of messages read by one call to sk_receive_batch(). */
+#define SK_RX_BATCH_MAX 32
+
+/** The largest number of messages sent by one call to sk_send_batch(). */
+#define SK_TX_BATCH_MAX 32
+
+/**
+ * Describes one message of a batch for sk_send_batch().
+ * @buf:     the message to send.
+ * @len:     length of the message in bytes.
+ * @addr:    destination address, may be NULL when the socket does not
+ *           need one.
+ */
+struct sk_tx {
+	void *buf;
+	int len;
+	struct address *addr;
+};
+
+/**
+ * Describes one message of a batch for sk_receive_batch().
+ * @buf:     buffer to receive the message.
+ * @buflen:  size of 'buf' in bytes.
+ * @addr:    buffer to receive the source address, may be NULL.
+ * @hwts:    buffer to receive the message's time stamp.
+ * @cnt:     set to the length of the message, or to a negative error code.
+ */
+struct sk_rx {
+	void *buf;
+	int buflen;
+	struct address *addr;
+	struct hw_timestamp *hwts;
+	int cnt;
+};
+
 /**
  * Obtains a socket suitable for use with sk_interface_index().
  * @return  An open socket on success, -1 otherwise.
@@ -63,6 +100,28 @@ int sk_interface_fd(void);
  */
 int sk_interface_index(int fd, const char *device);
 
+/** A placeholder for a jump to the reject instruction of sk_set_filter(). */
+#define SK_FILTER_REJECT 0xff
+
+/**
+ * Attach a socket filter which drops the PTP messages described by a
+ * transport filter.
+ * @param fd        An open socket.
+ * @param prologue  Instructions which check the lower layers and leave the
+ *                  offset of the PTP header from 'offset' in the X register.
+ *                  They may jump to SK_FILTER_REJECT. If NULL, X is zero.
+ * @param len       The number of instructions in 'prologue'.
+ * @param offset    The fixed offset of the PTP header in the packet.
+ * @param snaplen   The number of bytes of an accepted packet to keep.
+ * @param event     1 to accept only event messages, 0 to accept only
+ *                  general messages, -1 to accept both.
+ * @param f         The messages to drop, or NULL to drop none.
+ * @return          Zero on success, non-zero otherwise.
+ */
+int sk_set_filter(int fd, struct sock_filter *prologue, int len,
+		  uint32_t offset, uint32_t snaplen, int event,
+		  struct transport_filter *f);
+
 /**
  * Prepare a given socket for PTP "general" messages.
  * @param fd  An open socket.
@@ -109,6 +168,32 @@ int sk_interface_addr(const char *name, int family, struct address *addr);
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags);
 
+/**
+ * Read a batch of messages from a socket with a single system call.
+ * @param fd      An open socket.
+ * @param rx      Array of message descriptors.
+ * @param n       Number of elements in 'rx', at most SK_RX_BATCH_MAX
+ *                of them are used.
+ * @param flags   Flags to pass to RECVMMSG(2).
+ * @return        The number of messages received, which have their 'cnt'
+ *                field set, or a negative error code.
+ */
+int sk_receive_batch(int fd, struct sk_rx *rx, int n, int flags);
+
+/**
+ * Send a batch of messages on a socket with as few system calls as
+ * possible. Transmit time stamps are not collected.
+ * @param fd      An open socket.
+ * @param tx      Array of message descriptors.
+ * @param n       Number of elements in 'tx', at most SK_TX_BATCH_MAX
+ *                of them are used.
+ * @param addrlen Length of the socket addresses to pass to the kernel,
+ *                or zero to send without destination addresses.
+ * @return        The number of messages sent, or a negative error code
+ *                if none could be sent.
+ */
+int sk_send_batch(int fd, struct sk_tx *tx, int n, socklen_t addrlen);
+
 /**
  * Set DSCP value for socket.
  * @param fd     An open socket.
@@ -22,6 +22,19 @@
 
 #include "stats.h"
 
+/*
+ * The percentiles are estimated from a log-linear histogram of the
+ * absolute values rounded to integers. Values below 2 * HIST_SUB have
+ * their own buckets and each power of two above that is split into
+ * HIST_SUB buckets, which bounds the relative error to 1 / HIST_SUB.
+ * Values of 2^HIST_MAX_BITS and above are counted in the last bucket.
+ */
+#define HIST_SUB_BITS	5
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS	40
+#define HIST_MAX	((1ULL << HIST_MAX_BITS) - 1)
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
 struct stats {
 	unsigned int num;
 	double min;
@@ -29,8 +42,55 @@ struct stats {
 	double mean;
 	double sum_sqr;
 	double sum_diff_sqr;
+	unsigned int hist[HIST_BUCKETS];
 };
 
+static int hist_index(double value)
+{
+	unsigned long long u;
+	int shift;
+
+	value = fabs(value);
+	u = value < HIST_MAX ? (unsigned long long) (value + 0.5) : HIST_MAX;
+	if (u < 2 * HIST_SUB)
+		return u;
+
+	shift = 63 - __builtin_clzll(u) - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + (u >> shift) - HIST_SUB;
+}
+
+static double hist_value(int index)
+{
+	unsigned long long low;
+	int shift;
+
+	if (index < 2 * HIST_SUB)
+		return index;
+
+	shift = index / HIST_SUB - 1;
+	low = (unsigned long long) (index % HIST_SUB + HIST_SUB) << shift;
+	return low + ((1ULL << shift) - 1) / 2.0;
+}
+
+static double hist_quantile(struct stats *stats, double max_abs, double q)
+{
+	unsigned long long rank, count = 0;
+	double value;
+	int i;
+
+	rank = ceil(q * stats->num);
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		count += stats->hist[i];
+		if (count >= rank)
+			break;
+	}
+	value = hist_value(i);
+	return value < max_abs ? value : max_abs;
+}
+
 struct stats *stats_create(void)
 {
 	struct stats *stats;
@@ -57,6 +117,7 @@ void stats_add_value(struct stats *stats, double value)
 	stats->mean = old_mean + (value - old_mean) / stats->num;
 	stats->sum_sqr += value * value;
 	stats->sum_diff_sqr += (value - old_mean) * (value - stats->mean);
+	stats->hist[hist_index(value)]++;
 }
 
 unsigned int stats_get_num_values(struct stats *stats)
@@ -75,6 +136,40 @@ int stats_get_result(struct stats *stats, struct stats_result *result)
 	result->mean = stats->mean;
 	result->rms = sqrt(stats->sum_sqr / stats->num);
 	result->stddev = sqrt(stats->sum_diff_sqr / stats->num);
+	result->p50 = hist_quantile(stats, result->max_abs, 0.5);
+	result->p99 = hist_quantile(stats, result->max_abs, 0.99);
+	result->p999 = hist_quantile(stats, result->max_abs, 0.999);
+
+	return 0;
+}
+
+int stats_merge(struct stats *dst, struct stats *src)
+{
+	double delta;
+	unsigned int num;
+	int i;
+
+	if (!src->num)
+		return 0;
+	if (dst->num > ~0U - src->num)
+		return -1;
+
+	if (!dst->num || dst->max < src->max)
+		dst->max = src->max;
+	if (!dst->num || dst->min > src->min)
+		dst->min = src->min;
+
+	/* Combine the variances as in Chan et al. */
+	num = dst->num + src->num;
+	delta = src->mean - dst->mean;
+	dst->sum_diff_sqr += src->sum_diff_sqr +
+		delta * delta * dst->num / num * src->num;
+	dst->mean += delta * src->num / num;
+	dst->sum_sqr += src->sum_sqr;
+	dst->num = num;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->hist[i] += src->hist[i];
 
 	return 0;
 }
@@ -56,6 +56,9 @@ struct stats_result {
 	double mean;
 	double rms;
 	double stddev;
+	double p50;	/* percentiles of the absolute values */
+	double p99;
+	double p999;
 };
 
 /**
@@ -66,6 +69,14 @@ struct stats_result {
  */
 int stats_get_result(struct stats *stats, struct stats_result *result);
 
+/**
+ * Add the values collected in one instance of stats to another one.
+ * @param dst Pointer to stats obtained via @ref stats_create().
+ * @param src Pointer to stats obtained via @ref stats_create().
+ * @return    Zero on success, non-zero if the number of values would overflow.
+ */
+int stats_merge(struct stats *dst, struct stats *src);
+
 /**
  * Reset all statistics.
  * @param stats Pointer to stats obtained via @ref stats_create().
@@ -18,6 +18,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <linux/ptp_clock.h>
@@ -90,9 +91,109 @@ static int64_t sysoff_estimate(struct ptp_clock_time *pct, int extended,
 	return best_offset;
 }
 
+static void sort_intervals(int64_t *v, int n)
+{
+	int64_t x;
+	int i, j;
+
+	for (i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+int sysoff_filter(struct sysoff_reading *r, int n, int64_t *result,
+		  uint64_t *ts, int64_t *delay, double *uncertainty)
+{
+	int64_t d[SYSOFF_MAX_READINGS], limit, median, mad;
+	int64_t lo = INT64_MIN, hi = INT64_MAX, mid_sum = 0, ts_sum = 0;
+	int64_t base, interval, min_interval = INT64_MAX;
+	int i, k = 0;
+
+	if (n > SYSOFF_MAX_READINGS)
+		n = SYSOFF_MAX_READINGS;
+
+	for (i = 0; i < n; i++) {
+		d[i] = r[i].after - r[i].before;
+		if (d[i] < min_interval)
+			min_interval = d[i];
+	}
+
+	/*
+	 * Readings delayed by an interrupt, a CPU migration or an SMI
+	 * have a longer interval. Drop those beyond three standard
+	 * deviations of the median, with the deviation estimated from
+	 * the median absolute deviation.
+	 */
+	limit = INT64_MAX;
+	if (n >= 3) {
+		sort_intervals(d, n);
+		median = d[n / 2];
+		for (i = 0; i < n; i++)
+			d[i] = llabs(d[i] - median);
+		sort_intervals(d, n);
+		mad = d[n / 2];
+		limit = median + 3 * 1.4826 * mad;
+	}
+
+	/*
+	 * The clock was read somewhere between the two other readings,
+	 * so each reading bounds the offset. The estimate is the middle
+	 * of the intersection of all the bounds.
+	 */
+	base = r[0].before;
+	for (i = 0; i < n; i++) {
+		interval = r[i].after - r[i].before;
+		if (interval > limit)
+			continue;
+		if (r[i].before - r[i].clock > lo)
+			lo = r[i].before - r[i].clock;
+		if (r[i].after - r[i].clock < hi)
+			hi = r[i].after - r[i].clock;
+		mid_sum += r[i].before - r[i].clock + interval / 2 -
+			(r[0].before - r[0].clock);
+		ts_sum += r[i].before + interval / 2 - base;
+		k++;
+	}
+
+	if (lo <= hi) {
+		*result = lo + (hi - lo) / 2;
+		*uncertainty = (hi - lo) / 2.0;
+	} else {
+		/* The readings are not consistent, fall back to the mean. */
+		*result = r[0].before - r[0].clock + mid_sum / k;
+		*uncertainty = min_interval / 2.0 + (lo - hi);
+	}
+	*ts = base + ts_sum / k;
+	*delay = min_interval;
+	return k;
+}
+
+static void sysoff_readings(struct ptp_clock_time *pct, int extended,
+			    int n_samples, struct sysoff_reading *r)
+{
+	int i;
+
+	for (i = 0; i < n_samples; i++) {
+		if (extended) {
+			r[i].before = pctns(&pct[3*i]);
+			r[i].clock = pctns(&pct[3*i+1]);
+			r[i].after = pctns(&pct[3*i+2]);
+		} else {
+			r[i].before = pctns(&pct[2*i]);
+			r[i].clock = pctns(&pct[2*i+1]);
+			r[i].after = pctns(&pct[2*i+2]);
+		}
+	}
+}
+
 static int sysoff_extended(int fd, int n_samples,
-			   int64_t *result, uint64_t *ts, int64_t *delay)
+			   int64_t *result, uint64_t *ts, int64_t *delay,
+			   double *uncertainty)
 {
+	struct sysoff_reading r[PTP_MAX_SAMPLES];
 	struct ptp_sys_offset_extended pso;
 	memset(&pso, 0, sizeof(pso));
 	pso.n_samples = n_samples;
@@ -100,13 +201,21 @@ static int sysoff_extended(int fd, int n_samples,
 		pr_debug("ioctl PTP_SYS_OFFSET_EXTENDED: %m");
 		return SYSOFF_RUN_TIME_MISSING;
 	}
-	*result = sysoff_estimate(&pso.ts[0][0], 1, n_samples, ts, delay);
+	if (uncertainty) {
+		sysoff_readings(&pso.ts[0][0], 1, n_samples, r);
+		sysoff_filter(r, n_samples, result, ts, delay, uncertainty);
+	} else {
+		*result = sysoff_estimate(&pso.ts[0][0], 1, n_samples,
+					  ts, delay);
+	}
 	return SYSOFF_EXTENDED;
 }
 
 static int sysoff_basic(int fd, int n_samples,
-			int64_t *result, uint64_t *ts, int64_t *delay)
+			int64_t *result, uint64_t *ts, int64_t *delay,
+			double *uncertainty)
 {
+	struct sysoff_reading r[PTP_MAX_SAMPLES];
 	struct ptp_sys_offset pso;
 	memset(&pso, 0, sizeof(pso));
 	pso.n_samples = n_samples;
@@ -114,7 +223,12 @@ static int sysoff_basic(int fd, int n_samples,
 		perror("ioctl PTP_SYS_OFFSET");
 		return SYSOFF_RUN_TIME_MISSING;
 	}
-	*result = sysoff_estimate(pso.ts, 0, n_samples, ts, delay);
+	if (uncertainty) {
+		sysoff_readings(pso.ts, 0, n_samples, r);
+		sysoff_filter(r, n_samples, result, ts, delay, uncertainty);
+	} else {
+		*result = sysoff_estimate(pso.ts, 0, n_samples, ts, delay);
+	}
 	return SYSOFF_BASIC;
 }
 
@@ -126,9 +240,29 @@ int sysoff_measure(int fd, int method, int n_samples,
 		*delay = 0;
 		return sysoff_precise(fd, result, ts);
 	case SYSOFF_EXTENDED:
-		return sysoff_extended(fd, n_samples, result, ts, delay);
+		return sysoff_extended(fd, n_samples, result, ts, delay, NULL);
+	case SYSOFF_BASIC:
+		return sysoff_basic(fd, n_samples, result, ts, delay, NULL);
+	}
+	return SYSOFF_RUN_TIME_MISSING;
+}
+
+int sysoff_measure_filtered(int fd, int method, int n_samples,
+			    int64_t *result, uint64_t *ts, int64_t *delay,
+			    double *uncertainty)
+{
+	switch (method) {
+	case SYSOFF_PRECISE:
+		/* Cross timestamping has no readings to filter. */
+		*delay = 0;
+		*uncertainty = 0.0;
+		return sysoff_precise(fd, result, ts);
+	case SYSOFF_EXTENDED:
+		return sysoff_extended(fd, n_samples, result, ts, delay,
+				       uncertainty);
 	case SYSOFF_BASIC:
-		return sysoff_basic(fd, n_samples, result, ts, delay);
+		return sysoff_basic(fd, n_samples, result, ts, delay,
+				    uncertainty);
 	}
 	return SYSOFF_RUN_TIME_MISSING;
 }
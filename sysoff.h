@@ -21,6 +21,17 @@
 #include <stdint.h>
 #include "missing.h"
 
+#define SYSOFF_MAX_READINGS 64
+
+/**
+ * One reading of a clock taken between two readings of another clock.
+ */
+struct sysoff_reading {
+	int64_t before;
+	int64_t clock;
+	int64_t after;
+};
+
 enum {
 	SYSOFF_RUN_TIME_MISSING = -1,
 	SYSOFF_PRECISE,
@@ -48,3 +59,35 @@ int sysoff_probe(int fd, int n_samples);
  */
 int sysoff_measure(int fd, int method, int n_samples,
 		   int64_t *result, uint64_t *ts, int64_t *delay);
+
+/**
+ * Measure the offset between a PHC and the system time like
+ * sysoff_measure(), but reject the outlying readings and estimate the
+ * uncertainty of the result.
+ * @param fd           An open file descriptor to a PHC device.
+ * @param method       A non-negative SYSOFF_ value returned by sysoff_probe().
+ * @param n_samples    The number of consecutive readings to make.
+ * @param result       The estimated offset in nanoseconds.
+ * @param ts           The system time corresponding to the 'result'.
+ * @param delay        The delay in reading of the clock in nanoseconds.
+ * @param uncertainty  The maximum error of 'result' in nanoseconds.
+ * @return  One of the SYSOFF_ enumeration values.
+ */
+int sysoff_measure_filtered(int fd, int method, int n_samples,
+			    int64_t *result, uint64_t *ts, int64_t *delay,
+			    double *uncertainty);
+
+/**
+ * Estimate the offset between two clocks from readings of one clock
+ * taken between pairs of readings of the other clock. Readings with an
+ * outlying interval are rejected.
+ * @param r            The readings.
+ * @param n            The number of readings, at most SYSOFF_MAX_READINGS.
+ * @param result       The estimated offset, 'before' minus 'clock'.
+ * @param ts           The 'before' clock time corresponding to the 'result'.
+ * @param delay        The shortest interval between 'before' and 'after'.
+ * @param uncertainty  The maximum error of 'result' in nanoseconds.
+ * @return  The number of readings used in the estimate.
+ */
+int sysoff_filter(struct sysoff_reading *r, int n, int64_t *result,
+		  uint64_t *ts, int64_t *delay, double *uncertainty);
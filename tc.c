@@ -18,6 +18,7 @@
  */
 #include <stdlib.h>
 
+#include "config.h"
 #include "port.h"
 #include "print.h"
 #include "tc.h"
@@ -30,27 +31,105 @@ enum tc_match {
 	TC_DELAY_REQRESP,
 };
 
-static TAILQ_HEAD(tc_pool, tc_txd) tc_pool = TAILQ_HEAD_INITIALIZER(tc_pool);
+/*
+ * The remembered messages of all ports are indexed by egress port,
+ * ingress port, source port identity, sequenceId and domain. The
+ * tc_transmitted list of each port keeps them in order of arrival,
+ * which lets tc_prune() stop at the first current one.
+ */
+#define TC_HASH_BITS	10
+#define TC_HASH_SIZE	(1 << TC_HASH_BITS)
+
+static LIST_HEAD(tc_hash, tc_txd) tc_hash[TC_HASH_SIZE];
+
+static int tc_match_delay(int ingress_port, int egress_port,
+			  struct ptp_message *resp, struct tc_txd *txd);
+static int tc_match_syfup(int ingress_port, int egress_port,
+			  struct ptp_message *msg, struct tc_txd *txd);
+static void tc_recycle(struct port *p, struct tc_txd *txd);
+static void tc_remove(struct port *p, struct tc_txd *txd);
+
+static unsigned int tc_fnv(unsigned int hash, const void *data, size_t len)
+{
+	const unsigned char *buf = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= buf[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
 
-static int tc_match_delay(int ingress_port, struct ptp_message *resp,
-			  struct tc_txd *txd);
-static int tc_match_syfup(int ingress_port, struct ptp_message *msg,
-			  struct tc_txd *txd);
-static void tc_recycle(struct tc_txd *txd);
+static struct tc_hash *tc_bucket(int ingress_port, int egress_port,
+				 struct ptp_message *m, struct PortIdentity *pid)
+{
+	unsigned int hash = 2166136261u;
+	UInteger16 ports[2] = { ingress_port, egress_port };
+
+	hash = tc_fnv(hash, ports, sizeof(ports));
+	hash = tc_fnv(hash, pid, sizeof(*pid));
+	hash = tc_fnv(hash, &m->header.sequenceId, sizeof(m->header.sequenceId));
+	hash = tc_fnv(hash, &m->header.domainNumber,
+		      sizeof(m->header.domainNumber));
+
+	return &tc_hash[(hash ^ (hash >> TC_HASH_BITS)) & (TC_HASH_SIZE - 1)];
+}
 
-static struct tc_txd *tc_allocate(void)
+/*
+ * Takes a record from the arena of the egress port. When the arena is
+ * full, the expired records are pruned, and then either the oldest
+ * record is reused or the new one is refused.
+ */
+static struct tc_txd *tc_allocate(struct port *p)
 {
-	struct tc_txd *txd = TAILQ_FIRST(&tc_pool);
+	struct tc_stats *s = &p->tc_stats;
+	struct tc_txd *txd = TAILQ_FIRST(&p->tc_free);
 
-	if (txd) {
-		TAILQ_REMOVE(&tc_pool, txd, list);
-		memset(txd, 0, sizeof(*txd));
-		return txd;
+	if (!txd) {
+		tc_prune(p);
+		txd = TAILQ_FIRST(&p->tc_free);
+	}
+	if (!txd) {
+		if (!p->tc_evict_oldest || TAILQ_EMPTY(&p->tc_transmitted)) {
+			s->dropped++;
+			return NULL;
+		}
+		tc_remove(p, TAILQ_FIRST(&p->tc_transmitted));
+		s->evicted++;
+		txd = TAILQ_FIRST(&p->tc_free);
+	}
+	TAILQ_REMOVE(&p->tc_free, txd, list);
+	memset(txd, 0, sizeof(*txd));
+	s->in_use++;
+	if (s->high_water < s->in_use) {
+		s->high_water = s->in_use;
 	}
-	txd = calloc(1, sizeof(*txd));
 	return txd;
 }
 
+static void tc_insert(struct port *q, struct port *p, struct ptp_message *msg,
+		      tmv_t residence, struct tc_txd *txd)
+{
+	msg_get(msg);
+	txd->msg = msg;
+	txd->residence = residence;
+	txd->ingress_port = portnum(q);
+	txd->egress_port = portnum(p);
+	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	LIST_INSERT_HEAD(tc_bucket(txd->ingress_port, txd->egress_port, msg,
+				   &msg->header.sourcePortIdentity),
+			 txd, hash);
+}
+
+static void tc_remove(struct port *p, struct tc_txd *txd)
+{
+	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
+	LIST_REMOVE(txd, hash);
+	msg_put(txd->msg);
+	tc_recycle(p, txd);
+}
+
 static int tc_blocked(struct port *q, struct port *p, struct ptp_message *m)
 {
 	enum port_state s;
@@ -120,9 +199,8 @@ static int tc_blocked(struct port *q, struct port *p, struct ptp_message *m)
 static void tc_complete_request(struct port *q, struct port *p,
 				struct ptp_message *req, tmv_t residence)
 {
-	struct tc_txd *txd = tc_allocate();
+	struct tc_txd *txd = tc_allocate(p);
 	if (!txd) {
-		port_dispatch(p, EV_FAULT_DETECTED, 0);
 		return;
 	}
 #ifdef DEBUG
@@ -130,17 +208,14 @@ static void tc_complete_request(struct port *q, struct port *p,
 	       portnum(q), portnum(p), ntohs(req->header.sequenceId),
 	       (unsigned long) tmv_to_nanoseconds(residence));
 #endif
-	msg_get(req);
-	txd->msg = req;
-	txd->residence = residence;
-	txd->ingress_port = portnum(q);
-	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	tc_insert(q, p, req, residence, txd);
 }
 
 static void tc_complete_response(struct port *q, struct port *p,
 				 struct ptp_message *resp, tmv_t residence)
 {
 	enum tc_match type = TC_MISMATCH;
+	struct tc_hash *bucket;
 	struct tc_txd *txd;
 	Integer64 c1, c2;
 	int cnt;
@@ -149,8 +224,10 @@ static void tc_complete_response(struct port *q, struct port *p,
 	pr_err("complete delay response from port %hd to %hd seqid %hu",
 	       portnum(q), portnum(p), ntohs(resp->header.sequenceId));
 #endif
-	TAILQ_FOREACH(txd, &q->tc_transmitted, list) {
-		type = tc_match_delay(portnum(p), resp, txd);
+	bucket = tc_bucket(portnum(p), portnum(q), resp,
+			   &resp->delay_resp.requestingPortIdentity);
+	LIST_FOREACH(txd, bucket, hash) {
+		type = tc_match_delay(portnum(p), portnum(q), resp, txd);
 		if (type == TC_DELAY_REQRESP) {
 			residence = txd->residence;
 			break;
@@ -169,9 +246,7 @@ static void tc_complete_response(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	resp->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_remove(q, txd);
 }
 
 static void tc_complete_syfup(struct port *q, struct port *p,
@@ -179,12 +254,15 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 {
 	enum tc_match type = TC_MISMATCH;
 	struct ptp_message *fup;
+	struct tc_hash *bucket;
 	struct tc_txd *txd;
 	Integer64 c1, c2;
 	int cnt;
 
-	TAILQ_FOREACH(txd, &p->tc_transmitted, list) {
-		type = tc_match_syfup(portnum(q), msg, txd);
+	bucket = tc_bucket(portnum(q), portnum(p), msg,
+			   &msg->header.sourcePortIdentity);
+	LIST_FOREACH(txd, bucket, hash) {
+		type = tc_match_syfup(portnum(q), portnum(p), msg, txd);
 		switch (type) {
 		case TC_MISMATCH:
 			break;
@@ -205,16 +283,11 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 
 	if (type == TC_MISMATCH) {
-		txd = tc_allocate();
+		txd = tc_allocate(p);
 		if (!txd) {
-			port_dispatch(p, EV_FAULT_DETECTED, 0);
 			return;
 		}
-		msg_get(msg);
-		txd->msg = msg;
-		txd->residence = residence;
-		txd->ingress_port = portnum(q);
-		TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+		tc_insert(q, p, msg, residence, txd);
 		return;
 	}
 
@@ -230,9 +303,7 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	fup->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_remove(p, txd);
 }
 
 static void tc_complete(struct port *q, struct port *p,
@@ -263,16 +334,19 @@ static int tc_current(struct ptp_message *m, struct timespec now)
 	return t2 - t1 < tmo;
 }
 
+/*
+ * Sends the event message out all other ports at once. The transmit
+ * time stamps are gathered by the main loop, which then completes the
+ * forwarding in tc_fwd_complete() for each egress port on its own.
+ */
 static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 {
-	tmv_t egress, ingress = msg->hwts.ts, residence;
+	tmv_t ingress = msg->hwts.ts;
 	struct port *p;
-	int cnt, err;
-	double rr;
+	int cnt;
 
 	clock_gettime(CLOCK_MONOTONIC, &msg->ts.host);
 
-	/* First send the event message out. */
 	for (p = clock_first_port(q->clock); p; p = LIST_NEXT(p, list)) {
 		if (tc_blocked(q, p, msg)) {
 			continue;
@@ -282,40 +356,28 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 			pr_err("failed to forward event from port %hd to %hd",
 				portnum(q), portnum(p));
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
-		}
-	}
-
-	/* Go back and gather the transmit time stamps. */
-	for (p = clock_first_port(q->clock); p; p = LIST_NEXT(p, list)) {
-		if (tc_blocked(q, p, msg)) {
 			continue;
 		}
-		err = transport_txts(&p->fda, msg);
-		if (err || !msg_sots_valid(msg)) {
-			pr_err("failed to fetch txts on port %hd to %hd event",
+		if (port_tx_forward(p, q, msg, ingress)) {
+			pr_err("failed to defer txts on port %hd to %hd event",
 				portnum(q), portnum(p));
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
-			continue;
 		}
-		ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
-		egress = msg->hwts.ts;
-		residence = tmv_sub(egress, ingress);
-		rr = clock_rate_ratio(q->clock);
-		if (rr != 1.0) {
-			residence = dbl_tmv(tmv_dbl(residence) * rr);
-		}
-		tc_complete(q, p, msg, residence);
 	}
 
 	return 0;
 }
 
-static int tc_match_delay(int ingress_port, struct ptp_message *resp,
-			  struct tc_txd *txd)
+static int tc_match_delay(int ingress_port, int egress_port,
+			  struct ptp_message *resp, struct tc_txd *txd)
 {
 	struct ptp_message *req = txd->msg;
 
-	if (ingress_port != txd->ingress_port) {
+	if (ingress_port != txd->ingress_port ||
+	    egress_port != txd->egress_port) {
+		return TC_MISMATCH;
+	}
+	if (req->header.domainNumber != resp->header.domainNumber) {
 		return TC_MISMATCH;
 	}
 	if (req->header.sequenceId != resp->header.sequenceId) {
@@ -331,10 +393,14 @@ static int tc_match_delay(int ingress_port, struct ptp_message *resp,
 	return TC_MISMATCH;
 }
 
-static int tc_match_syfup(int ingress_port, struct ptp_message *msg,
-			  struct tc_txd *txd)
+static int tc_match_syfup(int ingress_port, int egress_port,
+			  struct ptp_message *msg, struct tc_txd *txd)
 {
-	if (ingress_port != txd->ingress_port) {
+	if (ingress_port != txd->ingress_port ||
+	    egress_port != txd->egress_port) {
+		return TC_MISMATCH;
+	}
+	if (msg->header.domainNumber != txd->msg->header.domainNumber) {
 		return TC_MISMATCH;
 	}
 	if (msg->header.sequenceId != txd->msg->header.sequenceId) {
@@ -352,21 +418,19 @@ static int tc_match_syfup(int ingress_port, struct ptp_message *msg,
 	return TC_MISMATCH;
 }
 
-static void tc_recycle(struct tc_txd *txd)
+static void tc_recycle(struct port *p, struct tc_txd *txd)
 {
-	TAILQ_INSERT_HEAD(&tc_pool, txd, list);
+	TAILQ_INSERT_HEAD(&p->tc_free, txd, list);
+	p->tc_stats.in_use--;
 }
 
 /* public methods */
 
-void tc_cleanup(void)
+void tc_cleanup(struct port *q)
 {
-	struct tc_txd *txd;
-
-	while ((txd = TAILQ_FIRST(&tc_pool)) != NULL) {
-		TAILQ_REMOVE(&tc_pool, txd, list);
-		free(txd);
-	}
+	tc_flush(q);
+	free(q->tc_arena);
+	q->tc_arena = NULL;
 }
 
 void tc_flush(struct port *q)
@@ -374,9 +438,7 @@ void tc_flush(struct port *q)
 	struct tc_txd *txd;
 
 	while ((txd = TAILQ_FIRST(&q->tc_transmitted)) != NULL) {
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+		tc_remove(q, txd);
 	}
 }
 
@@ -405,6 +467,20 @@ int tc_forward(struct port *q, struct ptp_message *msg)
 	return 0;
 }
 
+void tc_fwd_complete(struct port *q, struct port *p, struct ptp_message *msg,
+		     tmv_t ingress, tmv_t egress)
+{
+	tmv_t residence;
+	double rr;
+
+	residence = tmv_sub(egress, ingress);
+	rr = clock_rate_ratio(q->clock);
+	if (rr != 1.0) {
+		residence = dbl_tmv(tmv_dbl(residence) * rr);
+	}
+	tc_complete(q, p, msg, residence);
+}
+
 int tc_fwd_folup(struct port *q, struct ptp_message *msg)
 {
 	struct port *p;
@@ -472,6 +548,27 @@ int tc_fwd_sync(struct port *q, struct ptp_message *msg)
 	return err;
 }
 
+int tc_init(struct port *q)
+{
+	struct config *cfg = clock_config(q->clock);
+	int i, n;
+
+	n = config_int(cfg, q->cfg_section, CFG_TC_RECORDS);
+	q->tc_arena = calloc(n, sizeof(*q->tc_arena));
+	if (!q->tc_arena) {
+		pr_err("port %hu: failed to allocate %d tc records",
+		       portnum(q), n);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		TAILQ_INSERT_TAIL(&q->tc_free, &q->tc_arena[i], list);
+	}
+	q->tc_stats.records = n;
+	q->tc_evict_oldest = config_int(cfg, q->cfg_section,
+					CFG_TC_EVICT_OLDEST);
+	return 0;
+}
+
 int tc_ignore(struct port *p, struct ptp_message *m)
 {
 	struct ClockIdentity c1, c2;
@@ -507,8 +604,6 @@ void tc_prune(struct port *q)
 		if (tc_current(txd->msg, now)) {
 			break;
 		}
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+		tc_remove(q, txd);
 	}
 }
@@ -23,6 +23,12 @@
 #include "msg.h"
 #include "port_private.h"
 
+/**
+ * Releases the records of a transparent clock port.
+ * @param q    Port obtained via @ref port_open().
+ */
+void tc_cleanup(struct port *q);
+
 /**
  * Flushes the list of remembered residence times.
  * @param q    Port whose list should be flushed
@@ -37,6 +43,18 @@ void tc_flush(struct port *q);
  */
 int tc_forward(struct port *q, struct ptp_message *msg);
 
+/**
+ * Completes forwarding an event message once its transmit time stamp
+ * on the egress port has arrived.
+ * @param q        The ingress port
+ * @param p        The egress port
+ * @param msg      The forwarded event message
+ * @param ingress  The receive time stamp on the ingress port
+ * @param egress   The transmit time stamp on the egress port
+ */
+void tc_fwd_complete(struct port *q, struct port *p, struct ptp_message *msg,
+		     tmv_t ingress, tmv_t egress);
+
 /**
  * Forwards a given Follow-Up message out all other ports.
  *
@@ -85,6 +103,14 @@ int tc_fwd_response(struct port *q, struct ptp_message *msg);
  */
 int tc_fwd_sync(struct port *q, struct ptp_message *msg);
 
+/**
+ * Allocates the records for remembering residence times on a port,
+ * sized by the tc_records option. No records are allocated later on.
+ * @param q    Port whose records should be allocated
+ * @return     Zero on success, non-zero otherwise.
+ */
+int tc_init(struct port *q);
+
 /**
  * Determines whether the local clock should ignore a given message.
  *
@@ -123,6 +123,10 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 	struct grandmaster_settings_np *gsn;
 	struct subscribe_events_np *sen;
 	struct port_properties_np *ppn;
+	struct msg_pool_stats_np *mps;
+	struct clock_stats_np *csn;
+	struct port_foreign_stats_np *pfsn;
+	struct port_tc_stats_np *ptsn;
 	struct port_stats_np *psn;
 	struct mgmt_clock_description *cd;
 	int extra_len = 0, len;
@@ -318,6 +322,30 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		extra_len = sizeof(struct port_properties_np);
 		extra_len += ppn->interface.length;
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		if (data_len != sizeof(struct msg_pool_stats_np))
+			goto bad_length;
+		mps = (struct msg_pool_stats_np *) m->data;
+		mps->total = ntohl(mps->total);
+		mps->in_use = ntohl(mps->in_use);
+		mps->high_water = ntohl(mps->high_water);
+		mps->limit = ntohl(mps->limit);
+		mps->failures = ntohl(mps->failures);
+		break;
+	case TLV_CLOCK_STATS_NP:
+		if (data_len != sizeof(struct clock_stats_np))
+			goto bad_length;
+		csn = (struct clock_stats_np *) m->data;
+		csn->samples = ntohl(csn->samples);
+		csn->offset_rms = net2host64(csn->offset_rms);
+		csn->offset_max = net2host64(csn->offset_max);
+		csn->offset_p50 = net2host64(csn->offset_p50);
+		csn->offset_p99 = net2host64(csn->offset_p99);
+		csn->offset_p999 = net2host64(csn->offset_p999);
+		csn->delay_mean = net2host64(csn->delay_mean);
+		csn->delay_p99 = net2host64(csn->delay_p99);
+		csn->delay_p999 = net2host64(csn->delay_p999);
+		break;
 	case TLV_PORT_STATS_NP:
 		if (data_len < sizeof(struct port_stats_np))
 			goto bad_length;
@@ -326,6 +354,30 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 			ntohs(psn->portIdentity.portNumber);
 		extra_len = sizeof(struct port_stats_np);
 		break;
+	case TLV_PORT_TC_STATS_NP:
+		if (data_len != sizeof(struct port_tc_stats_np))
+			goto bad_length;
+		ptsn = (struct port_tc_stats_np *) m->data;
+		ptsn->portIdentity.portNumber =
+			ntohs(ptsn->portIdentity.portNumber);
+		ptsn->records = ntohl(ptsn->records);
+		ptsn->in_use = ntohl(ptsn->in_use);
+		ptsn->high_water = ntohl(ptsn->high_water);
+		ptsn->evicted = ntohl(ptsn->evicted);
+		ptsn->dropped = ntohl(ptsn->dropped);
+		break;
+	case TLV_PORT_FOREIGN_STATS_NP:
+		if (data_len != sizeof(struct port_foreign_stats_np))
+			goto bad_length;
+		pfsn = (struct port_foreign_stats_np *) m->data;
+		pfsn->portIdentity.portNumber =
+			ntohs(pfsn->portIdentity.portNumber);
+		pfsn->records = ntohl(pfsn->records);
+		pfsn->in_use = ntohl(pfsn->in_use);
+		pfsn->high_water = ntohl(pfsn->high_water);
+		pfsn->evicted = ntohl(pfsn->evicted);
+		pfsn->dropped = ntohl(pfsn->dropped);
+		break;
 	case TLV_SAVE_IN_NON_VOLATILE_STORAGE:
 	case TLV_RESET_NON_VOLATILE_STORAGE:
 	case TLV_INITIALIZE:
@@ -359,6 +411,10 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 	struct grandmaster_settings_np *gsn;
 	struct subscribe_events_np *sen;
 	struct port_properties_np *ppn;
+	struct msg_pool_stats_np *mps;
+	struct clock_stats_np *csn;
+	struct port_foreign_stats_np *pfsn;
+	struct port_tc_stats_np *ptsn;
 	struct port_stats_np *psn;
 	struct mgmt_clock_description *cd;
 	switch (m->id) {
@@ -432,11 +488,51 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 		ppn = (struct port_properties_np *)m->data;
 		ppn->portIdentity.portNumber = htons(ppn->portIdentity.portNumber);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		mps = (struct msg_pool_stats_np *) m->data;
+		mps->total = htonl(mps->total);
+		mps->in_use = htonl(mps->in_use);
+		mps->high_water = htonl(mps->high_water);
+		mps->limit = htonl(mps->limit);
+		mps->failures = htonl(mps->failures);
+		break;
+	case TLV_CLOCK_STATS_NP:
+		csn = (struct clock_stats_np *) m->data;
+		csn->samples = htonl(csn->samples);
+		csn->offset_rms = host2net64(csn->offset_rms);
+		csn->offset_max = host2net64(csn->offset_max);
+		csn->offset_p50 = host2net64(csn->offset_p50);
+		csn->offset_p99 = host2net64(csn->offset_p99);
+		csn->offset_p999 = host2net64(csn->offset_p999);
+		csn->delay_mean = host2net64(csn->delay_mean);
+		csn->delay_p99 = host2net64(csn->delay_p99);
+		csn->delay_p999 = host2net64(csn->delay_p999);
+		break;
 	case TLV_PORT_STATS_NP:
 		psn = (struct port_stats_np *)m->data;
 		psn->portIdentity.portNumber =
 			htons(psn->portIdentity.portNumber);
 		break;
+	case TLV_PORT_TC_STATS_NP:
+		ptsn = (struct port_tc_stats_np *) m->data;
+		ptsn->portIdentity.portNumber =
+			htons(ptsn->portIdentity.portNumber);
+		ptsn->records = htonl(ptsn->records);
+		ptsn->in_use = htonl(ptsn->in_use);
+		ptsn->high_water = htonl(ptsn->high_water);
+		ptsn->evicted = htonl(ptsn->evicted);
+		ptsn->dropped = htonl(ptsn->dropped);
+		break;
+	case TLV_PORT_FOREIGN_STATS_NP:
+		pfsn = (struct port_foreign_stats_np *) m->data;
+		pfsn->portIdentity.portNumber =
+			htons(pfsn->portIdentity.portNumber);
+		pfsn->records = htonl(pfsn->records);
+		pfsn->in_use = htonl(pfsn->in_use);
+		pfsn->high_water = htonl(pfsn->high_water);
+		pfsn->evicted = htonl(pfsn->evicted);
+		pfsn->dropped = htonl(pfsn->dropped);
+		break;
 	}
 }
 
@@ -100,6 +100,8 @@ enum management_action {
 #define TLV_GRANDMASTER_SETTINGS_NP			0xC001
 #define TLV_SUBSCRIBE_EVENTS_NP				0xC003
 #define TLV_SYNCHRONIZATION_UNCERTAIN_NP		0xC006
+#define TLV_MSG_POOL_STATS_NP				0xC007
+#define TLV_CLOCK_STATS_NP				0xC008
 
 /* Port management ID values */
 #define TLV_NULL_MANAGEMENT				0x0000
@@ -125,6 +127,8 @@ enum management_action {
 #define TLV_PORT_DATA_SET_NP				0xC002
 #define TLV_PORT_PROPERTIES_NP				0xC004
 #define TLV_PORT_STATS_NP				0xC005
+#define TLV_PORT_TC_STATS_NP				0xC009
+#define TLV_PORT_FOREIGN_STATS_NP			0xC00A
 
 /* Management error ID values */
 #define TLV_RESPONSE_TOO_BIG				0x0001
@@ -349,6 +353,45 @@ struct port_stats_np {
 	struct PortStats stats;
 } PACKED;
 
+struct port_tc_stats_np {
+	struct PortIdentity portIdentity;
+	UInteger32    records;
+	UInteger32    in_use;
+	UInteger32    high_water;
+	UInteger32    evicted;
+	UInteger32    dropped;
+} PACKED;
+
+struct port_foreign_stats_np {
+	struct PortIdentity portIdentity;
+	UInteger32    records;
+	UInteger32    in_use;
+	UInteger32    high_water;
+	UInteger32    evicted;
+	UInteger32    dropped;
+} PACKED;
+
+struct msg_pool_stats_np {
+	UInteger32    total;
+	UInteger32    in_use;
+	UInteger32    high_water;
+	UInteger32    limit;
+	UInteger32    failures;
+} PACKED;
+
+/* Summary statistics of the last interval, in nanoseconds. */
+struct clock_stats_np {
+	UInteger32    samples;
+	Integer64     offset_rms;
+	Integer64     offset_max;
+	Integer64     offset_p50;
+	Integer64     offset_p99;
+	Integer64     offset_p999;
+	Integer64     delay_mean;
+	Integer64     delay_p99;
+	Integer64     delay_p999;
+} PACKED;
+
 #define PROFILE_ID_LEN 6
 
 struct mgmt_clock_description {
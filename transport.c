@@ -18,10 +18,12 @@
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
 
 #include "transport.h"
 #include "transport_private.h"
 #include "raw.h"
+#include "sk.h"
 #include "udp.h"
 #include "udp6.h"
 #include "uds.h"
@@ -42,6 +44,32 @@ int transport_recv(struct transport *t, int fd, struct ptp_message *msg)
 	return t->recv(t, fd, msg, sizeof(msg->data), &msg->address, &msg->hwts);
 }
 
+int transport_recv_batch(struct transport *t, int fd,
+			 struct ptp_message **msg, int *cnt, int n)
+{
+	struct sk_rx rx[SK_RX_BATCH_MAX];
+	int i, res;
+
+	if (!t->recv_batch || n < 2) {
+		cnt[0] = transport_recv(t, fd, msg[0]);
+		return cnt[0] < 0 ? cnt[0] : 1;
+	}
+	if (n > SK_RX_BATCH_MAX) {
+		n = SK_RX_BATCH_MAX;
+	}
+	for (i = 0; i < n; i++) {
+		rx[i].buf = msg[i];
+		rx[i].buflen = sizeof(msg[i]->data);
+		rx[i].addr = &msg[i]->address;
+		rx[i].hwts = &msg[i]->hwts;
+	}
+	res = t->recv_batch(t, fd, rx, n);
+	for (i = 0; i < res; i++) {
+		cnt[i] = rx[i].cnt;
+	}
+	return res;
+}
+
 int transport_send(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg)
 {
@@ -77,6 +105,45 @@ int transport_txts(struct fdarray *fda,
 	return cnt > 0 ? 0 : cnt;
 }
 
+int transport_sendto_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event,
+			   struct ptp_message **msg, int n)
+{
+	struct sk_tx tx[SK_TX_BATCH_MAX];
+	int cnt, i, len;
+
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	if (!t->send_batch) {
+		for (i = 0; i < n; i++) {
+			len = ntohs(msg[i]->header.messageLength);
+			cnt = t->send(t, fda, event, 0, msg[i], len,
+				      &msg[i]->address, &msg[i]->hwts);
+			if (cnt <= 0) {
+				return i ? i : -1;
+			}
+		}
+		return n;
+	}
+	for (i = 0; i < n; i++) {
+		tx[i].buf = msg[i];
+		tx[i].len = ntohs(msg[i]->header.messageLength);
+		tx[i].addr = &msg[i]->address;
+	}
+	return t->send_batch(t, fda, event, tx, n);
+}
+
+int transport_txts_recv(struct fdarray *fda, int fd_index,
+			void *buf, int buflen, struct hw_timestamp *hwts)
+{
+	int cnt;
+
+	cnt = sk_receive(fda->fd[fd_index], buf, buflen, NULL, hwts,
+			 MSG_ERRQUEUE | MSG_DONTWAIT);
+	return cnt == -EAGAIN ? 0 : cnt;
+}
+
 int transport_physical_addr(struct transport *t, uint8_t *addr)
 {
 	if (t->physical_addr) {
@@ -93,6 +160,15 @@ int transport_protocol_addr(struct transport *t, uint8_t *addr)
 	return 0;
 }
 
+int transport_set_filter(struct transport *t, struct fdarray *fda,
+			 struct transport_filter *f)
+{
+	if (!t->set_filter) {
+		return 0;
+	}
+	return t->set_filter(t, fda, f);
+}
+
 enum transport_type transport_type(struct transport *t)
 {
 	return t->type;
@@ -62,6 +62,21 @@ int transport_open(struct transport *t, struct interface *iface,
 
 int transport_recv(struct transport *t, int fd, struct ptp_message *msg);
 
+/**
+ * Receives up to 'n' PTP messages using the given transport. Transports
+ * which do not support batching receive a single message.
+ * @param t	The transport.
+ * @param fd	The descriptor to read from.
+ * @param msg	Array of 'n' messages obtained via msg_allocate().
+ * @param cnt	Array of 'n' integers which receive the length of each
+ *		message, or a negative error code.
+ * @param n	The maximum number of messages to receive.
+ * @return	The number of messages received, or negative value in
+ *		case of an error.
+ */
+int transport_recv_batch(struct transport *t, int fd,
+			 struct ptp_message **msg, int *cnt, int n);
+
 /**
  * Sends the PTP message using the given transport. The message is sent to
  * the default (usually multicast) address, any address field in the
@@ -113,11 +128,75 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 int transport_txts(struct fdarray *fda,
 		   struct ptp_message *msg);
 
+/**
+ * Sends a batch of PTP messages, each one to the address stored in
+ * the message, using as few system calls as the transport allows.
+ *
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param event	1 for event message, 0 for general message.
+ * @param msg	Array of messages to send.
+ * @param n	Number of messages, at most SK_TX_BATCH_MAX.
+ * @return	Number of messages sent, or negative value in case of an error.
+ */
+int transport_sendto_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event,
+			   struct ptp_message **msg, int n);
+
+/**
+ * Reads one transmit time stamp from the error queue of a descriptor,
+ * without blocking. The buffer receives the looped back packet,
+ * including the headers of the lower layers.
+ *
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param fd_index	The index of the descriptor to read from.
+ * @param buf	Buffer for the looped back packet.
+ * @param buflen	Size of the buffer in bytes.
+ * @param hwts	Returns the time stamp. The caller sets the type.
+ * @return	Number of bytes received, zero if the error queue is empty,
+ *		or negative value in case of an error.
+ */
+int transport_txts_recv(struct fdarray *fda, int fd_index,
+			void *buf, int buflen, struct hw_timestamp *hwts);
+
 /**
  * Returns the transport's type.
  */
 enum transport_type transport_type(struct transport *t);
 
+/**
+ * Describes the messages which a port has no use for. Transports may
+ * drop them in the kernel, before they are copied to user space.
+ * @domain:         accept only this domainNumber, or -1 for any.
+ * @tsp:            accept only this transportSpecific, already shifted
+ *                  into the upper nibble, or -1 for any.
+ * @drop:           message types to drop, as a bit mask of 1 << type.
+ * @drop_multicast: message types to drop unless the unicast flag is set.
+ * @parent_only:    message types to accept only from 'parent'.
+ * @parent:         the port identity of the parent.
+ * @block:          drop all messages from this clock, or NULL.
+ */
+struct transport_filter {
+	int domain;
+	int tsp;
+	uint16_t drop;
+	uint16_t drop_multicast;
+	uint16_t parent_only;
+	struct PortIdentity parent;
+	struct ClockIdentity *block;
+};
+
+/**
+ * Installs a filter for the received messages in the kernel. A transport
+ * without filtering support silently accepts all messages.
+ * @param t    The transport.
+ * @param fda  The array of descriptors filled in by transport_open.
+ * @param f    The messages to drop.
+ * @return     Zero on success, negative value in case of an error.
+ */
+int transport_set_filter(struct transport *t, struct fdarray *fda,
+			 struct transport_filter *f);
+
 #define TRANSPORT_ADDR_LEN 16
 
 /**
@@ -26,6 +26,9 @@
 #include "fd.h"
 #include "transport.h"
 
+struct sk_rx;
+struct sk_tx;
+
 struct transport {
 	enum transport_type type;
 	struct config *cfg;
@@ -38,10 +41,24 @@ struct transport {
 	int (*recv)(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	/* Optional, transports without batching leave this NULL. */
+	int (*recv_batch)(struct transport *t, int fd, struct sk_rx *rx, int n);
+
 	int (*send)(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	/*
+	 * Optional, like recv_batch. Event messages are sent without
+	 * collecting their time stamps, see transport_txts_batch().
+	 */
+	int (*send_batch)(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, struct sk_tx *tx, int n);
+
+	/* Optional, see transport_set_filter(). */
+	int (*set_filter)(struct transport *t, struct fdarray *fda,
+			  struct transport_filter *f);
+
 	void (*release)(struct transport *t);
 
 	int (*physical_addr)(struct transport *t, uint8_t *addr);
@@ -0,0 +1,350 @@
+/**
+ * @file twheel.c
+ * @brief Implements a hierarchical timer wheel driven by a single timerfd.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "missing.h"
+#include "print.h"
+#include "twheel.h"
+
+#define NS_PER_SEC	1000000000LL
+
+/*
+ * One tick is 2^20 ns, about one millisecond. The root level covers
+ * the next 256 ticks, and each of the upper levels is 64 times as
+ * coarse as the one below it, for a total range of about 19 hours.
+ * Timers further in the future are parked in the last slot and are
+ * re-queued when that slot cascades.
+ *
+ * The ticks only select the slot. Each timer keeps its exact
+ * expiration time, and the timerfd is programmed to the earliest one.
+ */
+#define TW_TICK_SHIFT	20
+#define TW_ROOT_BITS	8
+#define TW_LEVEL_BITS	6
+#define TW_LEVELS	3
+#define TW_ROOT_SIZE	(1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE	(1 << TW_LEVEL_BITS)
+#define TW_ROOT_MASK	(TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK	(TW_LEVEL_SIZE - 1)
+#define TW_MAX_DELTA	((1ULL << (TW_ROOT_BITS + TW_LEVELS * TW_LEVEL_BITS)) - 1)
+
+enum {
+	TW_IDLE,
+	TW_QUEUED,	/* in a root slot */
+	TW_QUEUED_UPPER,	/* in an upper level slot */
+	TW_EXPIRED,
+	TW_FIRED,	/* handed out by twheel_expired() */
+};
+
+LIST_HEAD(twheel_slot, twheel_timer);
+
+struct twheel {
+	int fd;
+	uint64_t tick;		/* the next tick to be processed */
+	int64_t armed;		/* programmed deadline, or zero */
+	unsigned int count;	/* number of queued timers */
+	unsigned int upper;	/* of which in the upper levels */
+	struct twheel_slot root[TW_ROOT_SIZE];
+	struct twheel_slot level[TW_LEVELS][TW_LEVEL_SIZE];
+	struct twheel_slot expired;
+};
+
+static int64_t tw_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static int tw_index(uint64_t tick, int level)
+{
+	return (tick >> (TW_ROOT_BITS + level * TW_LEVEL_BITS)) & TW_LEVEL_MASK;
+}
+
+static void tw_queue(struct twheel *w, struct twheel_timer *t)
+{
+	uint64_t delta, exp;
+	int i;
+
+	exp = t->expires >> TW_TICK_SHIFT;
+	if (exp < w->tick) {
+		exp = w->tick;
+	}
+	delta = exp - w->tick;
+
+	t->state = TW_QUEUED;
+	w->count++;
+
+	if (delta < TW_ROOT_SIZE) {
+		LIST_INSERT_HEAD(&w->root[exp & TW_ROOT_MASK], t, list);
+		return;
+	}
+	if (delta > TW_MAX_DELTA) {
+		delta = TW_MAX_DELTA;
+		exp = w->tick + delta;
+	}
+	for (i = 0; i < TW_LEVELS - 1; i++) {
+		if (delta < 1ULL << (TW_ROOT_BITS + (i + 1) * TW_LEVEL_BITS)) {
+			break;
+		}
+	}
+	t->state = TW_QUEUED_UPPER;
+	w->upper++;
+	LIST_INSERT_HEAD(&w->level[i][tw_index(exp, i)], t, list);
+}
+
+static void tw_unlink(struct twheel *w, struct twheel_timer *t)
+{
+	if (t->state == TW_QUEUED_UPPER) {
+		w->upper--;
+	}
+	if (t->state == TW_QUEUED || t->state == TW_QUEUED_UPPER) {
+		w->count--;
+	}
+	if (t->state != TW_IDLE && t->state != TW_FIRED) {
+		LIST_REMOVE(t, list);
+	}
+	t->state = TW_IDLE;
+}
+
+/*
+ * Re-queues the timers of the upper level slots which the current tick
+ * just reached, from the top down, so that they trickle into the root.
+ * Doing this twice for the same tick is harmless.
+ */
+static void tw_cascade(struct twheel *w)
+{
+	struct twheel_slot *slot;
+	struct twheel_timer *t;
+	int i, n;
+
+	if (w->tick & TW_ROOT_MASK) {
+		return;
+	}
+	for (n = 1; n < TW_LEVELS; n++) {
+		if (tw_index(w->tick, n - 1)) {
+			break;
+		}
+	}
+	for (i = n - 1; i >= 0; i--) {
+		slot = &w->level[i][tw_index(w->tick, i)];
+		while ((t = LIST_FIRST(slot)) != NULL) {
+			tw_unlink(w, t);
+			tw_queue(w, t);
+		}
+	}
+}
+
+static int64_t tw_next_deadline(struct twheel *w)
+{
+	struct twheel_slot *slot;
+	struct twheel_timer *t;
+	int64_t cascade, deadline = 0;
+	int i;
+
+	if (!w->count) {
+		return 0;
+	}
+	for (i = 0; i < TW_ROOT_SIZE && w->count > w->upper; i++) {
+		slot = &w->root[(w->tick + i) & TW_ROOT_MASK];
+		LIST_FOREACH(t, slot, list) {
+			if (!deadline || t->expires < deadline) {
+				deadline = t->expires;
+			}
+		}
+		if (deadline) {
+			break;
+		}
+	}
+	/*
+	 * The timers of the upper levels may be due before the first
+	 * root timer, so wake up to cascade them at the next boundary.
+	 */
+	if (w->upper) {
+		cascade = ((w->tick | TW_ROOT_MASK) + 1) << TW_TICK_SHIFT;
+		if (!deadline || cascade < deadline) {
+			deadline = cascade;
+		}
+	}
+	return deadline;
+}
+
+static int tw_program(struct twheel *w, int64_t deadline)
+{
+	struct itimerspec tmo;
+
+	memset(&tmo, 0, sizeof(tmo));
+	if (deadline) {
+		/* An expiration time of zero would disarm the timerfd. */
+		if (deadline < 1) {
+			deadline = 1;
+		}
+		tmo.it_value.tv_sec = deadline / NS_PER_SEC;
+		tmo.it_value.tv_nsec = deadline % NS_PER_SEC;
+	}
+	if (timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &tmo, NULL)) {
+		pr_err("timerfd_settime failed: %m");
+		return -1;
+	}
+	w->armed = deadline;
+	return 0;
+}
+
+static int tw_insert(struct twheel *w, struct twheel_timer *t, int64_t expires)
+{
+	tw_unlink(w, t);
+	t->expires = expires;
+	tw_queue(w, t);
+
+	/*
+	 * Only reprogram the timerfd when the new timer expires first.
+	 * Removed timers may cause a spurious wake up, which is cheaper
+	 * than a system call on every change.
+	 */
+	if (!w->armed || expires < w->armed) {
+		return tw_program(w, expires);
+	}
+	return 0;
+}
+
+struct twheel *twheel_create(void)
+{
+	struct twheel *w;
+	int i, j;
+
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		return NULL;
+	}
+	w->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (w->fd < 0) {
+		pr_err("timerfd_create failed: %m");
+		free(w);
+		return NULL;
+	}
+	for (i = 0; i < TW_ROOT_SIZE; i++) {
+		LIST_INIT(&w->root[i]);
+	}
+	for (i = 0; i < TW_LEVELS; i++) {
+		for (j = 0; j < TW_LEVEL_SIZE; j++) {
+			LIST_INIT(&w->level[i][j]);
+		}
+	}
+	LIST_INIT(&w->expired);
+	w->tick = tw_now() >> TW_TICK_SHIFT;
+	return w;
+}
+
+void twheel_destroy(struct twheel *w)
+{
+	close(w->fd);
+	free(w);
+}
+
+int twheel_fd(struct twheel *w)
+{
+	return w->fd;
+}
+
+int twheel_set(struct twheel *w, struct twheel_timer *t, uint64_t ns)
+{
+	if (!ns) {
+		twheel_clr(w, t);
+		return 0;
+	}
+	return tw_insert(w, t, tw_now() + ns);
+}
+
+int twheel_set_abs(struct twheel *w, struct twheel_timer *t,
+		   struct timespec *ts)
+{
+	if (!ts->tv_sec && !ts->tv_nsec) {
+		twheel_clr(w, t);
+		return 0;
+	}
+	return tw_insert(w, t, ts->tv_sec * NS_PER_SEC + ts->tv_nsec);
+}
+
+void twheel_clr(struct twheel *w, struct twheel_timer *t)
+{
+	tw_unlink(w, t);
+}
+
+int twheel_advance(struct twheel *w)
+{
+	struct twheel_timer *t, *next;
+	struct twheel_slot *slot;
+	uint64_t expirations;
+	int64_t now;
+	uint64_t now_tick;
+
+	if (read(w->fd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN) {
+		pr_err("read on timer wheel failed: %m");
+		return -1;
+	}
+	now = tw_now();
+	now_tick = now >> TW_TICK_SHIFT;
+
+	if (!w->count) {
+		w->tick = now_tick;
+		return tw_program(w, 0);
+	}
+	for (;;) {
+		tw_cascade(w);
+		slot = &w->root[w->tick & TW_ROOT_MASK];
+		for (t = LIST_FIRST(slot); t; t = next) {
+			next = LIST_NEXT(t, list);
+			if (t->expires <= now) {
+				tw_unlink(w, t);
+				LIST_INSERT_HEAD(&w->expired, t, list);
+				t->state = TW_EXPIRED;
+			}
+		}
+		/* The current tick may be only partially processed. */
+		if (w->tick >= now_tick) {
+			break;
+		}
+		w->tick++;
+	}
+	return tw_program(w, tw_next_deadline(w));
+}
+
+struct twheel_timer *twheel_expired(struct twheel *w)
+{
+	struct twheel_timer *t;
+
+	t = LIST_FIRST(&w->expired);
+	if (t) {
+		tw_unlink(w, t);
+		t->state = TW_FIRED;
+	}
+	return t;
+}
+
+int twheel_fired(struct twheel_timer *t)
+{
+	return t->state == TW_FIRED;
+}
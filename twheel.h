@@ -0,0 +1,113 @@
+/**
+ * @file twheel.h
+ * @brief Implements a hierarchical timer wheel driven by a single timerfd.
+ * @note Copyright (C) 2026 The linuxptp project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_TWHEEL_H
+#define HAVE_TWHEEL_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+#include <time.h>
+
+/** Opaque type */
+struct twheel;
+
+/**
+ * A single one-shot timer. The storage belongs to the user of the
+ * wheel, but all fields except 'cookie' are private to the wheel.
+ */
+struct twheel_timer {
+	LIST_ENTRY(twheel_timer) list;
+	int64_t expires;	/* CLOCK_MONOTONIC, in nanoseconds */
+	int state;
+	void *cookie;		/* for the user of the wheel */
+};
+
+/**
+ * Create a new timer wheel.
+ * @return  A pointer to a new timer wheel on success, NULL otherwise.
+ */
+struct twheel *twheel_create(void);
+
+/**
+ * Destroy a timer wheel. Timers still armed are simply forgotten.
+ * @param w  Pointer obtained via @ref twheel_create().
+ */
+void twheel_destroy(struct twheel *w);
+
+/**
+ * Obtain the file descriptor which becomes readable whenever at least
+ * one timer of the wheel has expired.
+ * @param w  Pointer obtained via @ref twheel_create().
+ * @return   A timerfd(2) descriptor.
+ */
+int twheel_fd(struct twheel *w);
+
+/**
+ * Arm a timer relative to the current time. Arming a timer which is
+ * already pending moves it to the new expiration time.
+ * @param w   Pointer obtained via @ref twheel_create().
+ * @param t   The timer to arm.
+ * @param ns  The timeout in nanoseconds. Passing zero disarms the timer.
+ * @return    Zero on success, non-zero otherwise.
+ */
+int twheel_set(struct twheel *w, struct twheel_timer *t, uint64_t ns);
+
+/**
+ * Arm a timer to an absolute CLOCK_MONOTONIC time.
+ * @param w   Pointer obtained via @ref twheel_create().
+ * @param t   The timer to arm.
+ * @param ts  The expiration time. Passing zero disarms the timer.
+ * @return    Zero on success, non-zero otherwise.
+ */
+int twheel_set_abs(struct twheel *w, struct twheel_timer *t,
+		   struct timespec *ts);
+
+/**
+ * Disarm a timer. Disarming a timer which is not pending has no effect.
+ * @param w  Pointer obtained via @ref twheel_create().
+ * @param t  The timer to disarm.
+ */
+void twheel_clr(struct twheel *w, struct twheel_timer *t);
+
+/**
+ * Advance the wheel to the current time. This must be called when the
+ * descriptor from @ref twheel_fd() is readable. The expired timers are
+ * then available via @ref twheel_expired().
+ * @param w  Pointer obtained via @ref twheel_create().
+ * @return   Zero on success, non-zero otherwise.
+ */
+int twheel_advance(struct twheel *w);
+
+/**
+ * Remove the next expired timer from the wheel. The caller must drain
+ * all expired timers after each call to @ref twheel_advance().
+ * @param w  Pointer obtained via @ref twheel_create().
+ * @return   An expired timer, or NULL if there are no more.
+ */
+struct twheel_timer *twheel_expired(struct twheel *w);
+
+/**
+ * Test whether a timer has been returned by @ref twheel_expired() and
+ * has been neither armed nor disarmed since then.
+ * @param t  The timer to test.
+ * @return   Non-zero if the expiry is still to be handled, zero otherwise.
+ */
+int twheel_fired(struct twheel_timer *t);
+
+#endif
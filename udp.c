@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -90,6 +91,19 @@ static int udp_close(struct transport *t, struct fdarray *fda)
 	return 0;
 }
 
+/* The filter of a UDP socket sees the packet from the UDP header on. */
+static int udp_set_filter(struct transport *t, struct fdarray *fda,
+			  struct transport_filter *f)
+{
+	if (sk_set_filter(fda->fd[FD_EVENT], NULL, 0, sizeof(struct udphdr),
+			  0xffff, -1, f) ||
+	    sk_set_filter(fda->fd[FD_GENERAL], NULL, 0, sizeof(struct udphdr),
+			  0xffff, -1, f)) {
+		return -1;
+	}
+	return 0;
+}
+
 static int open_socket(const char *name, struct in_addr mc_addr[2], short port,
 		       int ttl)
 {
@@ -213,6 +227,11 @@ static int udp_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
 }
 
+static int udp_recv_batch(struct transport *t, int fd, struct sk_rx *rx, int n)
+{
+	return sk_receive_batch(fd, rx, n, MSG_DONTWAIT);
+}
+
 static int udp_send(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int len,
 		    struct address *addr, struct hw_timestamp *hwts)
@@ -264,6 +283,33 @@ static int udp_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp_send_batch(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, struct sk_tx *tx, int n)
+{
+	struct address addr_buf;
+	int fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	memset(&addr_buf, 0, sizeof(addr_buf));
+	addr_buf.sin.sin_family = AF_INET;
+	addr_buf.sin.sin_addr = mcast_addr[MC_PRIMARY];
+	addr_buf.len = sizeof(addr_buf.sin);
+
+	for (i = 0; i < n; i++) {
+		if (!tx[i].addr) {
+			tx[i].addr = &addr_buf;
+		}
+		tx[i].addr->sin.sin_port =
+			htons(event ? EVENT_PORT : GENERAL_PORT);
+		/* See udp_send() about the extra two bytes. */
+		if (event == TRANS_ONESTEP) {
+			tx[i].len += 2;
+		}
+	}
+	return sk_send_batch(fd, tx, n, sizeof(addr_buf.sin));
+}
+
 static void udp_release(struct transport *t)
 {
 	struct udp *udp = container_of(t, struct udp, t);
@@ -302,7 +348,10 @@ struct transport *udp_transport_create(void)
 	udp->t.close = udp_close;
 	udp->t.open  = udp_open;
 	udp->t.recv  = udp_recv;
+	udp->t.recv_batch = udp_recv_batch;
 	udp->t.send  = udp_send;
+	udp->t.send_batch = udp_send_batch;
+	udp->t.set_filter = udp_set_filter;
 	udp->t.release = udp_release;
 	udp->t.physical_addr = udp_physical_addr;
 	udp->t.protocol_addr = udp_protocol_addr;
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -101,6 +102,19 @@ static int udp6_close(struct transport *t, struct fdarray *fda)
 	return 0;
 }
 
+/* The filter of a UDP socket sees the packet from the UDP header on. */
+static int udp6_set_filter(struct transport *t, struct fdarray *fda,
+			   struct transport_filter *f)
+{
+	if (sk_set_filter(fda->fd[FD_EVENT], NULL, 0, sizeof(struct udphdr),
+			  0xffff, -1, f) ||
+	    sk_set_filter(fda->fd[FD_GENERAL], NULL, 0, sizeof(struct udphdr),
+			  0xffff, -1, f)) {
+		return -1;
+	}
+	return 0;
+}
+
 static int open_socket_ipv6(const char *name, struct in6_addr mc_addr[2], short port,
 			    int *interface_index, int hop_limit)
 {
@@ -230,6 +244,11 @@ static int udp6_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
 }
 
+static int udp6_recv_batch(struct transport *t, int fd, struct sk_rx *rx, int n)
+{
+	return sk_receive_batch(fd, rx, n, MSG_DONTWAIT);
+}
+
 static int udp6_send(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, int peer, void *buf, int len,
 		     struct address *addr, struct hw_timestamp *hwts)
@@ -279,6 +298,33 @@ static int udp6_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp6_send_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event, struct sk_tx *tx, int n)
+{
+	struct udp6 *udp6 = container_of(t, struct udp6, t);
+	struct address addr_buf;
+	int fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	memset(&addr_buf, 0, sizeof(addr_buf));
+	addr_buf.sin6.sin6_family = AF_INET6;
+	addr_buf.sin6.sin6_addr = udp6->mc6_addr[MC_PRIMARY];
+	if (is_link_local(&addr_buf.sin6.sin6_addr))
+		addr_buf.sin6.sin6_scope_id = udp6->index;
+	addr_buf.len = sizeof(addr_buf.sin6);
+
+	for (i = 0; i < n; i++) {
+		if (!tx[i].addr) {
+			tx[i].addr = &addr_buf;
+		}
+		tx[i].addr->sin6.sin6_port =
+			htons(event ? EVENT_PORT : GENERAL_PORT);
+		tx[i].len += 2; /* For UDP checksum corrections. */
+	}
+	return sk_send_batch(fd, tx, n, sizeof(addr_buf.sin6));
+}
+
 static void udp6_release(struct transport *t)
 {
 	struct udp6 *udp6 = container_of(t, struct udp6, t);
@@ -318,7 +364,10 @@ struct transport *udp6_transport_create(void)
 	udp6->t.close   = udp6_close;
 	udp6->t.open    = udp6_open;
 	udp6->t.recv    = udp6_recv;
+	udp6->t.recv_batch = udp6_recv_batch;
 	udp6->t.send    = udp6_send;
+	udp6->t.send_batch = udp6_send_batch;
+	udp6->t.set_filter = udp6_set_filter;
 	udp6->t.release = udp6_release;
 	udp6->t.physical_addr = udp6_physical_addr;
 	udp6->t.protocol_addr = udp6_protocol_addr;
@@ -350,7 +350,7 @@ int unicast_client_initialize(struct port *p)
 	struct unicast_master_table *table;
 	int table_id;
 
-	table_id = config_get_int(cfg, p->name, "unicast_master_table");
+	table_id = config_int(cfg, p->cfg_section, CFG_UNICAST_MASTER_TABLE);
 	if (!table_id) {
 		return 0;
 	}
@@ -390,7 +390,7 @@ int unicast_client_initialize(struct port *p)
 	table->port = portnum(p);
 	p->unicast_master_table = table;
 	p->unicast_req_duration =
-		config_get_int(cfg, p->name, "unicast_req_duration");
+		config_int(cfg, p->cfg_section, CFG_UNICAST_REQ_DURATION);
 	return 0;
 }
 
@@ -493,7 +493,7 @@ void unicast_client_grant(struct port *p, struct ptp_message *m,
 
 int unicast_client_set_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_UNICAST_REQ_TIMER], 1,
+	return set_tmo_log(p, FD_UNICAST_REQ_TIMER, 1,
 			   p->unicast_master_table->logQueryInterval);
 }
 
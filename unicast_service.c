@@ -28,21 +28,42 @@
 #include "port_private.h"
 #include "pqueue.h"
 #include "print.h"
+#include "sk.h"
+#include "twheel.h"
 #include "unicast_service.h"
 #include "util.h"
 
 #define QUEUE_LEN 16
 
+/*
+ * The clients of all intervals are indexed by address, as one client
+ * may hold grants in more than one interval.
+ */
+#define HASH_BITS	12
+#define HASH_SIZE	(1 << HASH_BITS)
+
+/*
+ * Grants are filed by the second of their expiration into a wheel of
+ * EXPIRY_SLOTS seconds. Renewals leave the record in place, and the
+ * reaper moves it to its new slot once it gets there.
+ */
+#define EXPIRY_SLOTS	256
+
 struct unicast_client_address {
 	LIST_ENTRY(unicast_client_address) list;
+	LIST_ENTRY(unicast_client_address) hash;
+	LIST_ENTRY(unicast_client_address) expiry;
+	struct unicast_service_interval *interval;
 	struct PortIdentity portIdentity;
 	unsigned int message_types;
 	struct address addr;
 	time_t grant_tmo;
 };
 
+LIST_HEAD(uca, unicast_client_address);
+
 struct unicast_service_interval {
-	LIST_HEAD(uca, unicast_client_address) clients;
+	struct uca clients;
 	LIST_ENTRY(unicast_service_interval) list;
 	struct timespec incr;
 	struct timespec tmo;
@@ -52,6 +73,9 @@ struct unicast_service_interval {
 struct unicast_service {
 	LIST_HEAD(usi, unicast_service_interval) intervals;
 	struct pqueue *queue;
+	struct uca hash[HASH_SIZE];
+	struct uca expiry[EXPIRY_SLOTS];
+	time_t reaped;	/* the next second to be reaped */
 };
 
 static struct timespec log_to_timespec(int log_seconds);
@@ -90,6 +114,88 @@ static int compare_timeout(void *ain, void *bin)
 	return timespec_compare(&a->tmo, &b->tmo);
 }
 
+static unsigned int client_hash(enum transport_type type, struct address *a)
+{
+	unsigned int i, len, hash = 2166136261u;
+	unsigned char *buf;
+
+	switch (type) {
+	case TRANS_UDP_IPV4:
+		buf = (unsigned char *) &a->sin.sin_addr;
+		len = sizeof(a->sin.sin_addr);
+		break;
+	case TRANS_UDP_IPV6:
+		buf = (unsigned char *) &a->sin6.sin6_addr;
+		len = sizeof(a->sin6.sin6_addr);
+		break;
+	case TRANS_IEEE_802_3:
+		buf = (unsigned char *) &a->sll.sll_addr;
+		len = MAC_LEN;
+		break;
+	default:
+		return 0;
+	}
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		hash ^= buf[i];
+		hash *= 16777619u;
+	}
+	return (hash ^ (hash >> HASH_BITS)) & (HASH_SIZE - 1);
+}
+
+static struct uca *client_bucket(struct port *p, struct address *a)
+{
+	return &p->unicast_service->hash[client_hash(transport_type(p->trp), a)];
+}
+
+static void client_expiry_insert(struct unicast_service *s,
+				 struct unicast_client_address *client)
+{
+	time_t t = client->grant_tmo < s->reaped ? s->reaped : client->grant_tmo;
+
+	LIST_INSERT_HEAD(&s->expiry[t % EXPIRY_SLOTS], client, expiry);
+}
+
+static void client_remove(struct unicast_client_address *client)
+{
+	LIST_REMOVE(client, list);
+	LIST_REMOVE(client, hash);
+	LIST_REMOVE(client, expiry);
+	free(client);
+}
+
+/*
+ * Drops the grants which expired before 'now', visiting only the
+ * slots of the seconds which passed since the last call.
+ */
+static void unicast_service_reap(struct unicast_service *s, time_t now)
+{
+	struct unicast_client_address *client, *next;
+	struct uca *slot;
+
+	if (now - s->reaped > EXPIRY_SLOTS) {
+		s->reaped = now - EXPIRY_SLOTS;
+	}
+	for (; s->reaped < now; s->reaped++) {
+		slot = &s->expiry[s->reaped % EXPIRY_SLOTS];
+		LIST_FOREACH_SAFE(client, slot, expiry, next) {
+			if (client->grant_tmo < now) {
+				pr_debug("%s service of 0x%x expired",
+					 pid2str(&client->portIdentity),
+					 client->message_types);
+				client_remove(client);
+				continue;
+			}
+			if (client->grant_tmo % EXPIRY_SLOTS !=
+			    s->reaped % EXPIRY_SLOTS) {
+				/* The grant was renewed meanwhile. */
+				LIST_REMOVE(client, expiry);
+				client_expiry_insert(s, client);
+			}
+		}
+	}
+}
+
 static void initialize_interval(struct unicast_service_interval *interval,
 				int log_period)
 {
@@ -160,37 +266,42 @@ static void timespec_normalize(struct timespec *ts)
 static int unicast_service_clients(struct port *p,
 				   struct unicast_service_interval *interval)
 {
-	struct unicast_client_address *client, *next;
-	struct timespec now;
-	int err = 0;
+	struct address *announce[SK_TX_BATCH_MAX], *sync[SK_TX_BATCH_MAX];
+	int err = 0, n_announce = 0, n_sync = 0;
+	struct unicast_client_address *client;
 
-	err = clock_gettime(CLOCK_MONOTONIC, &now);
-	if (err) {
-		pr_err("clock_gettime failed: %m");
-		return err;
-	}
-	LIST_FOREACH_SAFE(client, &interval->clients, list, next) {
+	LIST_FOREACH(client, &interval->clients, list) {
 		pr_debug("%s wants 0x%x", pid2str(&client->portIdentity),
 			 client->message_types);
-		if (now.tv_sec > client->grant_tmo) {
-			pr_debug("%s service of 0x%x expired",
-				 pid2str(&client->portIdentity),
-				 client->message_types);
-			LIST_REMOVE(client, list);
-			free(client);
-			continue;
-		}
+		/*
+		 * Collect the destinations, so that the messages of all
+		 * clients sharing this interval go out in batches.
+		 */
 		if (client->message_types & (1 << ANNOUNCE)) {
-			if (port_tx_announce(p, &client->addr)) {
-				err = -1;
+			announce[n_announce++] = &client->addr;
+			if (n_announce == SK_TX_BATCH_MAX) {
+				if (port_tx_announce_batch(p, announce, n_announce)) {
+					err = -1;
+				}
+				n_announce = 0;
 			}
 		}
 		if (client->message_types & (1 << SYNC)) {
-			if (port_tx_sync(p, &client->addr)) {
-				err = -1;
+			sync[n_sync++] = &client->addr;
+			if (n_sync == SK_TX_BATCH_MAX) {
+				if (port_tx_sync_batch(p, sync, n_sync)) {
+					err = -1;
+				}
+				n_sync = 0;
 			}
 		}
 	}
+	if (n_announce && port_tx_announce_batch(p, announce, n_announce)) {
+		err = -1;
+	}
+	if (n_sync && port_tx_sync_batch(p, sync, n_sync)) {
+		err = -1;
+	}
 	return err;
 }
 
@@ -218,20 +329,19 @@ static void unicast_service_extend(struct unicast_client_address *client,
 static int unicast_service_rearm_timer(struct port *p)
 {
 	struct unicast_service_interval *interval;
-	struct itimerspec tmo;
-	int fd;
+	struct timespec tmo;
 
-	fd = p->fda.fd[FD_UNICAST_SRV_TIMER];
 	memset(&tmo, 0, sizeof(tmo));
 	interval = pqueue_peek(p->unicast_service->queue);
 	if (interval) {
-		tmo.it_value = interval->tmo;
+		tmo = interval->tmo;
 		pr_debug("arming timer tmo={%lld,%ld}",
 			 (long long)interval->tmo.tv_sec, interval->tmo.tv_nsec);
 	} else {
 		pr_debug("stopping unicast service timer");
 	}
-	return timerfd_settime(fd, TFD_TIMER_ABSTIME, &tmo, NULL);
+	return twheel_set_abs(clock_twheel(p->clock),
+			      port_timer(p, FD_UNICAST_SRV_TIMER), &tmo);
 }
 
 static int unicast_service_reply(struct port *p, struct ptp_message *dst,
@@ -267,6 +377,7 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 	struct unicast_client_address *client = NULL, *ctmp, *next;
 	struct unicast_service_interval *interval = NULL, *itmp;
 	struct request_unicast_xmit_tlv *req;
+	struct uca *bucket;
 	unsigned int mask;
 	uint8_t mtype;
 
@@ -289,37 +400,37 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 		return SERVICE_DENIED;
 	}
 
+	/*
+	 * Remember the interval of interest.
+	 */
 	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		/*
-		 * Remember the interval of interest.
-		 */
 		if (itmp->log_period == req->logInterMessagePeriod) {
 			interval = itmp;
+			break;
 		}
-		/*
-		 * Find any client records, and remove any stale contract.
-		 */
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (interval == itmp) {
-				if (ctmp->message_types & mask) {
-					/* Contract is unchanged. */
-					unicast_service_extend(ctmp, req);
-					return SERVICE_GRANTED;
-				}
-				/* This is the one to use. */
-				client = ctmp;
-				continue;
-			}
-			/* Clear any stale contracts. */
-			ctmp->message_types &= ~mask;
-			if (!ctmp->message_types) {
-				LIST_REMOVE(ctmp, list);
-				free(ctmp);
+	}
+	/*
+	 * Find any client records, and remove any stale contract.
+	 */
+	bucket = client_bucket(p, &m->address);
+	LIST_FOREACH_SAFE(ctmp, bucket, hash, next) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->interval == interval) {
+			if (ctmp->message_types & mask) {
+				/* Contract is unchanged. */
+				unicast_service_extend(ctmp, req);
+				return SERVICE_GRANTED;
 			}
+			/* This is the one to use. */
+			client = ctmp;
+			continue;
+		}
+		/* Clear any stale contracts. */
+		ctmp->message_types &= ~mask;
+		if (!ctmp->message_types) {
+			client_remove(ctmp);
 		}
 	}
 
@@ -354,7 +465,10 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 		}
 		unicast_service_rearm_timer(p);
 	}
+	client->interval = interval;
 	LIST_INSERT_HEAD(&interval->clients, client, list);
+	LIST_INSERT_HEAD(bucket, client, hash);
+	client_expiry_insert(p->unicast_service, client);
 	return SERVICE_GRANTED;
 }
 
@@ -368,8 +482,7 @@ void unicast_service_cleanup(struct port *p)
 	}
 	LIST_FOREACH_SAFE(itmp, &p->unicast_service->intervals, list, inext) {
 		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, cnext) {
-			LIST_REMOVE(ctmp, list);
-			free(ctmp);
+			client_remove(ctmp);
 		}
 		LIST_REMOVE(itmp, list);
 		free(itmp);
@@ -399,8 +512,10 @@ int unicast_service_grant(struct port *p, struct ptp_message *m,
 int unicast_service_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
+	struct timespec now;
+	int i;
 
-	if (!config_get_int(cfg, p->name, "unicast_listen")) {
+	if (!config_int(cfg, p->cfg_section, CFG_UNICAST_LISTEN)) {
 		return 0;
 	}
 	if (config_set_section_int(cfg, p->name, "hybrid_e2e", 1)) {
@@ -411,6 +526,14 @@ int unicast_service_initialize(struct port *p)
 		return -1;
 	}
 	LIST_INIT(&p->unicast_service->intervals);
+	for (i = 0; i < HASH_SIZE; i++) {
+		LIST_INIT(&p->unicast_service->hash[i]);
+	}
+	for (i = 0; i < EXPIRY_SLOTS; i++) {
+		LIST_INIT(&p->unicast_service->expiry[i]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	p->unicast_service->reaped = now.tv_sec;
 
 	p->unicast_service->queue = pqueue_create(QUEUE_LEN, compare_timeout);
 	if (!p->unicast_service->queue) {
@@ -418,7 +541,7 @@ int unicast_service_initialize(struct port *p)
 		return -1;
 	}
 	p->inhibit_multicast_service =
-		config_get_int(cfg, p->name, "inhibit_multicast_service");
+		config_int(cfg, p->cfg_section, CFG_INHIBIT_MULTICAST_SERVICE);
 
 	return 0;
 }
@@ -428,7 +551,7 @@ void unicast_service_remove(struct port *p, struct ptp_message *m,
 {
 	struct unicast_client_address *ctmp, *next;
 	struct cancel_unicast_xmit_tlv *cancel;
-	struct unicast_service_interval *itmp;
+	struct uca *bucket;
 	unsigned int mask;
 	uint8_t mtype;
 
@@ -452,20 +575,17 @@ void unicast_service_remove(struct port *p, struct ptp_message *m,
 		return;
 	}
 
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (ctmp->message_types & mask) {
-				ctmp->message_types &= ~mask;
-				if (!ctmp->message_types) {
-					LIST_REMOVE(ctmp, list);
-					free(ctmp);
-				}
-				return;
+	bucket = client_bucket(p, &m->address);
+	LIST_FOREACH_SAFE(ctmp, bucket, hash, next) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->message_types & mask) {
+			ctmp->message_types &= ~mask;
+			if (!ctmp->message_types) {
+				client_remove(ctmp);
 			}
+			return;
 		}
 	}
 }
@@ -497,6 +617,8 @@ int unicast_service_timer(struct port *p)
 		break;
 	}
 
+	unicast_service_reap(p->unicast_service, now.tv_sec);
+
 	while ((interval = pqueue_peek(p->unicast_service->queue)) != NULL) {
 
 		pr_debug("peek i={2^%d} tmo={%lld,%ld}", interval->log_period,